@@ -0,0 +1,215 @@
+""" Thermistor calibration capture
+
+Builds a calibration file for thermistor_calibration.py from the raw ADC
+readings of the unit itself, instead of reading the resistance of the
+thermistor by hand.
+
+1. Flash the capture firmware and connect a serial adapter (9600 8N1) to
+   PB4, the LED2 pin.
+
+> make -C ../firmware NAME=therm_capture avrdude
+
+2. Record the stream while the thermistor and the probe of a reference
+   thermometer sit together in a bath that slowly changes temperature.
+   Every line is stamped with the time of the host. Stop with Ctrl-C.
+
+> python capture.py -p /dev/ttyUSB0 -o raw.txt
+
+3. Pair the readings with the log of the reference thermometer. Each
+   line of the log is "time temperature", the time either in seconds
+   since the epoch or as "YYYY-MM-DD HH:MM:SS". The ADC readings within
+   a window around each reference reading are reduced to their median
+   and converted to a resistance through the R2 divider.
+
+> python capture.py -a raw.txt -r reference.txt -o data.txt
+
+Since the resistance is computed from what the ADC sees, the fit made from
+this file also absorbs the tolerance of R2 and the offset and gain of the
+ADC, not only the thermistor.
+
+(c) 2014, Robin Scheibler/fakufaku
+This script is released in the public domain.
+"""
+
+from __future__ import division, print_function
+
+import numpy as np
+import datetime
+import time
+import sys
+
+
+def record(port, baud, rawfile):
+    ''' Save the stream of the capture firmware with host timestamps '''
+    import serial
+
+    s = serial.Serial(port, baud, timeout=1)
+    f = open(rawfile, 'w')
+    f.write('# host time [s], sequence number, adc\n')
+
+    n = 0
+    lost = 0
+    last = None
+    try:
+        while True:
+            line = s.readline().decode('ascii', 'ignore').split()
+            if len(line) != 2 or not line[0].isdigit() or not line[1].isdigit():
+                continue
+            seq, adc = int(line[0]), int(line[1])
+            if last is not None:
+                lost += (seq - last - 1) % 65536
+            last = seq
+            f.write('%.3f %d %d\n' % (time.time(), seq, adc))
+            n += 1
+            if n % 1000 == 0:
+                print('%d readings, %d lost, last adc %d' % (n, lost, adc))
+    except KeyboardInterrupt:
+        pass
+
+    f.close()
+    s.close()
+    print('%d readings, %d lost, saved to %s' % (n, lost, rawfile))
+
+
+def parse_time(tokens):
+    ''' Seconds since the epoch from "1402988400.5" or "2014-06-17 08:00:00" '''
+    if '-' not in tokens[0] and ':' not in tokens[0]:
+        return float(tokens[0]), tokens[1:]
+    if 'T' in tokens[0]:
+        stamp, n = tokens[0].replace('T', ' '), 1
+    else:
+        stamp, n = ' '.join(tokens[:2]), 2
+    fmt = '%Y-%m-%d %H:%M:%S.%f' if '.' in stamp else '%Y-%m-%d %H:%M:%S'
+    d = datetime.datetime.strptime(stamp, fmt)
+    return time.mktime(d.timetuple()) + d.microsecond * 1e-6, tokens[n:]
+
+
+def load_reference(reffile):
+    t, temp = [], []
+    for line in open(reffile):
+        tokens = line.replace(',', ' ').split()
+        if len(tokens) < 2 or line.startswith('#'):
+            continue
+        stamp, rest = parse_time(tokens)
+        t.append(stamp)
+        temp.append(float(rest[-1]))
+    return np.array(t), np.array(temp)
+
+
+def pair(rawfile, reffile, outfile, R2, B, window, offset, min_readings):
+    ''' Median ADC reading around every reference reading, as a resistance '''
+    raw = np.loadtxt(rawfile, dtype=float, comments='#', ndmin=2)
+    order = np.argsort(raw[:, 0])
+    t_adc, adc = raw[order, 0], raw[order, 2]
+
+    t_ref, temp = load_reference(reffile)
+    t_ref = t_ref + offset
+
+    lo = np.searchsorted(t_adc, t_ref - window / 2.)
+    hi = np.searchsorted(t_adc, t_ref + window / 2.)
+
+    N = 2 ** B
+    f = open(outfile, 'w')
+    f.write('# Captured from %s and %s on %s\n' % (rawfile, reffile, time.strftime('%Y/%m/%d')))
+    f.write('# R2 = %.1f Ohm, %.1f s window\n' % (R2, window))
+    kept = 0
+    for i in range(len(t_ref)):
+        if hi[i] - lo[i] < min_readings:
+            continue
+        alpha = np.median(adc[lo[i]:hi[i]]) + 0.5
+        R = R2 * (N - alpha) / alpha
+        f.write('%.4f %.2f\n' % (R / 1000., temp[i]))
+        kept += 1
+    f.close()
+
+    print('%d of %d reference readings paired, saved to %s' % (kept, len(t_ref), outfile))
+
+
+def print_help():
+    print(sys.argv[0] + ' -p port -o raw_file')
+    print(sys.argv[0] + ' -a raw_file -r reference_file -o data_file')
+    print('Records the raw thermistor readings streamed by the therm_capture')
+    print('firmware, and pairs them with the log of a reference thermometer')
+    print('into a calibration file for thermistor_calibration.py.')
+    print('')
+    print('Options:')
+    print('   -p  the serial port to record from')
+    print('   -s  the baud rate (default 9600)')
+    print('   -a  the raw readings recorded with -p')
+    print('   -r  the reference thermometer log, "time temperature" lines')
+    print('   -o  the output file')
+    print('   -t  seconds to add to the reference times, when the thermometer')
+    print('       clock is not the one of the host (default 0)')
+    print('   -w  the averaging window around each reference reading in')
+    print('       seconds (default 10)')
+    print('   -m  the minimum number of readings in a window (default 10)')
+    print('   -B  the number of bits of the ADC (default to 10)')
+    print('   -R  the value of the serie resistance (in Ohms).')
+    print('   -h  display this help')
+
+
+def main():
+    # default values
+    port = None
+    baud = 9600
+    rawfile = None
+    reffile = None
+    outfile = None
+    offset = 0.
+    window = 10.
+    min_readings = 10
+    B = 10      # 10 bits ADC
+    R2 = 1500.  # The series resistance
+
+    # parse arguments
+    i = 1
+    while i < len(sys.argv):
+        if sys.argv[i] == '-p':
+            port = sys.argv[i + 1]
+            i += 2
+        elif sys.argv[i] == '-s':
+            baud = int(sys.argv[i + 1])
+            i += 2
+        elif sys.argv[i] == '-a':
+            rawfile = sys.argv[i + 1]
+            i += 2
+        elif sys.argv[i] == '-r':
+            reffile = sys.argv[i + 1]
+            i += 2
+        elif sys.argv[i] == '-o':
+            outfile = sys.argv[i + 1]
+            i += 2
+        elif sys.argv[i] == '-t':
+            offset = float(sys.argv[i + 1])
+            i += 2
+        elif sys.argv[i] == '-w':
+            window = float(sys.argv[i + 1])
+            i += 2
+        elif sys.argv[i] == '-m':
+            min_readings = int(sys.argv[i + 1])
+            i += 2
+        elif sys.argv[i] == '-B':
+            B = int(sys.argv[i + 1])
+            i += 2
+        elif sys.argv[i] == '-R':
+            R2 = float(sys.argv[i + 1])
+            i += 2
+        else:
+            print_help()
+            sys.exit(1)
+
+    if outfile is None:
+        print_help()
+        sys.exit(1)
+
+    if port is not None:
+        record(port, baud, outfile)
+    elif rawfile is not None and reffile is not None:
+        pair(rawfile, reffile, outfile, R2, B, window, offset, min_readings)
+    else:
+        print_help()
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
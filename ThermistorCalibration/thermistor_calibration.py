@@ -31,14 +31,28 @@ in the following in a terminal
 
 > ipython -- thermistor_calibration.py <options>
 
+To calibrate a batch of thermistors at once, put one calibration file per
+unit in a directory and run
+
+> python thermistor_calibration.py -b <directory> -O <output directory>
+
+Every unit is fitted in parallel, gets its own EEPROM record named after
+its calibration file, and units that stand out from the fleet are listed
+in the report.
 
 (c) 2014, Robin Scheibler/fakufaku
 This script is released in the public domain.
 """
 
+from __future__ import division, print_function
+
 from scipy.special import cbrt
 import numpy as np
 import matplotlib.pyplot as plt
+from multiprocessing import Pool, cpu_count
+import glob
+import os
+import struct
 import sys
 
 
@@ -77,136 +91,356 @@ def lasso(A, b, gam):
     return get_x(gam)
 
 
-def print_help():
-    print sys.argv[0], ' -i data_file -o lut_file -B bits -L lut_bits -D decimals'
-    print 'This script converts a table of thermistor calibration measurements into a'
-    print 'look-up table (LUT) in C that can be used in microcontroller such as AVR with'
-    print 'an ADC.'
-    print ''
-    print 'Options:'
-    print '   -i  the name of the file containing the calibration data'
-    print '       in the following format: two columns, comma separated, '
-    print '       "resistance [kOhms], temperature [C]" pairs. (default data.txt)'
-    print '   -o  the name of the file where to save the look-up table (default lut.txt)'
-    print '   -B  the number of bits of the ADC (default to 10)'
-    print '   -L  the number of bits for the look-up table (default to 8)'
-    print '   -D  the number of decimals to use in the look-up table. (default is 7)'
-    print '   -R  the value of the serie resistance (in Ohms).'
-    print '   -h  display this help'
-
-
-# default values
-datafile = 'data.txt'
-lutfile = 'lut.c'
-B = 10      # 10 bits ADC
-L = 8       # 256 values in the LUT
-D = 7       # values have 7 significant digits
-R2 = 1500.  # The series resistance
+# The EEPROM calibration record, see firmware/thermistor.h
+THERM_CAL_MAGIC = 0x54
+THERM_CAL_VERSION = 1
+THERM_CAL_SH = 1
+THERM_CAL_DELTA = 2
+EE_THERM_CAL = 0x000
+
+
+def fit_steinhart_hart(R, T):
+    ''' Fit 1/T = a + b ln(R) + c ln(R)^3 to resistances [Ohm] and temperatures [K] '''
+    A = np.vstack((np.ones((len(R))), np.log(R), np.log(R) ** 3)).T
+    p = np.linalg.lstsq(A, 1. / T, rcond=-1)
+    return p[0][0], p[0][1], p[0][2]
+
+
+def steinhart_hart(R, a, b, c):
+    return 1. / (a + b * np.log(R) + c * np.log(R) ** 3)
+
+
+def crc8(data):
+    ''' Dallas/Maxim CRC-8, same as _crc_ibutton_update of avr-libc '''
+    crc = 0
+    for byte in bytearray(data):
+        crc ^= byte
+        for k in range(8):
+            if crc & 1:
+                crc = (crc >> 1) ^ 0x8C
+            else:
+                crc >>= 1
+    return crc
+
+
+def therm_cal_record(kind, a=0., b=0., c=0., R2=0., delta=0.):
+    ''' Pack a struct therm_cal, delta is in Celsius '''
+    rec = struct.pack('<BBBBffffhB', THERM_CAL_MAGIC, THERM_CAL_VERSION, kind, 0,
+                      a, b, c, R2, int(round(delta * 100.)), 0)
+    return rec + struct.pack('<B', crc8(rec))
+
+
+def write_intel_hex(filename, data, address=0):
+    ''' Save a block of bytes as Intel HEX, the format avrdude reads '''
+    f = open(filename, 'w')
+    data = bytearray(data)
+    for off in range(0, len(data), 16):
+        chunk = data[off:off + 16]
+        addr = address + off
+        rec = bytearray([len(chunk), (addr >> 8) & 0xFF, addr & 0xFF, 0]) + chunk
+        f.write(':' + ''.join('%02X' % x for x in rec))
+        f.write('%02X\n' % ((-sum(rec)) & 0xFF))
+    f.write(':00000001FF\n')
+    f.close()
 
 
 # constants
 zero_celsius = 273.15
 
-# parse arguments
-i = 1
-while i < len(sys.argv):
-    if sys.argv[i] == '-i':
-        datafile = sys.argv[i + 1]
-        i += 2
-    elif sys.argv[i] == '-o':
-        lutfile = sys.argv[i + 1]
-        i += 2
-    elif sys.argv[i] == '-B':
-        B = int(sys.argv[i + 1])
-        i += 2
-    elif sys.argv[i] == '-L':
-        L = int(sys.argv[i + 1])
-        i += 2
-    elif sys.argv[i] == '-D':
-        D = int(sys.argv[i + 1])
-        i += 2
-    elif sys.argv[i] == '-R':
-        R2 = float(sys.argv[i + 1])
-        i += 2
-    else:
-        print_help()
-
-
-data = np.loadtxt(datafile, dtype=float, comments='#')
-
-# First we fit the data to the three parameters equation
-# of section 2.1.5 of AVX document.
-R = data[:, 0] * 1000.
-T = data[:, 1] + zero_celsius
-
-A = np.vstack((np.ones((len(R))), np.log(R), np.log(R) ** 3)).T
-b_vec = 1. / T
-
-p = np.linalg.lstsq(A, b_vec)
-a, b, c = p[0][0], p[0][1], p[0][2]
-
-#p = lasso(A, b_vec, 1e-4)
-#a, b, c = p[1,0], p[1,0], p[2,0]
-
-t = np.arange(0, 80) + zero_celsius
-
-r = np.arange(1, 10001)
-t = 1. / (a + b * np.log(r) + c * np.log(r) ** 3)
-
-
-# generate the lookup table
-N = 2 ** B
-div = 2 ** (B - L)
-n = np.arange(0, 2 ** L)
-alpha = (n * div + (div - 1) / 2. + 0.5) / N
-R_T = (1. / alpha - 1.) * R2
-lut = 1. / (a + b * np.log(R_T) + c * np.log(R_T) ** 3)
-
-# open and save LUT to file
-f_lut = open(lutfile, 'w')
-f_lut.write('float therm_lut[] = { ')
-format = '%.' + str(D) + 'f'
-for i in xrange(0, 2 ** L - 1):
-    f_lut.write(format % (lut[i] - zero_celsius))
-    f_lut.write(', ')
-    if (i + 1) % 10 == 0:
-        f_lut.write('\n  ')
-f_lut.write(format % lut[-1])
-f_lut.write(' };\n')
-
-# plot some stuff
-plt.subplot(2, 2, 1)
-plt.plot(r, t - zero_celsius, 'k-', R, T - zero_celsius, 'x')
-plt.xlabel('Resistance of thermistor [Ohm]')
-plt.ylabel('Temperature [Celsius]')
-plt.title('Raw')
-plt.legend(('Fitted curve', 'Measurements'))
-plt.axis('tight')
-plt.ylim(-5, 150)
-
-plt.subplot(2, 2, 2)
-plt.plot((R2)/(r+R2), t-zero_celsius, 'k-', (R2)/(R+R2), T-zero_celsius, 'x')
-plt.title('Linearized')
-R2_str = '%.2f' % (R2 / 1000.)
-plt.xlabel('Value of resistance divider with $R_2=' + R2_str + 'k\Omega$')
-plt.ylabel('Temperature [Celsius]')
-plt.legend(('Fitted curve', 'Measurements'))
-plt.axis('tight')
-plt.ylim(-5, 150)
-
-plt.subplot(2, 2, 3)
-plt.stem(np.arange(N), lut[np.arange(N) / div] - zero_celsius)
-plt.title('Look-up table')
-plt.xlabel('ADC value')
-plt.ylabel('Temperature')
-plt.axis('tight')
-
-plt.subplot(2, 2, 4)
-plt.stem(n[:-1], np.diff(lut))
-plt.title('Temperature precision')
-plt.xlabel('ADC value')
-plt.ylabel('$\Delta$T')
-plt.axis('tight')
-
-
-plt.show()
+# batch mode, a unit is flagged when its robust z-score (median and
+# median absolute deviation) of the offset to the fleet is above
+# OUTLIER_Z, or when its measurements do not follow the fitted curve
+OUTLIER_Z = 3.5
+FIT_RMS_MAX = 0.5   # Celsius
+BAND = (30., 45.)   # incubation range, Celsius
+
+# the offset of the single unit mode, over a wider range
+DELTA_BAND = (20., 50.)
+
+
+def make_lut(a, b, c, B, L, R2):
+    ''' Resistances and temperatures [K] at the center of the 2^L bins of a B bits ADC '''
+    N = 2 ** B
+    div = 2 ** (B - L)
+    n = np.arange(0, 2 ** L)
+    alpha = (n * div + (div - 1) / 2. + 0.5) / N
+    R_T = (1. / alpha - 1.) * R2
+    return R_T, steinhart_hart(R_T, a, b, c)
+
+
+def write_lut(filename, lut, D):
+    f_lut = open(filename, 'w')
+    f_lut.write('float therm_lut[] = { ')
+    format = '%.' + str(D) + 'f'
+    for i in range(0, len(lut) - 1):
+        f_lut.write(format % (lut[i] - zero_celsius))
+        f_lut.write(', ')
+        if (i + 1) % 10 == 0:
+            f_lut.write('\n  ')
+    f_lut.write(format % lut[-1])
+    f_lut.write(' };\n')
+    f_lut.close()
+
+
+def table_offset(lut, lut_ref, band=BAND):
+    ''' Mean offset [C] of a unit to the reference table over a range, by default the incubation one '''
+    band = (lut_ref - zero_celsius > band[0]) & (lut_ref - zero_celsius < band[1])
+    return np.mean(lut[band] - lut_ref[band])
+
+
+def load_calibration(datafile):
+    ''' Resistances [Ohm] and temperatures [K] of a calibration file '''
+    data = np.loadtxt(datafile, dtype=float, comments='#')
+    return data[:, 0] * 1000., data[:, 1] + zero_celsius
+
+
+def calibrate_unit(job):
+    ''' Fit one calibration file of a batch, runs in a worker process '''
+    datafile, B, L, R2 = job
+    name = os.path.splitext(os.path.basename(datafile))[0]
+    try:
+        R, T = load_calibration(datafile)
+        a, b, c = fit_steinhart_hart(R, T)
+    except Exception as e:
+        return dict(name=name, error=str(e))
+    residual = steinhart_hart(R, a, b, c) - T
+    R_T, lut = make_lut(a, b, c, B, L, R2)
+    return dict(name=name, error=None, a=a, b=b, c=c, n=len(R), lut=lut,
+                rms=np.sqrt(np.mean(residual ** 2)), max=np.max(np.abs(residual)))
+
+
+def calibrate_fleet(batchdir, outdir, B, L, R2, reffile=None, processes=None):
+    ''' Fit every *.txt file of batchdir, write one EEPROM record per unit
+    and a report to outdir. Returns the number of flagged units. '''
+    files = sorted(glob.glob(os.path.join(batchdir, '*.txt')))
+    if len(files) == 0:
+        print('No calibration file in ' + batchdir)
+        return 0
+    if not os.path.isdir(outdir):
+        os.makedirs(outdir)
+
+    pool = Pool(processes)
+    units = pool.map(calibrate_unit, [(f, B, L, R2) for f in files])
+    pool.close()
+
+    good = [u for u in units if u['error'] is None]
+    if len(good) == 0:
+        # no fleet median without a single fitted unit
+        for u in units:
+            print('%s: %s' % (u['name'], u['error']))
+        print('Error: none of the %d files of %s could be fitted' % (len(units), batchdir))
+        return len(units)
+    luts = np.array([u['lut'] for u in good])
+
+    # every unit against the fleet median, at the same ADC codes
+    median = np.median(luts, axis=0)
+    offsets = np.array([table_offset(lut, median) for lut in luts])
+    mad = max(np.median(np.abs(offsets - np.median(offsets))), 1e-3)
+    z = 0.6745 * (offsets - np.median(offsets)) / mad
+
+    if reffile is not None:
+        a_r, b_r, c_r = fit_steinhart_hart(*load_calibration(reffile))
+        R_T, lut_ref = make_lut(a_r, b_r, c_r, B, L, R2)
+
+    flagged = 0
+    report = open(os.path.join(outdir, 'report.txt'), 'w')
+    report.write('# %d units from %s, R2 = %.1f Ohm\n' % (len(units), batchdir, R2))
+    report.write('# unit, points, a, b, c, fit rms [C], fit max [C], '
+                 'offset to fleet [C], z-score, record, flags\n')
+    for u, off, zu in zip(good, offsets, z):
+        flags = []
+        if abs(zu) > OUTLIER_Z:
+            flags.append('offset')
+        if u['rms'] > FIT_RMS_MAX:
+            flags.append('fit')
+
+        if reffile is None:
+            record = therm_cal_record(THERM_CAL_SH, u['a'], u['b'], u['c'], R2)
+            kind = 'sh'
+        else:
+            delta = table_offset(u['lut'], lut_ref)
+            record = therm_cal_record(THERM_CAL_DELTA, delta=delta)
+            kind = 'delta %+.2f' % delta
+        write_intel_hex(os.path.join(outdir, u['name'] + '.hex'), record, EE_THERM_CAL)
+
+        report.write('%s, %d, %.8e, %.8e, %.8e, %.3f, %.3f, %+.3f, %+.1f, %s, %s\n'
+                     % (u['name'], u['n'], u['a'], u['b'], u['c'], u['rms'], u['max'],
+                        off, zu, kind, ' '.join(flags) if flags else 'ok'))
+        if flags:
+            flagged += 1
+            print('%s: %s (offset %+.2f C, fit rms %.2f C)' % (u['name'], ' '.join(flags), off, u['rms']))
+
+    for u in units:
+        if u['error'] is not None:
+            report.write('%s, error, %s\n' % (u['name'], u['error']))
+            print('%s: %s' % (u['name'], u['error']))
+            flagged += 1
+    report.close()
+
+    print('%d units calibrated, %d flagged, see %s' % (len(good), flagged, os.path.join(outdir, 'report.txt')))
+    return flagged
+
+
+def plot_calibration(a, b, c, R, T, R2, N, div, n, lut):
+    r = np.arange(1, 10001)
+    t = steinhart_hart(r, a, b, c)
+
+    plt.subplot(2, 2, 1)
+    plt.plot(r, t - zero_celsius, 'k-', R, T - zero_celsius, 'x')
+    plt.xlabel('Resistance of thermistor [Ohm]')
+    plt.ylabel('Temperature [Celsius]')
+    plt.title('Raw')
+    plt.legend(('Fitted curve', 'Measurements'))
+    plt.axis('tight')
+    plt.ylim(-5, 150)
+
+    plt.subplot(2, 2, 2)
+    plt.plot((R2)/(r+R2), t-zero_celsius, 'k-', (R2)/(R+R2), T-zero_celsius, 'x')
+    plt.title('Linearized')
+    R2_str = '%.2f' % (R2 / 1000.)
+    plt.xlabel('Value of resistance divider with $R_2=' + R2_str + 'k\Omega$')
+    plt.ylabel('Temperature [Celsius]')
+    plt.legend(('Fitted curve', 'Measurements'))
+    plt.axis('tight')
+    plt.ylim(-5, 150)
+
+    plt.subplot(2, 2, 3)
+    plt.stem(np.arange(N), lut[np.arange(N) // div] - zero_celsius)
+    plt.title('Look-up table')
+    plt.xlabel('ADC value')
+    plt.ylabel('Temperature')
+    plt.axis('tight')
+
+    plt.subplot(2, 2, 4)
+    plt.stem(n[:-1], np.diff(lut))
+    plt.title('Temperature precision')
+    plt.xlabel('ADC value')
+    plt.ylabel('$\Delta$T')
+    plt.axis('tight')
+
+    plt.show()
+
+
+def print_help():
+    print(sys.argv[0] + ' -i data_file -o lut_file -B bits -L lut_bits -D decimals')
+    print('This script converts a table of thermistor calibration measurements into a')
+    print('look-up table (LUT) in C that can be used in microcontroller such as AVR with')
+    print('an ADC.')
+    print('')
+    print('Options:')
+    print('   -i  the name of the file containing the calibration data')
+    print('       in the following format: two columns, comma separated, ')
+    print('       "resistance [kOhms], temperature [C]" pairs. (default data.txt)')
+    print('   -o  the name of the file where to save the look-up table (default lut.txt)')
+    print('   -B  the number of bits of the ADC (default to 10)')
+    print('   -L  the number of bits for the look-up table (default to 8)')
+    print('   -D  the number of decimals to use in the look-up table. (default is 7)')
+    print('   -R  the value of the serie resistance (in Ohms).')
+    print('   -e  the name of the Intel HEX file where to save the per-device')
+    print('       calibration record to flash in EEPROM (make eeprom)')
+    print('   -d  the calibration data the firmware look-up table was made from.')
+    print('       When given, the EEPROM record is an offset to the firmware')
+    print('       table instead of Steinhart-Hart coefficients.')
+    print('   -b  batch mode, fit every *.txt calibration file of a directory')
+    print('       and flag the outliers of the fleet, no plot')
+    print('   -O  the directory where batch mode saves one EEPROM record per')
+    print('       unit and report.txt (default fleet)')
+    print('   -j  the number of processes in batch mode (default all cores)')
+    print('   -h  display this help')
+
+
+def main():
+    # default values
+    datafile = 'data.txt'
+    lutfile = 'lut.c'
+    B = 10      # 10 bits ADC
+    L = 8       # 256 values in the LUT
+    D = 7       # values have 7 significant digits
+    R2 = 1500.  # The series resistance
+    eepfile = None  # EEPROM calibration record
+    reffile = None  # calibration of the firmware look-up table
+    batchdir = None
+    outdir = 'fleet'
+    processes = cpu_count()
+
+    # parse arguments
+    i = 1
+    while i < len(sys.argv):
+        if sys.argv[i] == '-i':
+            datafile = sys.argv[i + 1]
+            i += 2
+        elif sys.argv[i] == '-o':
+            lutfile = sys.argv[i + 1]
+            i += 2
+        elif sys.argv[i] == '-B':
+            B = int(sys.argv[i + 1])
+            i += 2
+        elif sys.argv[i] == '-L':
+            L = int(sys.argv[i + 1])
+            i += 2
+        elif sys.argv[i] == '-D':
+            D = int(sys.argv[i + 1])
+            i += 2
+        elif sys.argv[i] == '-R':
+            R2 = float(sys.argv[i + 1])
+            i += 2
+        elif sys.argv[i] == '-e':
+            eepfile = sys.argv[i + 1]
+            i += 2
+        elif sys.argv[i] == '-d':
+            reffile = sys.argv[i + 1]
+            i += 2
+        elif sys.argv[i] == '-b':
+            batchdir = sys.argv[i + 1]
+            i += 2
+        elif sys.argv[i] == '-O':
+            outdir = sys.argv[i + 1]
+            i += 2
+        elif sys.argv[i] == '-j':
+            processes = int(sys.argv[i + 1])
+            i += 2
+        else:
+            print_help()
+            sys.exit(1)
+
+    if batchdir is not None:
+        flagged = calibrate_fleet(batchdir, outdir, B, L, R2, reffile, processes)
+        sys.exit(1 if flagged else 0)
+
+    # First we fit the data to the three parameters equation
+    # of section 2.1.5 of AVX document.
+    R, T = load_calibration(datafile)
+    a, b, c = fit_steinhart_hart(R, T)
+
+    #p = lasso(A, b_vec, 1e-4)
+    #a, b, c = p[1,0], p[1,0], p[2,0]
+
+    # generate the lookup table
+    N = 2 ** B
+    div = 2 ** (B - L)
+    n = np.arange(0, 2 ** L)
+    R_T, lut = make_lut(a, b, c, B, L, R2)
+
+    # save LUT to file
+    write_lut(lutfile, lut, D)
+
+    # save the per-device calibration record for the EEPROM
+    if eepfile is not None:
+        if reffile is None:
+            record = therm_cal_record(THERM_CAL_SH, a, b, c, R2)
+        else:
+            # offset between this thermistor and the one the firmware table
+            # was made from, averaged from 20 to 50 C
+            a_r, b_r, c_r = fit_steinhart_hart(*load_calibration(reffile))
+            R_T, lut_ref = make_lut(a_r, b_r, c_r, B, L, R2)
+            delta = table_offset(lut, lut_ref, DELTA_BAND)
+            record = therm_cal_record(THERM_CAL_DELTA, delta=delta)
+            print('Offset to the firmware table: %.2f C' % delta)
+        write_intel_hex(eepfile, record, EE_THERM_CAL)
+
+    # plot some stuff
+    plot_calibration(a, b, c, R, T, R2, N, div, n, lut)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,88 @@
+/*
+* ----------------------------------------------------------------------------
+* "THE BEER-WARE LICENSE" (Revision 42):
+* <fakufaku@gmail.com> wrote this file. As long as you retain this notice you
+* can do whatever you want with this stuff. If we meet some day, and you think
+* this stuff is worth it, you can buy me a beer in return -- Robin Scheibler
+* ----------------------------------------------------------------------------
+*/
+
+#include <avr/io.h>
+
+#include "clock.h"
+
+#if CONFIG_CLOCK_BURST
+
+// CLKPR division of the 8 MHz oscillator
+#define CLOCK_DIV_FAST 0    // 8 MHz
+#define CLOCK_DIV_SLOW 3    // 1 MHz, as the CKDIV8 fuse
+
+// TIMER1 clock select, clk/16384
+#define TIMER1_CS ((1 << CS13) | (1 << CS12) | (1 << CS11) | (1 << CS10))
+#define TIMER1_TICK_SHIFT 14
+
+// One TIMER0 tick at clk/1024 and 8 MHz, in 1 MHz cycles
+#define TIMER0_TICK 128
+
+// Cycles at 1 MHz not seen by TIMER0: entering the interrupt before
+// TIMER1 is stopped, and leaving the burst
+#define CLOCK_OVERHEAD 60
+
+// 1 MHz cycles owed to TIMER1, less than a tick
+static uint16_t clock_debt = 0;
+
+static void clock_set(uint8_t div)
+{
+  // the two writes must be within 4 cycles
+  CLKPR = (1 << CLKPCE);
+  CLKPR = div;
+}
+
+void clock_burst()
+{
+  // stop TIMER1, the relay output keeps its level
+  TCCR1 &= ~TIMER1_CS;
+
+  // TIMER0 times the burst
+  PRR &= ~(1 << PRTIM0);
+  TCCR0A = 0;
+  TCNT0 = 0;
+  GTCCR = (1 << PSR0);
+  TIFR = (1 << TOV0);
+  TCCR0B = (1 << CS02) | (1 << CS00);
+
+  clock_set(CLOCK_DIV_FAST);
+}
+
+void clock_relax()
+{
+  uint8_t ticks = TCNT0;
+
+  // longer than 32 ms, should not happen
+  if (TIFR & (1 << TOV0))
+    ticks = 0xFF;
+
+  clock_set(CLOCK_DIV_SLOW);
+
+  TCCR0B = 0;
+  PRR |= (1 << PRTIM0);
+
+  // half a tick for the truncation of TCNT0
+  clock_debt += (uint16_t)ticks * TIMER0_TICK + TIMER0_TICK / 2 + CLOCK_OVERHEAD;
+
+  // move TIMER1 forward, but never past the overflow, what is
+  // left waits for the next burst
+  while (clock_debt >= (1 << TIMER1_TICK_SHIFT) && TCNT1 != 0xFF)
+  {
+    TCNT1++;
+    clock_debt -= 1 << TIMER1_TICK_SHIFT;
+  }
+
+  // restart TIMER1 on a fresh prescaler, the compare match that
+  // brought us here must not fire again
+  GTCCR = (1 << PSR1);
+  TCCR1 |= TIMER1_CS;
+  TIFR = (1 << OCF1A);
+}
+
+#endif /* CONFIG_CLOCK_BURST */
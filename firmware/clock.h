@@ -0,0 +1,40 @@
+/*
+ * Clock bursts
+ * ============
+ *
+ * The fuses run the internal 8 MHz oscillator divided by 8. The compare
+ * match interrupt raises the clock to 8 MHz for its computations with
+ * clock_burst() and drops back to 1 MHz with clock_relax().
+ *
+ * TIMER1 counts the system clock and would run 8 times too fast during
+ * a burst, so it is stopped instead, the burst is timed with TIMER0,
+ * and TIMER1 is moved forward by the time spent once back at 1 MHz.
+ * What is left of a TIMER1 tick is carried to the next burst, the
+ * control period does not drift.
+ */
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+
+#include "config.h"
+
+#if CONFIG_CLOCK_BURST
+
+// ADC clock at 62.5 kHz during bursts, as clk/16 at 1 MHz
+#define ADC_PRESCALER ((1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0))
+
+void clock_burst();
+void clock_relax();
+
+#else
+
+#define ADC_PRESCALER (1 << ADPS2)
+
+#define clock_burst()
+#define clock_relax()
+
+#endif /* CONFIG_CLOCK_BURST */
+
+#endif /* CLOCK_H */
@@ -0,0 +1,384 @@
+/*
+ * Firmware configuration
+ * ======================
+ *
+ * Everything that differs from one incubator model to another is chosen
+ * here at compile time, so that the features a build does not use cost
+ * no flash, RAM or cycles. A profile from profiles/ is included first
+ * and overrides any of the defaults below:
+ *
+ * > make PROFILE=precise
+ *
+ * Single settings can also be given on the command line:
+ *
+ * > make DEFS="-DCONFIG_K_P=8."
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+// Choices
+#define THERM_LUT           0   // look-up table, fastest
+#define THERM_SH            1   // fixed-point Steinhart-Hart, smallest
+
+#define FILTER_NONE         0
+#define FILTER_EMA          1   // exponential moving average
+
+#define CONTROLLER_PID      0
+#define CONTROLLER_ONOFF    1   // on/off with hysteresis
+
+#define OUTPUT_PWM          0   // TIMER1 hardware PWM on the relay
+#define OUTPUT_SIGMA_DELTA  1   // whole periods on or off
+
+#ifdef CONFIG_PROFILE
+#include CONFIG_PROFILE
+#endif
+
+/* Sensor */
+
+#ifndef CONFIG_THERM
+#define CONFIG_THERM THERM_LUT
+#endif
+
+// per-device calibration record in EEPROM (thermistor.h)
+#ifndef CONFIG_THERM_EEPROM
+#define CONFIG_THERM_EEPROM 1
+#endif
+
+// two-point field trim (trim.h)
+#ifndef CONFIG_TRIM
+#define CONFIG_TRIM 1
+#endif
+
+#ifndef CONFIG_FILTER
+#define CONFIG_FILTER FILTER_NONE
+#endif
+
+// weight of a new sample in the moving average
+#ifndef CONFIG_FILTER_ALPHA
+#define CONFIG_FILTER_ALPHA 0.2
+#endif
+
+/* Controller */
+
+#ifndef CONFIG_CONTROLLER
+#define CONFIG_CONTROLLER CONTROLLER_PID
+#endif
+
+#ifndef CONFIG_K_P
+#define CONFIG_K_P 10.
+#endif
+#ifndef CONFIG_K_I
+#define CONFIG_K_I 0.5
+#endif
+#ifndef CONFIG_K_D
+#define CONFIG_K_D 0.0
+#endif
+
+// on/off controller hysteresis, in Celsius
+#ifndef CONFIG_HYSTERESIS
+#define CONFIG_HYSTERESIS 0.25
+#endif
+
+// Temperature set points, kept in flash. Index 1 is used unless the
+// trimpot selects among 1 to 3.
+#ifndef CONFIG_SETPOINTS
+#define CONFIG_SETPOINTS { 0.0, 37.5, 40.0, 45.0 }
+#endif
+#ifndef CONFIG_SETPOINT_TRIMPOT
+#define CONFIG_SETPOINT_TRIMPOT 0
+#endif
+
+// error when we consider set point is reached
+#ifndef CONFIG_TEMP_SET_ERROR
+#define CONFIG_TEMP_SET_ERROR 1.0
+#endif
+
+/* Dial */
+
+// the trimpot dials the set point from CONFIG_DIAL_MIN to
+// CONFIG_DIAL_MAX instead of picking one of CONFIG_SETPOINTS (dial.h)
+#ifndef CONFIG_SETPOINT_DIAL
+#define CONFIG_SETPOINT_DIAL 0
+#endif
+#ifndef CONFIG_DIAL_MIN
+#define CONFIG_DIAL_MIN 30.0
+#endif
+// below CONFIG_PROTECT_TMAX
+#ifndef CONFIG_DIAL_MAX
+#define CONFIG_DIAL_MAX 45.0
+#endif
+// in Celsius, 254 steps at most
+#ifndef CONFIG_DIAL_STEP
+#define CONFIG_DIAL_STEP 0.1
+#endif
+
+// set points evenly spaced along the travel, from CONFIG_DIAL_MIN to
+// CONFIG_DIAL_MAX, e.g. { 30.0, 36.0, 38.0, 45.0 } for tenths around 37
+#ifndef CONFIG_DIAL_CURVE
+#define CONFIG_DIAL_CURVE { CONFIG_DIAL_MIN, CONFIG_DIAL_MAX }
+#endif
+
+// the off zone at the bottom of the travel, in 10-bit ADC counts
+#ifndef CONFIG_DIAL_OFF
+#define CONFIG_DIAL_OFF 24
+#endif
+// control periods on the other side before turning on or off
+#ifndef CONFIG_DIAL_DEBOUNCE
+#define CONFIG_DIAL_DEBOUNCE 2
+#endif
+
+// in steps past the middle of two
+#ifndef CONFIG_DIAL_HYSTERESIS
+#define CONFIG_DIAL_HYSTERESIS 0.5
+#endif
+
+/* Sampling */
+
+// A steady chamber is measured every few control periods only, up to
+// CONFIG_SAMPLE_MAX, 1 measures every period (control.h)
+#ifndef CONFIG_SAMPLE_MAX
+#define CONFIG_SAMPLE_MAX 4
+#endif
+
+// steady: this close to the set point, in Celsius
+#ifndef CONFIG_SAMPLE_ERROR
+#define CONFIG_SAMPLE_ERROR 0.3
+#endif
+
+// and moving slower than this, in Celsius per minute
+#ifndef CONFIG_SAMPLE_RATE
+#define CONFIG_SAMPLE_RATE 1.0
+#endif
+
+/* Disturbance */
+
+// the lid opened: the integral of the PID holds while the temperature
+// drops, and the heater is at full power after (control.h)
+#ifndef CONFIG_LID
+#define CONFIG_LID (CONFIG_CONTROLLER == CONTROLLER_PID)
+#endif
+
+// a drop faster than this, in Celsius per minute
+#ifndef CONFIG_LID_RATE
+#define CONFIG_LID_RATE 4.0
+#endif
+
+// and this far below the set point, in Celsius
+#ifndef CONFIG_LID_ERROR
+#define CONFIG_LID_ERROR 1.0
+#endif
+
+// the full power stops when the rise carried on this many seconds
+// meets the set point
+#ifndef CONFIG_LID_LEAD
+#define CONFIG_LID_LEAD 30.
+#endif
+
+// back to the PID after this many control periods, 143 is 10 minutes
+#ifndef CONFIG_LID_MAX
+#define CONFIG_LID_MAX 143
+#endif
+
+/* Output */
+
+#ifndef CONFIG_OUTPUT
+#define CONFIG_OUTPUT OUTPUT_PWM
+#endif
+
+// We limit PWM value to 6 from below to spare the relay
+// and to 200 from above to avoid overheating of the incubator
+#ifndef CONFIG_PWM_MAX
+#define CONFIG_PWM_MAX 200
+#endif
+#ifndef CONFIG_PWM_MIN
+#define CONFIG_PWM_MIN 6
+#endif
+
+/* Power */
+
+// sleep in Idle between interrupts, ADC on only when measuring
+#ifndef CONFIG_LOWPOWER
+#define CONFIG_LOWPOWER 1
+#endif
+
+// turn the brown-out detector off while sleeping, when the fuses
+// enable it
+#ifndef CONFIG_BOD_SLEEP
+#define CONFIG_BOD_SLEEP 0
+#endif
+
+// run the computations of a control period at 8 MHz (clock.h)
+#ifndef CONFIG_CLOCK_BURST
+#define CONFIG_CLOCK_BURST 0
+#endif
+
+/* Safety */
+
+// watchdog and warm restart from a snapshot (supervisor.h)
+#ifndef CONFIG_WATCHDOG
+#define CONFIG_WATCHDOG 1
+#endif
+
+// over-temperature cutoff on the watchdog tick (protect.h)
+#ifndef CONFIG_PROTECT
+#define CONFIG_PROTECT 1
+#endif
+#ifndef CONFIG_PROTECT_TMAX
+#define CONFIG_PROTECT_TMAX 48.0
+#endif
+#ifndef CONFIG_PROTECT_RATE
+#define CONFIG_PROTECT_RATE 0.5    // C/s
+#endif
+
+// open, short, jumping and stuck thermistor (sensor.h)
+#ifndef CONFIG_SENSOR_CHECK
+#define CONFIG_SENSOR_CHECK 1
+#endif
+#ifndef CONFIG_SENSOR_JUMP
+#define CONFIG_SENSOR_JUMP 5.0     // C between two measurements
+#endif
+
+/* History */
+
+// mean temperature and duty cycle kept in an EEPROM ring (history.h)
+#ifndef CONFIG_HISTORY
+#define CONFIG_HISTORY 1
+#endif
+// control periods in a sample, 256 is about 18 minutes and two days of
+// history in the ring
+#ifndef CONFIG_HISTORY_PERIODS
+#define CONFIG_HISTORY_PERIODS 256
+#endif
+
+/* Energy */
+
+// time the heater is on at each set point and closings of the relay,
+// kept in EEPROM (energy.h)
+#ifndef CONFIG_ENERGY
+#define CONFIG_ENERGY 1
+#endif
+// power of the heater, for the energy of the readouts
+#ifndef CONFIG_HEATER_WATTS
+#define CONFIG_HEATER_WATTS 100.
+#endif
+// minutes between the writes of the counters to EEPROM
+#ifndef CONFIG_ENERGY_SAVE
+#define CONFIG_ENERGY_SAVE 60
+#endif
+
+/* Remote */
+
+// gains, set points and duty cycle limits set over the serial line and
+// kept in EEPROM (params.h, remote.h), the values above are the defaults.
+// The line is half-duplex on PB4, LED2 is not used: the set point
+// reached is not shown, LED1 blinks on any fault and the kind of the
+// fault is lost.
+#ifndef CONFIG_REMOTE
+#define CONFIG_REMOTE 0
+#endif
+#ifndef CONFIG_REMOTE_BAUD
+#define CONFIG_REMOTE_BAUD 4800
+#endif
+// address of a unit without a stored one
+#ifndef CONFIG_REMOTE_ID
+#define CONFIG_REMOTE_ID 1
+#endif
+
+/* I2C */
+
+// register map on an I2C slave of the USI (twi.h), for one host polling
+// many units on a bus. SDA is PB0 and SCL is PB2: LED1 is not used and
+// the run register of the map replaces the trimpot. The heater on is
+// not shown, LED2 blinks on any fault, the faults register tells which.
+// With CONFIG_REMOTE as well, the unit has no LED left.
+#ifndef CONFIG_TWI
+#define CONFIG_TWI 0
+#endif
+// the address of a unit is CONFIG_TWI_BASE + its id (params.h)
+#ifndef CONFIG_TWI_BASE
+#define CONFIG_TWI_BASE 0x10
+#endif
+// run register at power up, the set point a unit heats to unattended
+#ifndef CONFIG_TWI_RUN
+#define CONFIG_TWI_RUN 1
+#endif
+
+/* Multi-zone */
+
+// zones of the ATmega328P build (multizone.c), ADC0 to ADC4
+#ifndef CONFIG_ZONES
+#define CONFIG_ZONES 4
+#endif
+
+/* Checks */
+
+#if CONFIG_THERM != THERM_LUT && CONFIG_THERM != THERM_SH
+#error "CONFIG_THERM must be THERM_LUT or THERM_SH"
+#endif
+
+#if CONFIG_FILTER != FILTER_NONE && CONFIG_FILTER != FILTER_EMA
+#error "CONFIG_FILTER must be FILTER_NONE or FILTER_EMA"
+#endif
+
+#if CONFIG_CONTROLLER != CONTROLLER_PID && CONFIG_CONTROLLER != CONTROLLER_ONOFF
+#error "CONFIG_CONTROLLER must be CONTROLLER_PID or CONTROLLER_ONOFF"
+#endif
+
+#if CONFIG_OUTPUT != OUTPUT_PWM && CONFIG_OUTPUT != OUTPUT_SIGMA_DELTA
+#error "CONFIG_OUTPUT must be OUTPUT_PWM or OUTPUT_SIGMA_DELTA"
+#endif
+
+#if CONFIG_CLOCK_BURST && F_CPU != 1000000UL
+#error "CONFIG_CLOCK_BURST expects the 8 MHz oscillator divided by 8"
+#endif
+
+#if CONFIG_PROTECT && !CONFIG_WATCHDOG
+#error "CONFIG_PROTECT runs on the tick of CONFIG_WATCHDOG"
+#endif
+
+#if CONFIG_TWI && CONFIG_TRIM
+#error "CONFIG_TRIM reads the trimpot, PB2 is SCL with CONFIG_TWI"
+#endif
+
+#if CONFIG_TWI && CONFIG_SETPOINT_DIAL
+#error "CONFIG_SETPOINT_DIAL reads the trimpot, PB2 is SCL with CONFIG_TWI"
+#endif
+
+#if CONFIG_DIAL_OFF < 1 || CONFIG_DIAL_OFF > 127
+#error "CONFIG_DIAL_OFF from 1 to 127"
+#endif
+
+#if CONFIG_DIAL_DEBOUNCE < 1 || CONFIG_DIAL_DEBOUNCE > 255
+#error "CONFIG_DIAL_DEBOUNCE from 1 to 255"
+#endif
+
+#if CONFIG_HISTORY_PERIODS < 1 || CONFIG_HISTORY_PERIODS > 65535
+#error "CONFIG_HISTORY_PERIODS from 1 to 65535"
+#endif
+
+#if CONFIG_ENERGY_SAVE < 5 || CONFIG_ENERGY_SAVE > 250
+#error "CONFIG_ENERGY_SAVE from 5 to 250 minutes"
+#endif
+
+#if CONFIG_SAMPLE_MAX < 1 || CONFIG_SAMPLE_MAX > 16
+#error "CONFIG_SAMPLE_MAX from 1 to 16"
+#endif
+
+#if CONFIG_LID && CONFIG_CONTROLLER != CONTROLLER_PID
+#error "CONFIG_LID holds the integral of CONTROLLER_PID"
+#endif
+
+#if CONFIG_LID_MAX < 1 || CONFIG_LID_MAX > 255
+#error "CONFIG_LID_MAX from 1 to 255"
+#endif
+
+#if CONFIG_ZONES < 1 || CONFIG_ZONES > 5
+#error "CONFIG_ZONES from 1 to 5"
+#endif
+
+#if CONFIG_PWM_MAX > 255 || CONFIG_PWM_MIN > CONFIG_PWM_MAX
+#error "CONFIG_PWM_MIN <= CONFIG_PWM_MAX <= 255"
+#endif
+
+#endif /* CONFIG_H */
@@ -0,0 +1,228 @@
+/*
+* ----------------------------------------------------------------------------
+* "THE BEER-WARE LICENSE" (Revision 42):
+* <fakufaku@gmail.com> wrote this file. As long as you retain this notice you
+* can do whatever you want with this stuff. If we meet some day, and you think
+* this stuff is worth it, you can buy me a beer in return -- Robin Scheibler
+* ----------------------------------------------------------------------------
+*/
+
+#include <avr/pgmspace.h>
+#include <math.h>
+
+#include "control.h"
+#include "dial.h"
+#include "thermistor.h"
+#include "trim.h"
+
+// Temperature set point
+const float temperature_setPoints[4] PROGMEM = CONFIG_SETPOINTS;
+
+#if CONFIG_LID
+// weight of a new measurement in the slope, against the ADC noise
+#define LID_SMOOTH 0.2
+
+#ifdef PID_TUNING
+#define LID_BOOST(c) ((c)->pid.pwm_max)
+#else
+#define LID_BOOST(c) PWM_MAX
+#endif
+#endif
+
+void control_init(struct control *c)
+{
+  c->state = PWM_OFF;
+  c->pwm_val = 0;
+  c->temperature_avg = 0.;
+  c->temp_avg_n = 0;
+  c->interval = 1;
+  c->elapsed = 0;
+  c->moving = 1;
+#if CONFIG_LID
+  c->lid = LID_CLOSED;
+  c->lid_periods = 0;
+  c->slope = 0.;
+#endif
+  pid_reset(&c->pid);
+}
+
+// At the start of each period, 1 when it measures the temperature
+uint8_t control_sampling(struct control *c)
+{
+  if (c->elapsed < 0xFF)
+    c->elapsed++;
+
+  return c->elapsed >= c->interval;
+}
+
+// Temperature of a raw thermistor reading
+float control_temperature(uint16_t raw)
+{
+  // two-point field trim, one integer multiply-add
+  return therm_convert(trim_apply(raw));
+}
+
+void control_filter(struct control *c, float t)
+{
+#if CONFIG_SAMPLE_MAX > 1 || CONFIG_LID
+  float previous = c->temperature_avg;
+  uint8_t fresh = c->temp_avg_n == 0;
+#endif
+#if CONFIG_LID
+  uint8_t periods = c->elapsed > 0 ? c->elapsed : 1;
+#endif
+#if CONFIG_FILTER == FILTER_EMA
+  float alpha = CONFIG_FILTER_ALPHA;
+#if CONFIG_SAMPLE_MAX > 1
+  float keep = 1. - CONFIG_FILTER_ALPHA;
+  uint8_t i;
+
+  // as many periods of the filter as the measurement stands for
+  if (c->elapsed > 1)
+  {
+    for (i = 1; i < c->elapsed; i++)
+      keep *= 1. - CONFIG_FILTER_ALPHA;
+    alpha = 1. - keep;
+  }
+#endif
+
+  // average the temperature measurement
+  if (c->temp_avg_n == 0)
+  {
+    c->temperature_avg = t;
+    c->temp_avg_n = 1;
+  }
+  else
+    c->temperature_avg += alpha * (t - c->temperature_avg);
+#else
+  c->temperature_avg = t;
+  c->temp_avg_n = 1;
+#endif
+
+#if CONFIG_SAMPLE_MAX > 1
+  // the change since the measurement before, in Celsius per minute
+  c->moving = fresh || fabs(c->temperature_avg - previous)
+    > CONFIG_SAMPLE_RATE / 60. * TIME_INTERVAL * c->elapsed;
+#endif
+
+#if CONFIG_LID
+  if (!fresh)
+    c->slope += LID_SMOOTH * ((c->temperature_avg - previous)
+        * (60. * TIME_INTERVAL_INV) / periods - c->slope);
+#endif
+}
+
+float control_set_point(uint8_t trimpot_val)
+{
+#if CONFIG_SETPOINT_DIAL
+  // a code of the dial, see dial.h
+  return dial_set_point(trimpot_val);
+#else
+#if !CONFIG_SETPOINT_TRIMPOT
+  trimpot_val = 1;
+#endif
+#if PARAMS_RUNTIME
+  return params.setpoints[trimpot_val];
+#else
+  return pgm_read_float(&(temperature_setPoints[trimpot_val]));
+#endif
+#endif /* CONFIG_SETPOINT_DIAL */
+}
+
+#if CONFIG_LID
+// The state of the lid after a measurement, see control.h
+static void lid_update(struct control *c, float error)
+{
+  switch (c->lid)
+  {
+    case LID_CLOSED:
+      if (error > CONFIG_LID_ERROR && c->slope < -CONFIG_LID_RATE)
+      {
+        c->lid = LID_OPEN;
+        c->lid_periods = 0;
+      }
+      break;
+
+    case LID_OPEN:
+      // the drop is over, the lid is closed
+      if (c->slope >= 0.)
+        c->lid = LID_RECOVER;
+      break;
+
+    case LID_RECOVER:
+      if (c->slope < -CONFIG_LID_RATE)
+        c->lid = LID_OPEN;
+      else if (error <= 0.)
+        c->lid = LID_CLOSED;
+      break;
+  }
+
+  if (c->lid != LID_CLOSED)
+  {
+    c->lid_periods = c->lid_periods + c->elapsed < CONFIG_LID_MAX
+      ? c->lid_periods + c->elapsed : CONFIG_LID_MAX;
+    if (c->lid_periods >= CONFIG_LID_MAX)
+      c->lid = LID_CLOSED;
+  }
+}
+#endif
+
+/*
+ * The trimpot at zero stops the heater and resets the PID. hold keeps
+ * the heater off for this period and the PID as it is.
+ */
+void control_update(struct control *c, uint8_t trimpot_val, uint8_t hold)
+{
+  float error = control_set_point(trimpot_val) - c->temperature_avg;
+
+  if (trimpot_val > 0)
+  {
+    c->state = PWM_ON;
+
+    // do the PID magic
+    if (hold)
+      c->pwm_val = 0;
+    else
+    {
+#if CONFIG_LID
+      float ITerm = c->pid.ITerm;
+
+      lid_update(c, error);
+#endif
+      c->pwm_val = pid_compute(&c->pid, error, c->pwm_val,
+          c->elapsed > 0 ? c->elapsed : 1);
+#if CONFIG_LID
+      // the integral of before the lid opened holds the set point
+      if (c->lid != LID_CLOSED)
+        c->pid.ITerm = ITerm;
+      // full power while the rise, carried on the lead, falls short
+      if (c->lid == LID_RECOVER
+          && error > c->slope * (CONFIG_LID_LEAD / 60.))
+        c->pwm_val = LID_BOOST(c);
+#endif
+    }
+  }
+  else if (c->state == PWM_ON)
+  {
+    c->state = PWM_OFF;
+    c->pwm_val = 0;
+    pid_reset(&c->pid);
+#if CONFIG_LID
+    c->lid = LID_CLOSED;
+#endif
+  }
+
+#if CONFIG_SAMPLE_MAX > 1
+  // the next measurement, further on while the chamber is steady
+  if (trimpot_val > 0 && !hold && !c->moving
+#if CONFIG_LID
+      && c->lid == LID_CLOSED
+#endif
+      && fabs(error) < CONFIG_SAMPLE_ERROR)
+    c->interval = c->interval * 2 < CONFIG_SAMPLE_MAX
+      ? c->interval * 2 : CONFIG_SAMPLE_MAX;
+  else
+    c->interval = 1;
+#endif
+  c->elapsed = 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * Control step
+ * ============
+ *
+ * What the compare match interrupt does with the readings, without
+ * touching the hardware: the conversion of the thermistor reading,
+ * the filter, and the state machine around the controller. The state
+ * of one chamber is a struct control.
+ *
+ * incubalibre.c applies the changes of state to the relay and the
+ * LEDs. The host simulations (see host/) run the same code.
+ *
+ * Sampling
+ * --------
+ *
+ * The relay keeps the period of TIMER1, but the temperature is not
+ * measured in all of them: control_sampling() tells which ones. After
+ * a measurement within CONFIG_SAMPLE_ERROR of the set point, moving
+ * slower than CONFIG_SAMPLE_RATE, the next one is twice as far, up to
+ * CONFIG_SAMPLE_MAX periods. Any other measurement, a fault or the
+ * heater off bring it back to every period. The periods in between
+ * keep the duty cycle.
+ *
+ * The controller and the filter take the time since the measurement
+ * before, the filter has the same time constant in seconds.
+ *
+ * Lid
+ * ---
+ *
+ * Opening the lid drops the temperature by a few degrees in a minute,
+ * and the integral of the PID winds up meanwhile: the chamber then
+ * overshoots once the lid is closed. The slope of the filtered
+ * temperature tells the event apart from the slow changes of the
+ * chamber:
+ *
+ *   closed   a drop faster than CONFIG_LID_RATE, CONFIG_LID_ERROR below
+ *            the set point, opens the lid
+ *   open     the PID with its integral held, until the drop ends
+ *   recover  full power while the rise, carried on CONFIG_LID_LEAD
+ *            seconds, falls short of the set point, the PID with the
+ *            integral of before the lid opened after, until the set
+ *            point is reached
+ *
+ * The lead stands for the lag of the thermistor and the heat stored in
+ * the heater. An event longer than CONFIG_LID_MAX periods is over, the
+ * integral is left to the PID again.
+ */
+
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <stdint.h>
+
+#include "config.h"
+#include "pid.h"
+
+// the state variable
+#define PWM_ON 0
+#define PWM_OFF 1
+
+// error when we consider set point is reached
+#define TEMP_SET_ERROR CONFIG_TEMP_SET_ERROR
+
+// the lid
+#define LID_CLOSED 0
+#define LID_OPEN 1
+#define LID_RECOVER 2
+
+struct control
+{
+  uint8_t state;
+  uint8_t pwm_val;
+  uint8_t temp_avg_n;
+  uint8_t interval;         // periods to the next measurement
+  uint8_t elapsed;          // periods since the last one
+  uint8_t moving;           // faster than CONFIG_SAMPLE_RATE
+#if CONFIG_LID
+  uint8_t lid;
+  uint8_t lid_periods;      // since the lid opened
+#endif
+  float temperature_avg;
+#if CONFIG_LID
+  float slope;              // of temperature_avg, Celsius per minute
+#endif
+  struct pid pid;
+};
+
+// A control period, as the compare match interrupt hands it to the
+// main loop (see queue.h)
+struct sample
+{
+  uint16_t period;          // number of the period since the reset, wraps
+  uint16_t thermistor;      // the raw reading, CONTROL_NO_READING
+  uint8_t trimpot;          // set point index, of the trimpot or the bus,
+                            // or code of the dial (dial.h)
+  uint8_t state;
+  uint8_t pwm_val;
+  uint8_t faults;           // sensor fault | over-temperature fault << 4
+  float temperature;        // filtered
+};
+
+// the thermistor of a period without measurement
+#define CONTROL_NO_READING 0xFFFF
+
+void control_init(struct control *c);
+uint8_t control_sampling(struct control *c);
+float control_temperature(uint16_t raw);
+void control_filter(struct control *c, float t);
+float control_set_point(uint8_t trimpot_val);
+
+// The set point the control runs at for an index of the trimpot, 0 for
+// off: the first one unless CONFIG_SETPOINT_TRIMPOT, a code of the dial
+// as is
+#if CONFIG_SETPOINT_TRIMPOT || CONFIG_SETPOINT_DIAL
+#define control_index(trimpot_val) (trimpot_val)
+#else
+#define control_index(trimpot_val) ((trimpot_val) > 0)
+#endif
+
+void control_update(struct control *c, uint8_t trimpot_val, uint8_t hold);
+
+#endif /* CONTROL_H */
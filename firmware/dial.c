@@ -0,0 +1,94 @@
+/*
+* ----------------------------------------------------------------------------
+* "THE BEER-WARE LICENSE" (Revision 42):
+* <fakufaku@gmail.com> wrote this file. As long as you retain this notice you
+* can do whatever you want with this stuff. If we meet some day, and you think
+* this stuff is worth it, you can buy me a beer in return -- Robin Scheibler
+* ----------------------------------------------------------------------------
+*/
+
+#include <avr/pgmspace.h>
+#include <math.h>
+
+#include "dial.h"
+
+#if CONFIG_SETPOINT_DIAL
+
+// the off zone and the end of the travel, as far from the top, in sums
+// of conversions
+#define DIAL_ENTER (CONFIG_DIAL_OFF * DIAL_SAMPLES)
+#define DIAL_LEAVE (2 * CONFIG_DIAL_OFF * DIAL_SAMPLES)
+#define DIAL_FULL ((1023 - CONFIG_DIAL_OFF) * DIAL_SAMPLES)
+
+// the last step of the dial, the codes fit in the index of the
+// trimpot with 0 for off
+#define DIAL_STEPS ((CONFIG_DIAL_MAX - CONFIG_DIAL_MIN) / CONFIG_DIAL_STEP)
+#define DIAL_LAST ((uint8_t)(DIAL_STEPS < 254. ? DIAL_STEPS + 0.5 : 254.))
+
+static const float dial_curve[] PROGMEM = CONFIG_DIAL_CURVE;
+
+#define DIAL_KNOTS (sizeof(dial_curve) / sizeof(dial_curve[0]))
+
+void dial_init(struct dial *d)
+{
+  d->fresh = 1;
+  d->off = 1;
+  d->debounce = 0;
+  d->step = 0;
+}
+
+// The step of the curve at the position, not rounded
+static float dial_curve_step(uint16_t position)
+{
+  float x, a, b;
+  uint8_t i;
+
+  if (position <= DIAL_LEAVE)
+    x = 0.;
+  else
+    x = (float)(position - DIAL_LEAVE) * (DIAL_KNOTS - 1)
+      / (DIAL_FULL - DIAL_LEAVE);
+
+  i = x < DIAL_KNOTS - 2 ? (uint8_t)x : DIAL_KNOTS - 2;
+  a = pgm_read_float(&dial_curve[i]);
+  b = pgm_read_float(&dial_curve[i + 1]);
+  x = (a + (x - i) * (b - a) - CONFIG_DIAL_MIN) / CONFIG_DIAL_STEP;
+
+  return x < 0. ? 0. : x > DIAL_LAST ? DIAL_LAST : x;
+}
+
+uint8_t dial_update(struct dial *d, uint16_t sum)
+{
+  uint8_t off;
+  float x;
+
+  if (d->fresh)
+    d->position = sum;
+  else
+    d->position = (d->position + sum + 1) >> 1;
+
+  // the off zone, left higher than it is entered
+  off = d->position < (d->off ? DIAL_LEAVE : DIAL_ENTER);
+  if (d->fresh)
+    d->off = off;
+  else if (off != d->off)
+  {
+    if (++d->debounce >= CONFIG_DIAL_DEBOUNCE)
+    {
+      d->off = off;
+      d->debounce = 0;
+    }
+  }
+  else
+    d->debounce = 0;
+
+  // a step further than the hysteresis, or the first reading
+  x = dial_curve_step(d->position);
+  if (d->fresh || fabs(x - d->step) > 0.5 + CONFIG_DIAL_HYSTERESIS)
+    d->step = (uint8_t)(x + 0.5);
+  d->fresh = 0;
+
+  return d->off ? 0 : d->step + 1;
+}
+
+#endif /* CONFIG_SETPOINT_DIAL */
@@ -0,0 +1,71 @@
+/*
+ * Set point dial
+ * ==============
+ *
+ * With CONFIG_SETPOINT_DIAL, the trimpot dials the set point itself
+ * instead of picking one of CONFIG_SETPOINTS: from CONFIG_DIAL_MIN to
+ * CONFIG_DIAL_MAX in steps of CONFIG_DIAL_STEP, 30.0 to 45.0 C in
+ * tenths by default, with an off zone at the bottom of the travel.
+ *
+ * Each control period reads DIAL_SAMPLES 10-bit conversions of the
+ * trimpot, their sum is averaged with the one of the period before.
+ * Then:
+ *
+ *   off zone  below CONFIG_DIAL_OFF, left above twice that, and only
+ *             after CONFIG_DIAL_DEBOUNCE periods on the other side
+ *   curve     the travel above the off zone, up to as far from the
+ *             top, is split evenly between the knots of
+ *             CONFIG_DIAL_CURVE, in Celsius, linear in between: knots
+ *             close together around 37 C spread its tenths over more
+ *             of the travel
+ *   steps     the set point moves to another step only when the curve
+ *             is CONFIG_DIAL_HYSTERESIS steps past the middle of the
+ *             two, the noise of the trimpot does not reach the PID
+ *
+ * The dial hands a code to the compare match in place of the index of
+ * the trimpot: 0 is off, n the step n - 1, and dial_set_point() its
+ * temperature. It fits in the sample of the period as the index did,
+ * and a new code measures the chamber at once.
+ *
+ * LED2 tells when the chamber is within TEMP_SET_ERROR of the dialed
+ * set point (see PID_compute() in incubalibre.c).
+ */
+
+#ifndef DIAL_H
+#define DIAL_H
+
+#include <stdint.h>
+
+#include "config.h"
+
+// conversions of the trimpot in a reading
+#define DIAL_SAMPLES 4
+
+// the set point of a code other than 0, in Celsius
+#define dial_set_point(code) \
+  (CONFIG_DIAL_MIN + ((code) - 1) * CONFIG_DIAL_STEP)
+
+#if CONFIG_SETPOINT_DIAL
+
+struct dial
+{
+  uint16_t position;        // sum of DIAL_SAMPLES conversions, averaged
+  uint8_t fresh;            // no reading yet
+  uint8_t off;
+  uint8_t debounce;         // periods on the other side of the off zone
+  uint8_t step;             // of the set point, kept in the off zone
+};
+
+void dial_init(struct dial *d);
+
+// The reading of the period, the sum of DIAL_SAMPLES conversions.
+// Returns the code of the set point, 0 for off
+uint8_t dial_update(struct dial *d, uint16_t sum);
+
+#else
+
+#define dial_init(d)
+
+#endif /* CONFIG_SETPOINT_DIAL */
+
+#endif /* DIAL_H */
@@ -0,0 +1,35 @@
+/*
+ * EEPROM map
+ * ==========
+ *
+ * The ATtiny85 has 512 bytes of EEPROM. Every record kept there lives
+ * at a fixed address so that host tools can read and write it with
+ * avrdude without knowing how the firmware was linked.
+ *
+ * The EESAVE fuse is programmed (see HFUSE in the Makefile) so that
+ * flashing a new firmware image does not erase these records.
+ */
+
+#ifndef EEPROM_MAP_H
+#define EEPROM_MAP_H
+
+// Per-device thermistor calibration (struct therm_cal, 24 bytes)
+#define EE_THERM_CAL      0x000
+
+// Two-point field trim (struct trim, 8 bytes)
+#define EE_TRIM           0x018
+
+// Runtime parameters of CONFIG_REMOTE and CONFIG_TWI (struct params, 33 bytes)
+#define EE_PARAMS         0x020
+
+// Ring of the temperature history (12 struct history_block, 384 bytes)
+#define EE_HISTORY        0x048
+
+// Energy counters, written in turn to two slots (2 struct energy_slot,
+// 36 bytes)
+#define EE_ENERGY         0x1C8
+
+// Results of the therm_cycles bench firmware (8 bytes)
+#define EE_BENCH          0x1F8
+
+#endif /* EEPROM_MAP_H */
@@ -0,0 +1,123 @@
+/*
+* ----------------------------------------------------------------------------
+* "THE BEER-WARE LICENSE" (Revision 42):
+* <fakufaku@gmail.com> wrote this file. As long as you retain this notice you
+* can do whatever you want with this stuff. If we meet some day, and you think
+* this stuff is worth it, you can buy me a beer in return -- Robin Scheibler
+* ----------------------------------------------------------------------------
+*/
+
+#include <avr/eeprom.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "energy.h"
+#include "eeprom_map.h"
+#include "thermistor.h"
+
+// the compiler keeps the copy of the counters between the reads of the
+// sequence
+#define ENERGY_BARRIER() __asm__ __volatile__ ("" ::: "memory")
+
+#define ENERGY_CRC(s) crc8((s), offsetof(struct energy_slot, crc))
+
+static struct energy_slot *slot_address(uint8_t slot)
+{
+  return (struct energy_slot *)EE_ENERGY + slot;
+}
+
+uint8_t energy_read(struct energy_slot *s)
+{
+  struct energy_slot other;
+  uint8_t slot, newest = 0;
+
+  for (slot = 0; slot < ENERGY_SLOTS; slot++)
+  {
+    eeprom_read_block(&other, slot_address(slot), sizeof(other));
+
+    // an erased slot reads 0xFF everywhere, the crc does not match, nor
+    // does the one of a slot the power was cut in the middle of
+    if (ENERGY_CRC(&other) != other.crc)
+      continue;
+    if (newest == 0 || (int8_t)(other.generation - s->generation) > 0)
+    {
+      *s = other;
+      newest = slot + 1;
+    }
+  }
+
+  return newest;
+}
+
+#if CONFIG_ENERGY
+
+struct energy energy;
+
+void energy_init()
+{
+  struct energy_slot s;
+  uint8_t newest;
+
+  memset(&energy, 0, sizeof(energy));
+
+  // counted from zero on a unit without a record, the next write goes
+  // to the other slot than the newest
+  newest = energy_read(&s);
+  if (newest)
+  {
+    energy.count = s.count;
+    energy.generation = s.generation;
+    energy.slot = newest % ENERGY_SLOTS;
+  }
+}
+
+void energy_overflow(uint16_t ticks)
+{
+  uint16_t sum;
+
+  if (ticks > 0)
+  {
+    // the PWM opens the relay at each compare match
+    if (CONFIG_OUTPUT == OUTPUT_PWM || !energy.relay)
+      energy.count.switches++;
+
+    if (energy.set_point >= 1 && energy.set_point <= 3)
+    {
+      sum = energy.ticks + ticks;
+      energy.count.heater[energy.set_point - 1] += sum >> ENERGY_SHIFT;
+      energy.ticks = sum & (ENERGY_TICKS - 1);
+    }
+  }
+  energy.relay = ticks > 0;
+
+  energy.sequence++;
+}
+
+void energy_task()
+{
+  struct energy_slot s;
+  uint8_t sequence;
+
+  energy.minutes += (uint8_t)(ENERGY_TASK / 60.);
+  if (energy.minutes < CONFIG_ENERGY_SAVE)
+    return;
+  energy.minutes = 0;
+
+  // an overflow in the middle of the copy, copy again
+  do
+  {
+    sequence = energy.sequence;
+    ENERGY_BARRIER();
+    s.count = energy.count;
+    ENERGY_BARRIER();
+  }
+  while (sequence != energy.sequence);
+
+  // the older slot, the newest one stays valid until the write is over
+  s.generation = ++energy.generation;
+  s.crc = ENERGY_CRC(&s);
+  eeprom_update_block(&s, slot_address(energy.slot), sizeof(s));
+  energy.slot = (energy.slot + 1) % ENERGY_SLOTS;
+}
+
+#endif /* CONFIG_ENERGY */
@@ -0,0 +1,114 @@
+/*
+ * Heater energy
+ * =============
+ *
+ * With CONFIG_ENERGY, the unit counts the time its heater is on at each
+ * set point and the closings of the relay, to tell the units with a bad
+ * insulation, that burn far more than the others, and the relays that
+ * wear out.
+ *
+ * The overflow interrupt adds the ticks of TIMER1 the relay is on in
+ * the period it starts, OCR1A or the whole period of the sigma-delta
+ * output, and counts a closing of the relay: a shift and an add, no
+ * multiplication. The time is counted in ENERGY_TICKS ticks of TIMER1,
+ * about a second, so that the counters last for a century.
+ *
+ * The energy is the time on times the power of the heater,
+ * CONFIG_HEATER_WATTS: ENERGY_WH() in watt-hours.
+ *
+ * A task of the main loop (see sched.h) writes the counters to EEPROM
+ * every CONFIG_ENERGY_SAVE minutes, the bytes that changed only, to
+ * the two slots at EE_ENERGY in turn: once an hour, a byte is written
+ * about 4500 times a year. Each slot carries a generation and the
+ * crc8 of the two, the newest valid slot is read at power up. A reset
+ * loses the counts since the last write, a power cut in the middle of
+ * a write the ones of the write before.
+ *
+ * Readout: the registers of the I2C slave (see twi.h, twi_poll -e), or
+ * the EEPROM from make rhistory or remote.py -d, decoded by
+ * host/history_dump.
+ */
+
+#ifndef ENERGY_H
+#define ENERGY_H
+
+#include <stdint.h>
+
+#include "config.h"
+#include "pid.h"
+
+// ticks of TIMER1 in a count of the time on
+#define ENERGY_SHIFT 6
+#define ENERGY_TICKS (1 << ENERGY_SHIFT)
+
+// a count, in seconds
+#define ENERGY_UNIT (TIME_INTERVAL / 256 * ENERGY_TICKS)
+
+// watt-hours of a count of the time on
+#define ENERGY_WH(count) ((count) * ENERGY_UNIT * CONFIG_HEATER_WATTS / 3600.)
+
+// the task that writes the counters, in seconds
+#define ENERGY_TASK 300.
+
+struct energy_record
+{
+  uint32_t heater[3];       // time on at set points 1 to 3, counts
+  uint32_t switches;        // closings of the relay
+};
+
+// two of them at EE_ENERGY, 18 bytes
+struct energy_slot
+{
+  struct energy_record count;
+  uint8_t generation;       // one more than the other slot's, wraps
+  uint8_t crc;              // crc8 of the above
+};
+
+#define ENERGY_SLOTS 2
+
+struct energy
+{
+  struct energy_record count;
+  volatile uint8_t sequence;    // changes with each overflow
+  uint8_t set_point;            // of the compare match, 1 to 3
+  uint8_t ticks;                // short of a count
+  uint8_t relay;                // on in the period before
+  uint8_t minutes;              // since the last write
+  uint8_t slot;                 // written next
+  uint8_t generation;           // of the slot written last
+};
+
+// Reads the newest valid slot of the EEPROM, returns its number plus
+// one, 0 when none is valid
+uint8_t energy_read(struct energy_slot *s);
+
+#if CONFIG_ENERGY
+
+extern struct energy energy;
+
+void energy_init();
+
+// From the overflow interrupt, the ticks the relay is on in the period
+void energy_overflow(uint16_t ticks);
+
+// From the compare match, the set point the heater runs at, 0 for off
+// (see control_index()). The set points of the dial (dial.h) all count
+// as the first
+#if CONFIG_SETPOINT_DIAL
+#define energy_set_point(i) (energy.set_point = (i) > 0)
+#else
+#define energy_set_point(i) (energy.set_point = (i))
+#endif
+
+// The task of the main loop
+void energy_task();
+
+#else
+
+#define energy_init()
+#define energy_overflow(ticks)
+#define energy_set_point(i)
+
+#endif /* CONFIG_ENERGY */
+
+#endif /* ENERGY_H */
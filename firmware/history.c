@@ -0,0 +1,204 @@
+/*
+* ----------------------------------------------------------------------------
+* "THE BEER-WARE LICENSE" (Revision 42):
+* <fakufaku@gmail.com> wrote this file. As long as you retain this notice you
+* can do whatever you want with this stuff. If we meet some day, and you think
+* this stuff is worth it, you can buy me a beer in return -- Robin Scheibler
+* ----------------------------------------------------------------------------
+*/
+
+#include <avr/eeprom.h>
+#include <stddef.h>
+
+#include "history.h"
+#include "eeprom_map.h"
+#include "thermistor.h"
+
+#define HISTORY_HEADER offsetof(struct history_block, data)
+
+static void *slot_address(uint8_t slot)
+{
+  return (void *)(EE_HISTORY + slot * sizeof(struct history_block));
+}
+
+// the bytes of a block the crc covers
+static uint8_t block_crc(const struct history_block *b)
+{
+  return crc8(&b->sequence, HISTORY_HEADER - 1 + b->used);
+}
+
+uint8_t history_read(uint8_t slot, struct history_block *b)
+{
+  eeprom_read_block(b, slot_address(slot), sizeof(*b));
+
+  // an erased slot reads 0xFF everywhere, used is out of range
+  return b->used <= HISTORY_DATA && block_crc(b) == b->crc;
+}
+
+uint8_t history_newest()
+{
+  struct history_block b;
+  uint8_t slot, next, sequence[HISTORY_SLOTS], valid[HISTORY_SLOTS];
+
+  for (slot = 0; slot < HISTORY_SLOTS; slot++)
+  {
+    valid[slot] = history_read(slot, &b);
+    sequence[slot] = b.sequence;
+  }
+
+  for (slot = 0; slot < HISTORY_SLOTS; slot++)
+  {
+    next = slot + 1 < HISTORY_SLOTS ? slot + 1 : 0;
+    if (valid[slot] && (!valid[next]
+          || sequence[next] != (uint8_t)(sequence[slot] + 1)))
+      return slot;
+  }
+
+  return HISTORY_SLOTS;
+}
+
+#if CONFIG_HISTORY
+
+static void write_block(struct history *h)
+{
+  h->block.crc = block_crc(&h->block);
+
+  // only the bytes that changed wear the EEPROM
+  eeprom_update_block(&h->block, slot_address(h->slot),
+      HISTORY_HEADER + h->block.used);
+}
+
+/*
+ * Counts the reset in the newest block, the samples of this run go to
+ * new blocks after it.
+ */
+void history_init(struct history *h, uint8_t warm)
+{
+  uint8_t power_ups, resets;
+
+  h->temperature_sum = 0.;
+  h->duty_sum = 0;
+  h->periods = 0;
+  h->status = 0;
+  h->open = 0;
+
+  // the first period of the run is number 0
+  h->period = 0xFFFF;
+
+  h->slot = history_newest();
+  if (h->slot == HISTORY_SLOTS)
+  {
+    // an empty ring, the first block goes to slot 0
+    h->slot = HISTORY_SLOTS - 1;
+    h->block.sequence = 0xFF;
+    return;
+  }
+
+  history_read(h->slot, &h->block);
+
+  power_ups = HISTORY_POWER_UPS(h->block.resets);
+  resets = HISTORY_WARM(h->block.resets);
+  if (warm && resets < 15)
+    resets++;
+  else if (!warm && power_ups < 15)
+    power_ups++;
+  h->block.resets = power_ups << 4 | resets;
+
+  write_block(h);
+}
+
+// Appends an unsigned varint, returns the position after it
+static uint8_t put_varint(uint8_t *buf, uint8_t n, uint32_t v)
+{
+  while (v >= 0x80)
+  {
+    buf[n++] = (v & 0x7F) | 0x80;
+    v >>= 7;
+  }
+  buf[n++] = v;
+
+  return n;
+}
+
+static uint32_t zigzag(int32_t v)
+{
+  return v < 0 ? ((uint32_t)-v << 1) - 1 : (uint32_t)v << 1;
+}
+
+// Starts the next block of the ring with the sample
+static void start_block(struct history *h, int16_t t, uint8_t d, uint8_t s)
+{
+  h->slot = h->slot + 1 < HISTORY_SLOTS ? h->slot + 1 : 0;
+  h->block.sequence++;
+  h->block.used = 0;
+  h->block.resets = 0;
+  h->block.temperature = t;
+  h->block.duty = d;
+  h->block.status = s;
+  h->open = 1;
+}
+
+// For each record of a control period, in the main loop
+void history_update(struct history *h, const struct sample *p)
+{
+  uint8_t buf[HISTORY_SAMPLE_MAX];
+  uint8_t i, n, d, s;
+  uint8_t sensor_fault = p->faults & 0x0F, protect_fault = p->faults >> 4;
+  uint16_t k;
+  int16_t t;
+  float x;
+
+  // the periods of the records lost on a full queue count as this one,
+  // the samples keep their length
+  k = p->period - h->period;
+  if (k > CONFIG_HISTORY_PERIODS)
+    k = CONFIG_HISTORY_PERIODS;
+  h->period = p->period;
+
+  h->temperature_sum += k * p->temperature;
+  if (p->state == PWM_ON)
+    h->duty_sum += (uint32_t)k * p->pwm_val;
+  else
+    h->status |= HISTORY_OFF;
+  if (sensor_fault)
+    h->status |= HISTORY_OPEN << (sensor_fault - 1);
+  if (protect_fault)
+    h->status |= HISTORY_OVER << (protect_fault - 1);
+
+  h->periods += k;
+  if (h->periods < CONFIG_HISTORY_PERIODS)
+    return;
+
+  // the sample, in tenths of a degree
+  x = h->temperature_sum * 10. / h->periods;
+  t = (int16_t)(x + (x < 0. ? -0.5 : 0.5));
+  d = (h->duty_sum + h->periods / 2) / h->periods;
+  s = h->status;
+
+  h->temperature_sum = 0.;
+  h->duty_sum = 0;
+  h->periods = 0;
+  h->status = 0;
+
+  n = put_varint(buf, 0,
+      zigzag((int32_t)t - h->temperature) << 1 | (s != h->status_last));
+  n = put_varint(buf, n, zigzag((int16_t)d - h->duty));
+  if (s != h->status_last)
+    buf[n++] = s;
+
+  if (h->open && h->block.used + n <= HISTORY_DATA)
+  {
+    for (i = 0; i < n; i++)
+      h->block.data[h->block.used++] = buf[i];
+  }
+  else
+    start_block(h, t, d, s);
+
+  h->temperature = t;
+  h->duty = d;
+  h->status_last = s;
+
+  write_block(h);
+}
+
+#endif /* CONFIG_HISTORY */
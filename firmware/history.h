@@ -0,0 +1,122 @@
+/*
+ * Temperature history
+ * ===================
+ *
+ * With CONFIG_HISTORY, the unit keeps the history of the last days in
+ * EEPROM, to audit a run after the fact without a host attached.
+ *
+ * A sample is the mean temperature and duty cycle over
+ * CONFIG_HISTORY_PERIODS control periods, and the faults seen in them.
+ * The samples are packed into blocks of 32 bytes: the first sample of
+ * a block as is, the next ones as the differences to the one before,
+ * zigzag and varint encoded (LEB128, 7 bits a byte):
+ *
+ *   varint  zigzag(temperature difference) << 1 | status follows
+ *   varint  zigzag(duty cycle difference)
+ *   byte    status, when it changed
+ *
+ * A steady box takes 2 bytes a sample, 13 samples a block.
+ *
+ * The block being filled is kept in RAM and written to its slot of the
+ * ring at EE_HISTORY after each sample, the bytes that changed only.
+ * The slots are written one after the other around the ring, so the
+ * wear spreads over all of them: at the default settings, a slot is
+ * written about 13 times in the 47 hours of a turn of the ring.
+ *
+ * The newest block is the one whose next slot does not follow it in
+ * sequence. A reset ends the block being filled and is counted in it,
+ * the next sample starts a new block.
+ *
+ * The compare match interrupt queues the record of each period (see
+ * queue.h), the samples are taken from the main loop: the writes take
+ * about 3.4 ms a byte, 8 bytes or 27 ms at most once a sample, outside
+ * of the interrupts. A power cut in the middle loses the block being
+ * filled.
+ *
+ * Readout, with the unit stopped by the programmer:
+ *
+ * > make rhistory
+ *
+ * or over the serial line of CONFIG_REMOTE, with remote.py -d. The
+ * EEPROM is decoded by host/history_dump.
+ */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+
+#include "config.h"
+#include "control.h"
+
+#define HISTORY_SLOTS 12
+#define HISTORY_DATA 24
+
+// longest encoded sample
+#define HISTORY_SAMPLE_MAX 6
+
+// status of a sample, the faults seen in its periods
+#define HISTORY_OPEN  0x01  // sensor.h
+#define HISTORY_SHORT 0x02
+#define HISTORY_JUMP  0x04
+#define HISTORY_STUCK 0x08
+#define HISTORY_OVER  0x10  // protect.h
+#define HISTORY_RISE  0x20
+#define HISTORY_OFF   0x80  // the heater was off (control.h)
+
+// resets after the last sample of a block, 15 at most each
+#define HISTORY_POWER_UPS(resets)  ((resets) >> 4)
+#define HISTORY_WARM(resets)       ((resets) & 0x0F)
+
+// a slot of the ring, 32 bytes
+struct history_block
+{
+  uint8_t crc;              // crc8 of the bytes after it, up to data[used]
+  uint8_t sequence;         // of the slots written, wraps around
+  uint8_t used;             // bytes of data
+  uint8_t resets;           // power-ups << 4 | warm resets
+  int16_t temperature;      // first sample, 0.1 C
+  uint8_t duty;             // out of 256
+  uint8_t status;
+  uint8_t data[HISTORY_DATA];
+};
+
+struct history
+{
+  // the sample being taken
+  float temperature_sum;
+  uint32_t duty_sum;
+  uint32_t periods;
+  uint8_t status;
+  uint16_t period;          // of the last record
+
+  // the last sample, the differences are from it
+  int16_t temperature;
+  uint8_t duty;
+  uint8_t status_last;
+
+  // the block being filled, in its slot
+  struct history_block block;
+  uint8_t slot;
+  uint8_t open;             // a block was started since the reset
+};
+
+// Reads a slot, returns 1 when it holds a block
+uint8_t history_read(uint8_t slot, struct history_block *b);
+
+// The slot of the newest block, HISTORY_SLOTS when there is none
+uint8_t history_newest();
+
+#if CONFIG_HISTORY
+
+void history_init(struct history *h, uint8_t warm);
+void history_update(struct history *h, const struct sample *p);
+
+#else
+
+#define history_init(h, warm)
+#define history_update(h, p)
+
+#endif /* CONFIG_HISTORY */
+
+#endif /* HISTORY_H */
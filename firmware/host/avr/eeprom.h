@@ -0,0 +1,26 @@
+/* Host shim of avr-libc <avr/eeprom.h>, backed by host_eeprom[] */
+#ifndef HOST_EEPROM_H
+#define HOST_EEPROM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define EEMEM
+#define E2END 0x1FF
+
+extern uint8_t host_eeprom[E2END + 1];
+
+void host_eeprom_erase();
+int host_eeprom_load_hex(const char *filename);
+int host_eeprom_save_hex(const char *filename);
+
+void eeprom_read_block(void *dst, const void *src, size_t n);
+void eeprom_update_block(const void *src, void *dst, size_t n);
+uint8_t eeprom_read_byte(const uint8_t *p);
+void eeprom_update_byte(uint8_t *p, uint8_t v);
+void eeprom_busy_wait();
+
+#define eeprom_write_block eeprom_update_block
+#define eeprom_write_byte eeprom_update_byte
+
+#endif
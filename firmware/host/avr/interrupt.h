@@ -0,0 +1,13 @@
+/* Host shim of avr-libc <avr/interrupt.h>, the vectors are functions */
+#ifndef HOST_INTERRUPT_H
+#define HOST_INTERRUPT_H
+
+#include <avr/io.h>
+
+#define SIGNAL(v) void v(void); void v(void)
+#define ISR(v, ...) void v(void); void v(void)
+
+#define sei() (SREG |= 0x80)
+#define cli() (SREG &= ~0x80)
+
+#endif
@@ -0,0 +1,142 @@
+/*
+ * Host shim of avr-libc <avr/io.h> for the ATtiny85, backed by
+ * variables in io.c. A conversion started through ADCSRA completes on
+ * the next read of ADCSRA, with the value of host_adc_input[] for the
+ * channel of ADMUX.
+ */
+#ifndef HOST_IO_H
+#define HOST_IO_H
+
+#include <stdint.h>
+
+extern volatile uint8_t PORTB, DDRB, PINB;
+extern volatile uint8_t ADMUX, ADCSRB, ADCH, ADCL;
+extern volatile uint16_t ADC;
+extern volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, OCR0B;
+extern volatile uint8_t TCCR1, TCNT1, OCR1A, OCR1B, OCR1C, GTCCR;
+extern volatile uint8_t TIMSK, TIFR;
+extern volatile uint8_t SREG, MCUSR, MCUCR, WDTCR, PRR, DIDR0, ACSR;
+extern volatile uint8_t CLKPR, OSCCAL;
+extern volatile uint8_t USICR, USISR, USIDR, USIBR, GIMSK, GIFR, PCMSK;
+
+extern uint16_t host_adc_input[16];
+volatile uint8_t *host_adcsra();
+#define ADCSRA (*host_adcsra())
+
+// PORTB
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+
+// ADMUX, ADCSRA
+#define MUX0 0
+#define MUX1 1
+#define MUX2 2
+#define MUX3 3
+#define REFS2 4
+#define ADLAR 5
+#define REFS0 6
+#define REFS1 7
+#define ADPS0 0
+#define ADPS1 1
+#define ADPS2 2
+#define ADIE 3
+#define ADIF 4
+#define ADATE 5
+#define ADSC 6
+#define ADEN 7
+
+// DIDR0, ACSR
+#define ADC0D 5
+#define ADC2D 4
+#define ADC3D 3
+#define ADC1D 2
+#define ACD 7
+
+// TIMER0
+#define WGM00 0
+#define WGM01 1
+#define CS00 0
+#define CS01 1
+#define CS02 2
+#define WGM02 3
+
+// TIMER1, GTCCR
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define CS13 3
+#define COM1A0 4
+#define COM1A1 5
+#define PWM1A 6
+#define CTC1 7
+#define PSR0 0
+#define PSR1 1
+
+// TIMSK, TIFR
+#define OCIE0B 3
+#define OCIE0A 4
+#define TOIE0 1
+#define TOIE1 2
+#define OCIE1B 5
+#define OCIE1A 6
+#define TOV0 1
+#define TOV1 2
+#define OCF0B 3
+#define OCF0A 4
+#define OCF1B 5
+#define OCF1A 6
+
+// PRR
+#define PRADC 0
+#define PRUSI 1
+#define PRTIM0 2
+#define PRTIM1 3
+
+// MCUSR, WDTCR, MCUCR, CLKPR
+#define PORF 0
+#define EXTRF 1
+#define BORF 2
+#define WDRF 3
+#define WDP0 0
+#define WDP1 1
+#define WDP2 2
+#define WDE 3
+#define WDCE 4
+#define WDP3 5
+#define WDIE 6
+#define WDIF 7
+#define BODSE 2
+#define SM0 3
+#define SM1 4
+#define SE 5
+#define BODS 7
+#define CLKPCE 7
+
+// GIMSK, GIFR, PCMSK
+#define PCIE 5
+#define INT0 6
+#define PCIF 5
+#define INTF0 6
+#define PCINT4 4
+
+// USICR, USISR
+#define USITC 0
+#define USICLK 1
+#define USICS0 2
+#define USICS1 3
+#define USIWM0 4
+#define USIWM1 5
+#define USIOIE 6
+#define USISIE 7
+#define USIDC 4
+#define USIPF 5
+#define USIOIF 6
+#define USISIF 7
+
+#define _BV(b) (1 << (b))
+
+#endif
@@ -0,0 +1,15 @@
+/* Host shim of avr-libc <avr/sleep.h>, the host does not sleep */
+#ifndef HOST_SLEEP_H
+#define HOST_SLEEP_H
+
+#define SLEEP_MODE_IDLE 0
+#define SLEEP_MODE_ADC 1
+#define SLEEP_MODE_PWR_DOWN 2
+
+#define set_sleep_mode(m)
+#define sleep_enable()
+#define sleep_disable()
+#define sleep_cpu()
+#define sleep_bod_disable()
+
+#endif
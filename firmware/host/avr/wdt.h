@@ -0,0 +1,22 @@
+/* Host shim of avr-libc <avr/wdt.h> */
+#ifndef HOST_WDT_H
+#define HOST_WDT_H
+
+#include <avr/io.h>
+
+#define WDTO_15MS 0
+#define WDTO_30MS 1
+#define WDTO_60MS 2
+#define WDTO_120MS 3
+#define WDTO_250MS 4
+#define WDTO_500MS 5
+#define WDTO_1S 6
+#define WDTO_2S 7
+#define WDTO_4S 8
+#define WDTO_8S 9
+
+#define wdt_reset()
+#define wdt_enable(t) (WDTCR = (1 << WDE) | ((t) & 7) | (((t) & 8) << 2))
+#define wdt_disable() (WDTCR = 0)
+
+#endif
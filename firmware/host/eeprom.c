@@ -0,0 +1,94 @@
+/*
+ * Host EEPROM
+ * ===========
+ *
+ * The 512 bytes of the ATtiny85 EEPROM in RAM. It starts erased and
+ * can be loaded from and saved to the Intel HEX files of avrdude.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <avr/eeprom.h>
+
+uint8_t host_eeprom[E2END + 1];
+
+void host_eeprom_erase()
+{
+  memset(host_eeprom, 0xFF, sizeof(host_eeprom));
+}
+
+int host_eeprom_load_hex(const char *filename)
+{
+  FILE *f = fopen(filename, "r");
+  char line[128];
+  unsigned int n, addr, type, byte, i;
+
+  if (f == NULL)
+    return -1;
+
+  while (fgets(line, sizeof(line), f))
+  {
+    if (sscanf(line, ":%2x%4x%2x", &n, &addr, &type) != 3)
+      continue;
+    if (type != 0)
+      break;
+
+    for (i = 0; i < n && addr + i <= E2END; i++)
+    {
+      sscanf(line + 9 + 2 * i, "%2x", &byte);
+      host_eeprom[addr + i] = byte;
+    }
+  }
+
+  fclose(f);
+  return 0;
+}
+
+int host_eeprom_save_hex(const char *filename)
+{
+  FILE *f = fopen(filename, "w");
+  unsigned int addr, i, sum;
+
+  if (f == NULL)
+    return -1;
+
+  for (addr = 0; addr <= E2END; addr += 16)
+  {
+    fprintf(f, ":10%04X00", addr);
+    sum = 0x10 + (addr >> 8) + (addr & 0xFF);
+    for (i = 0; i < 16; i++)
+    {
+      fprintf(f, "%02X", host_eeprom[addr + i]);
+      sum += host_eeprom[addr + i];
+    }
+    fprintf(f, "%02X\n", -sum & 0xFF);
+  }
+  fprintf(f, ":00000001FF\n");
+
+  return fclose(f);
+}
+
+void eeprom_read_block(void *dst, const void *src, size_t n)
+{
+  memcpy(dst, host_eeprom + (size_t)src, n);
+}
+
+void eeprom_update_block(const void *src, void *dst, size_t n)
+{
+  memcpy(host_eeprom + (size_t)dst, src, n);
+}
+
+uint8_t eeprom_read_byte(const uint8_t *p)
+{
+  return host_eeprom[(size_t)p];
+}
+
+void eeprom_update_byte(uint8_t *p, uint8_t v)
+{
+  host_eeprom[(size_t)p] = v;
+}
+
+void eeprom_busy_wait()
+{
+}
@@ -0,0 +1,198 @@
+/*
+ * Fleet simulation
+ * ================
+ *
+ * Thousands of incubators, each running the control step of the
+ * firmware (control.c: conversion, filter, state machine and PID, and
+ * the checks of sensor.c) in a simulated box, on all the cores.
+ *
+ *   ./fleet_sim [-n units] [-d hours] [-j threads] [-s seed] [-o units.csv]
+ *               [-b boxes.csv] [-l seconds]
+ *
+ * Every unit draws its own box (see plant.h): volume, heater power,
+ * ambient, time constant of the thermistor, calibration offset and
+ * ADC noise. With -b, the units take in turn the boxes identified by
+ * plant_id instead. The trimpot is at the first set point. With -l,
+ * the lid of every unit is open for that many seconds at the middle of
+ * the run.
+ *
+ * The units run in tasks of UNITS_PER_TASK on the work-stealing pool
+ * of pool.h.
+ *
+ * It prints the distribution over the fleet of the time to reach the
+ * set point within TEMP_SET_ERROR, the overshoot after, the error over
+ * the last quarter of the run, the relay switches per hour, and the
+ * share of the control periods that measure the temperature. With the
+ * lid opened, the time from the lid closed to within TEMP_SET_ERROR for
+ * good and the overshoot after; the lid events the controller detected
+ * are counted in any case, any without -l are false. The
+ * firmware options are the ones of config.h, DEFS of the Makefile
+ * changes them (make fleet_sim DEFS=-DCONFIG_K_P=5).
+ */
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "plant.h"
+#include "pool.h"
+
+#define UNITS_PER_TASK 8
+#define TRIMPOT 1
+
+static int n_units = 1000;
+static double hours = 48.;
+static uint64_t seed = 1;
+static double lid = 0.;
+
+static struct run *results;
+static struct box *boxes;
+static int n_boxes = 0;
+
+static void simulate(int task, void *arg)
+{
+  int unit;
+
+  for (unit = task * UNITS_PER_TASK;
+      unit < n_units && unit < (task + 1) * UNITS_PER_TASK; unit++)
+  {
+    uint64_t s = seed * 1000003ULL + unit;
+    struct box b;
+    struct control c;
+
+    if (n_boxes > 0)
+      b = boxes[unit % n_boxes];
+    else
+      plant_draw(&b, &s);
+    control_init(&c);
+    plant_run(&b, &c, TRIMPOT, hours, &s, &results[unit]);
+  }
+}
+
+static int compare(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static void stats(const char *name, size_t offset, double scale)
+{
+  double *v = malloc(n_units * sizeof(double));
+  double sum = 0.;
+  int i, n = 0;
+
+  for (i = 0; i < n_units; i++)
+  {
+    double x = *(const double *)((const char *)&results[i] + offset);
+    if ((offset == offsetof(struct run, reach)
+          || offset == offsetof(struct run, recovery)) && x < 0.)
+      continue;
+    v[n++] = x * scale;
+    sum += x * scale;
+  }
+
+  if (n == 0)
+    printf("  %-22s none\n", name);
+  else
+  {
+    qsort(v, n, sizeof(double), compare);
+    printf("  %-22s %9.2f %9.2f %9.2f %9.2f %9.2f\n", name, sum / n,
+        v[n / 20], v[n / 2], v[n - 1 - n / 20], v[n - 1]);
+  }
+
+  free(v);
+}
+
+int main(int argc, char **argv)
+{
+  struct timespec start, stop;
+  double wall;
+  int i, n_threads = 0, missed = 0, stuck = 0;
+  FILE *f;
+  const char *csv = NULL;
+
+  for (i = 1; i + 1 < argc; i += 2)
+  {
+    if (!strcmp(argv[i], "-n"))
+      n_units = atoi(argv[i + 1]);
+    else if (!strcmp(argv[i], "-d"))
+      hours = atof(argv[i + 1]);
+    else if (!strcmp(argv[i], "-j"))
+      n_threads = atoi(argv[i + 1]);
+    else if (!strcmp(argv[i], "-s"))
+      seed = strtoull(argv[i + 1], NULL, 0);
+    else if (!strcmp(argv[i], "-l"))
+      lid = atof(argv[i + 1]);
+    else if (!strcmp(argv[i], "-o"))
+      csv = argv[i + 1];
+    else if (!strcmp(argv[i], "-b") && (n_boxes = plant_load(argv[i + 1], &boxes)) <= 0)
+    {
+      fprintf(stderr, "No box in %s\n", argv[i + 1]);
+      return 1;
+    }
+  }
+  if (n_threads <= 0)
+    n_threads = pool_threads();
+  if (n_units <= 0 || hours <= 0. || lid < 0.)
+  {
+    fprintf(stderr, "%s [-n units] [-d hours] [-j threads] [-s seed] [-o units.csv] [-b boxes.csv] [-l seconds]\n", argv[0]);
+    return 1;
+  }
+
+  plant_init();
+  if (lid > 0.)
+    plant_lid(hours * 1800., lid);
+  results = calloc(n_units, sizeof(struct run));
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  pool_run((n_units + UNITS_PER_TASK - 1) / UNITS_PER_TASK, n_threads,
+      simulate, NULL);
+  clock_gettime(CLOCK_MONOTONIC, &stop);
+  wall = (stop.tv_sec - start.tv_sec) + 1e-9 * (stop.tv_nsec - start.tv_nsec);
+
+  for (i = 0; i < n_units; i++)
+  {
+    missed += results[i].reach < 0.;
+    stuck += results[i].recovery < 0.;
+  }
+
+  printf("%d units, %.0f h, %d threads, %.2f s, %.0f times real time per unit\n",
+      n_units, hours, n_threads, wall, n_units * hours * 3600. / wall);
+  printf("set point %.1f C, K_p %g K_i %g K_d %g, PWM %d..%d\n",
+      control_set_point(TRIMPOT), CONFIG_K_P, CONFIG_K_I, CONFIG_K_D,
+      PWM_MIN, PWM_MAX);
+  printf("  %-22s %9s %9s %9s %9s %9s\n", "", "mean", "p5", "median", "p95", "max");
+  stats("time to set point min", offsetof(struct run, reach), 1. / 60.);
+  stats("overshoot C", offsetof(struct run, overshoot), 1.);
+  stats("steady error C", offsetof(struct run, error), 1.);
+  stats("steady rms C", offsetof(struct run, rms), 1.);
+  stats("relay switches / h", offsetof(struct run, switches), 1.);
+  stats("periods measured %", offsetof(struct run, sampled), 100.);
+  if (lid > 0.)
+  {
+    stats("lid recovery min", offsetof(struct run, recovery), 1. / 60.);
+    stats("lid overshoot C", offsetof(struct run, lid_overshoot), 1.);
+  }
+  stats("lid events detected", offsetof(struct run, detected), 1.);
+  printf("  %d units never reached the set point\n", missed);
+  if (lid > 0.)
+    printf("  %d units never recovered from the lid\n", stuck);
+
+  if (csv != NULL && (f = fopen(csv, "w")) != NULL)
+  {
+    fprintf(f, "unit,reach_s,overshoot_C,error_C,rms_C,switches_per_h,sampled,recovery_s,lid_overshoot_C,detected\n");
+    for (i = 0; i < n_units; i++)
+      fprintf(f, "%d,%.1f,%.3f,%.3f,%.3f,%.1f,%.3f,%.1f,%.3f,%.0f\n", i,
+          results[i].reach, results[i].overshoot, results[i].error,
+          results[i].rms, results[i].switches, results[i].sampled,
+          results[i].recovery, results[i].lid_overshoot,
+          results[i].detected);
+    fclose(f);
+  }
+
+  return 0;
+}
@@ -0,0 +1,248 @@
+/*
+ * History decoder
+ * ===============
+ *
+ * Decodes the temperature history of history.h from the EEPROM of a
+ * unit, the Intel HEX file of make rhistory, remote.py -d or replay -w.
+ *
+ *   ./history_dump [-p periods] [-c] [-e] [-w watts] eeprom.hex
+ *
+ * The blocks are read from the oldest to the newest, and the samples
+ * printed by run: a run ends with the resets counted in its last block.
+ * The time of a sample is the end of its periods (-p, default
+ * CONFIG_HISTORY_PERIODS of the build) from the start of the run, or
+ * from the oldest sample kept when the ring overwrote the start.
+ *
+ * -c prints "run,hours,temperature,pwm,status" lines instead, the
+ * status in hex (HISTORY_OPEN...).
+ *
+ * -e prints the energy counters of energy.h instead, as of their last
+ * write: the hours the heater was on at each set point, and the energy
+ * at the power of the heater, CONFIG_HEATER_WATTS of the build or -w.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <avr/eeprom.h>
+
+#include "../history.h"
+#include "../energy.h"
+
+static int csv = 0;
+static double sample_hours;
+
+static const char *status_names[8] =
+{
+  "open", "short", "jump", "stuck", "over", "rise", "?", "off"
+};
+
+static void print_sample(int run, long i, int16_t t, uint8_t d, uint8_t s)
+{
+  int b;
+
+  if (csv)
+  {
+    printf("%d,%.3f,%.1f,%u,%02x\n", run, (i + 1) * sample_hours,
+        t / 10., d, s);
+    return;
+  }
+
+  printf("  %8.2f %6.1f %4u ", (i + 1) * sample_hours, t / 10., d);
+  for (b = 0; b < 8; b++)
+    if (s & (1 << b))
+      printf(" %s", status_names[b]);
+  printf("\n");
+}
+
+// Reads a varint of the data of a block, 0 past the bytes used
+static int get_varint(const struct history_block *b, uint8_t *p,
+    uint32_t *v)
+{
+  int shift;
+
+  *v = 0;
+  for (shift = 0; *p < b->used && shift < 32; shift += 7)
+  {
+    *v |= (uint32_t)(b->data[*p] & 0x7F) << shift;
+    if (!(b->data[(*p)++] & 0x80))
+      return 1;
+  }
+
+  return 0;
+}
+
+static int32_t unzigzag(uint32_t v)
+{
+  return v & 1 ? -(int32_t)(v >> 1) - 1 : (int32_t)(v >> 1);
+}
+
+/*
+ * The samples of a block, numbered on from i, returns the next number
+ * or -1 when the data is cut short
+ */
+static long print_block(int run, long i, const struct history_block *b)
+{
+  int16_t t = b->temperature;
+  uint8_t d = b->duty, s = b->status, p = 0;
+  uint32_t vt, vd;
+
+  print_sample(run, i++, t, d, s);
+
+  while (p < b->used)
+  {
+    if (!get_varint(b, &p, &vt) || !get_varint(b, &p, &vd))
+      return -1;
+    if (vt & 1)
+    {
+      if (p == b->used)
+        return -1;
+      s = b->data[p++];
+    }
+    t += unzigzag(vt >> 1);
+    d += unzigzag(vd);
+    print_sample(run, i++, t, d, s);
+  }
+
+  return i;
+}
+
+static void print_resets(uint8_t resets)
+{
+  printf("  ended by %u power-ups and %u other resets%s\n",
+      HISTORY_POWER_UPS(resets), HISTORY_WARM(resets),
+      HISTORY_POWER_UPS(resets) == 15 || HISTORY_WARM(resets) == 15
+      ? " (at least)" : "");
+}
+
+static int print_energy(const char *file, double watts)
+{
+  struct energy_slot s;
+  const struct energy_record *e = &s.count;
+  double hours, total = 0.;
+  int i;
+
+  if (!energy_read(&s))
+  {
+    fprintf(stderr, "No energy counters in %s\n", file);
+    return 1;
+  }
+
+  printf("set point   hours     kWh\n");
+  for (i = 0; i < 3; i++)
+  {
+    hours = e->heater[i] * ENERGY_UNIT / 3600.;
+    total += hours;
+    printf("  %d      %8.2f %7.3f\n", i + 1, hours, hours * watts / 1000.);
+  }
+  printf("  all    %8.2f %7.3f at %.0f W\n", total, total * watts / 1000.,
+      watts);
+  printf("%lu closings of the relay\n", (unsigned long)e->switches);
+
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  struct history_block b;
+  const char *file = NULL;
+  unsigned long periods = CONFIG_HISTORY_PERIODS;
+  uint8_t newest, slot, sequence = 0, resets = 0;
+  int k, kept = 0, run = 0, usage = 0, energy = 0;
+  double watts = CONFIG_HEATER_WATTS;
+  long i = 0, n, samples = 0;
+
+  for (k = 1; k < argc; k++)
+  {
+    if (!strcmp(argv[k], "-p") && k + 1 < argc)
+      periods = strtoul(argv[++k], NULL, 0);
+    else if (!strcmp(argv[k], "-c"))
+      csv = 1;
+    else if (!strcmp(argv[k], "-e"))
+      energy = 1;
+    else if (!strcmp(argv[k], "-w") && k + 1 < argc)
+      watts = atof(argv[++k]);
+    else if (file == NULL && argv[k][0] != '-')
+      file = argv[k];
+    else
+      usage = 1;
+  }
+  if (file == NULL || usage || periods == 0 || watts <= 0.)
+  {
+    fprintf(stderr, "%s [-p periods] [-c] [-e] [-w watts] eeprom.hex\n", argv[0]);
+    return 2;
+  }
+
+  host_eeprom_erase();
+  if (host_eeprom_load_hex(file) != 0)
+  {
+    fprintf(stderr, "Cannot read %s\n", file);
+    return 2;
+  }
+  sample_hours = periods * TIME_INTERVAL / 3600.;
+
+  if (energy)
+    return print_energy(file, watts);
+
+  newest = history_newest();
+  if (newest == HISTORY_SLOTS)
+  {
+    fprintf(stderr, "No history in %s\n", file);
+    return 1;
+  }
+
+  for (slot = 0; slot < HISTORY_SLOTS; slot++)
+    kept += history_read(slot, &b);
+
+  if (csv)
+    printf("run,hours,temperature,pwm,status\n");
+
+  // from the slot after the newest, the oldest when the ring is full
+  for (k = 1; k <= HISTORY_SLOTS; k++)
+  {
+    slot = (newest + k) % HISTORY_SLOTS;
+    if (!history_read(slot, &b))
+      continue;
+
+    // a run starts after the resets, or after a block that was lost
+    if (run == 0 || resets != 0 || b.sequence != (uint8_t)(sequence + 1))
+    {
+      if (run > 0 && !csv)
+      {
+        if (resets != 0)
+          print_resets(resets);
+        else
+          printf("  ended by a block that was lost\n");
+      }
+      run++;
+      i = 0;
+      if (!csv)
+        printf("run %d%s\n     hours   temp  pwm  status\n", run,
+            run == 1 && kept == HISTORY_SLOTS
+            ? ", its start may have been overwritten" : "");
+    }
+
+    n = print_block(run, i, &b);
+    if (n < 0)
+    {
+      fprintf(stderr, "Block %u is cut short\n", slot);
+      return 1;
+    }
+    samples += n - i;
+    i = n;
+
+    sequence = b.sequence;
+    resets = b.resets;
+  }
+
+  if (!csv)
+  {
+    if (resets != 0)
+      print_resets(resets);
+    printf("%ld samples of %.2f hours in %d blocks, %.1f days\n", samples,
+        sample_hours, kept, samples * sample_hours / 24.);
+  }
+
+  return 0;
+}
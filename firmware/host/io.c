@@ -0,0 +1,43 @@
+/*
+ * Host I/O registers
+ * ==================
+ *
+ * The ATtiny85 registers the firmware touches, as plain variables, and
+ * an ADC that converts host_adc_input[] (see avr/io.h).
+ */
+
+#include <avr/io.h>
+
+volatile uint8_t PORTB, DDRB, PINB;
+volatile uint8_t ADMUX, ADCSRB, ADCH, ADCL;
+volatile uint16_t ADC;
+volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, OCR0B;
+volatile uint8_t TCCR1, TCNT1, OCR1A, OCR1B, OCR1C, GTCCR;
+volatile uint8_t TIMSK, TIFR;
+volatile uint8_t SREG, MCUSR, MCUCR, WDTCR, PRR, DIDR0, ACSR;
+volatile uint8_t CLKPR, OSCCAL;
+volatile uint8_t USICR, USISR, USIDR, USIBR, GIMSK, GIFR, PCMSK;
+
+uint16_t host_adc_input[16];
+
+static volatile uint8_t adcsra;
+
+volatile uint8_t *host_adcsra()
+{
+  uint16_t v;
+
+  // the conversion started by the previous access is done
+  if ((adcsra & (1 << ADSC)) && (adcsra & (1 << ADEN)))
+  {
+    v = host_adc_input[ADMUX & 0x0F] & 0x3FF;
+    if (ADMUX & (1 << ADLAR))
+      v <<= 6;
+    ADC = v;
+    ADCL = v & 0xFF;
+    ADCH = v >> 8;
+    adcsra &= ~(1 << ADSC);
+    adcsra |= 1 << ADIF;
+  }
+
+  return &adcsra;
+}
@@ -0,0 +1,427 @@
+/*
+ * Gain sweep
+ * ==========
+ *
+ * Scores gains and duty cycle limits of the controller of pid.c over a
+ * family of simulated incubators (see plant.h), on all the cores, and
+ * writes the tuning maps.
+ *
+ *   ./pid_sweep [-P lo:hi:n] [-I lo:hi:n] [-D lo:hi:n] [-m lo:hi:n]
+ *               [-M lo:hi:n] [-r samples] [-u units] [-d hours]
+ *               [-j threads] [-s seed] [-o directory] [-b boxes.csv]
+ *
+ *   -P -I -D  K_p, K_i and K_d, geometric steps when lo > 0
+ *   -m -M     PWM_MIN and PWM_MAX, linear steps
+ *   -r        random samples in the same ranges instead of the grid
+ *   -u        boxes of the family (default 24, all of -b)
+ *   -d        hours from the ambient (default 12)
+ *   -o        output directory (default sweep)
+ *   -b        the boxes identified by plant_id, instead of drawn ones
+ *
+ * Every point runs the same boxes, with the same noise, from the
+ * ambient to the first set point. The boxes are drawn as in fleet_sim,
+ * keeping the ones whose heater can hold the set point at PWM_MAX with
+ * 20 % to spare: a box that cannot settle scores the same whatever the
+ * gains.
+ *
+ * Scores of a point, over the family:
+ *   settle    worst time after which the chamber stays within
+ *             TEMP_SET_ERROR, the run length when it does not settle
+ *   overshoot worst overshoot after reaching the set point
+ *   iae       mean integral of the absolute error
+ *   switches  mean relay operations per hour
+ *
+ * Files of the output directory:
+ *   points.csv         every point and its scores
+ *   pareto.csv         the points no other point beats on all 4 scores
+ *   heat_<score>.csv   K_i by K_p, best score over the other parameters
+ *   heat_<score>.ppm   the same as an image, blue is better
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "plant.h"
+#include "pool.h"
+
+#define TRIMPOT 1
+#define N_SCORES 4
+#define HEAT_BINS 16
+#define HEAT_PIXELS 16
+
+#ifndef PID_TUNING
+#error "pid_sweep needs the gains of pid.c at run time, build it with PID_TUNING"
+#endif
+
+struct axis
+{
+  double lo, hi;
+  int n;
+  int geometric;
+};
+
+struct point
+{
+  double kp, ki, kd;
+  int pwm_min, pwm_max;
+  double score[N_SCORES];   // settle, overshoot, iae, switches
+  int unsettled;
+};
+
+static const char *score_names[N_SCORES] =
+  { "settle", "overshoot", "iae", "switches" };
+
+static struct axis axes[5] =
+{
+  { 1., 40., 12, 1 },     // K_p
+  { 0.02, 2., 12, 1 },    // K_i
+  { 0., 0., 1, 0 },       // K_d
+  { PWM_MIN, PWM_MIN, 1, 0 },
+  { PWM_MAX, PWM_MAX, 1, 0 },
+};
+
+static int n_units = 24;
+static double hours = 12.;
+static uint64_t seed = 1;
+
+static struct box *boxes;
+static int n_boxes = 0;
+static struct point *points;
+
+static double axis_value(const struct axis *a, double x)
+{
+  // x from 0 to 1
+  if (a->geometric && a->lo > 0.)
+    return a->lo * pow(a->hi / a->lo, x);
+  return a->lo + (a->hi - a->lo) * x;
+}
+
+static double axis_step(const struct axis *a, int i)
+{
+  return axis_value(a, a->n > 1 ? (double)i / (a->n - 1) : 0.);
+}
+
+static void parse_axis(struct axis *a, const char *s)
+{
+  if (sscanf(s, "%lf:%lf:%d", &a->lo, &a->hi, &a->n) != 3 || a->n < 1)
+  {
+    fprintf(stderr, "Bad range %s, expected lo:hi:n\n", s);
+    exit(1);
+  }
+}
+
+static void draw_family()
+{
+  uint64_t s = seed;
+  double sp = control_set_point(TRIMPOT);
+  int i = 0;
+
+  if (boxes != NULL)
+    return;
+  boxes = malloc(n_units * sizeof(struct box));
+  while (i < n_units)
+  {
+    plant_draw(&boxes[i], &s);
+    if (boxes[i].P * PWM_MAX / 256. > 1.2 * boxes[i].G * (sp - boxes[i].ambient))
+      i++;
+  }
+}
+
+static void evaluate(int task, void *arg)
+{
+  struct point *p = &points[task];
+  struct control c;
+  struct run r;
+  int u;
+
+  memset(p->score, 0, sizeof(p->score));
+  p->unsettled = 0;
+
+  for (u = 0; u < n_units; u++)
+  {
+    // the same noise for every point
+    uint64_t s = seed * 1000003ULL + u;
+
+    control_init(&c);
+    pid_tune(&c.pid, p->kp, p->ki, p->kd, p->pwm_min, p->pwm_max);
+    plant_run(&boxes[u], &c, TRIMPOT, hours, &s, &r);
+
+    if (r.settle < 0.)
+    {
+      r.settle = hours * 3600.;
+      p->unsettled++;
+    }
+    if (r.settle > p->score[0])
+      p->score[0] = r.settle;
+    if (r.overshoot > p->score[1])
+      p->score[1] = r.overshoot;
+    p->score[2] += r.iae / n_units;
+    p->score[3] += r.switches / n_units;
+  }
+
+  // minutes
+  p->score[0] /= 60.;
+}
+
+static int dominates(const struct point *a, const struct point *b)
+{
+  int k, better = 0;
+
+  for (k = 0; k < N_SCORES; k++)
+  {
+    if (a->score[k] > b->score[k])
+      return 0;
+    if (a->score[k] < b->score[k])
+      better = 1;
+  }
+  return better;
+}
+
+static void write_point(FILE *f, const struct point *p)
+{
+  fprintf(f, "%.5g,%.5g,%.5g,%d,%d,%.2f,%.3f,%.3f,%.1f,%d\n",
+      p->kp, p->ki, p->kd, p->pwm_min, p->pwm_max, p->score[0],
+      p->score[1], p->score[2], p->score[3], p->unsettled);
+}
+
+static FILE *open_out(const char *dir, const char *name)
+{
+  char path[512];
+  FILE *f;
+
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  f = fopen(path, "w");
+  if (f == NULL)
+  {
+    fprintf(stderr, "Cannot write %s\n", path);
+    exit(1);
+  }
+  return f;
+}
+
+// Bin of a gain along an axis of the heat map
+static int heat_bin(const struct axis *a, double v, int bins)
+{
+  double x;
+  int i;
+
+  if (a->hi <= a->lo)
+    return 0;
+  if (a->geometric && a->lo > 0.)
+    x = log(v / a->lo) / log(a->hi / a->lo);
+  else
+    x = (v - a->lo) / (a->hi - a->lo);
+  i = (int)(x * bins);
+  return i < 0 ? 0 : i >= bins ? bins - 1 : i;
+}
+
+static void write_heat(const char *dir, int n_points, int random)
+{
+  int nx = random ? HEAT_BINS : axes[0].n;
+  int ny = random ? HEAT_BINS : axes[1].n;
+  double *cell = malloc(nx * ny * sizeof(double));
+  char name[64];
+  int k, i, x, y, px, py;
+  FILE *f;
+
+  for (k = 0; k < N_SCORES; k++)
+  {
+    double lo = INFINITY, hi = -INFINITY;
+
+    for (i = 0; i < nx * ny; i++)
+      cell[i] = NAN;
+    for (i = 0; i < n_points; i++)
+    {
+      x = heat_bin(&axes[0], points[i].kp, nx);
+      y = heat_bin(&axes[1], points[i].ki, ny);
+      if (isnan(cell[y * nx + x]) || points[i].score[k] < cell[y * nx + x])
+        cell[y * nx + x] = points[i].score[k];
+    }
+
+    snprintf(name, sizeof(name), "heat_%s.csv", score_names[k]);
+    f = open_out(dir, name);
+    fprintf(f, "K_i\\K_p");
+    for (x = 0; x < nx; x++)
+      fprintf(f, ",%.4g", random ? axis_value(&axes[0], (x + 0.5) / nx)
+          : axis_step(&axes[0], x));
+    fprintf(f, "\n");
+    for (y = 0; y < ny; y++)
+    {
+      fprintf(f, "%.4g", random ? axis_value(&axes[1], (y + 0.5) / ny)
+          : axis_step(&axes[1], y));
+      for (x = 0; x < nx; x++)
+      {
+        if (isnan(cell[y * nx + x]))
+          fprintf(f, ",");
+        else
+          fprintf(f, ",%.3f", cell[y * nx + x]);
+        if (cell[y * nx + x] < lo)
+          lo = cell[y * nx + x];
+        if (cell[y * nx + x] > hi)
+          hi = cell[y * nx + x];
+      }
+      fprintf(f, "\n");
+    }
+    fclose(f);
+
+    // K_p to the right, K_i up, empty cells black
+    snprintf(name, sizeof(name), "heat_%s.ppm", score_names[k]);
+    f = open_out(dir, name);
+    fprintf(f, "P6\n%d %d\n255\n", nx * HEAT_PIXELS, ny * HEAT_PIXELS);
+    for (py = ny * HEAT_PIXELS - 1; py >= 0; py--)
+      for (px = 0; px < nx * HEAT_PIXELS; px++)
+      {
+        double v = cell[(py / HEAT_PIXELS) * nx + px / HEAT_PIXELS];
+        double t = hi > lo ? (v - lo) / (hi - lo) : 0.;
+        unsigned char rgb[3] = { 0, 0, 0 };
+
+        if (!isnan(v))
+        {
+          rgb[0] = 255. * t;
+          rgb[1] = 255. * (1. - fabs(2. * t - 1.));
+          rgb[2] = 255. * (1. - t);
+        }
+        fwrite(rgb, 1, 3, f);
+      }
+    fclose(f);
+  }
+
+  free(cell);
+}
+
+int main(int argc, char **argv)
+{
+  const char *dir = "sweep";
+  int i, j, n_points, n_samples = 0, n_threads = 0, n_front = 0;
+  uint64_t s;
+  FILE *f;
+
+  for (i = 1; i < argc; i += 2)
+  {
+    if (i + 1 == argc)
+    {
+      fprintf(stderr, "Option %s without a value, see the top of pid_sweep.c\n", argv[i]);
+      return 1;
+    }
+    if (!strcmp(argv[i], "-P"))
+      parse_axis(&axes[0], argv[i + 1]);
+    else if (!strcmp(argv[i], "-I"))
+      parse_axis(&axes[1], argv[i + 1]);
+    else if (!strcmp(argv[i], "-D"))
+      parse_axis(&axes[2], argv[i + 1]);
+    else if (!strcmp(argv[i], "-m"))
+      parse_axis(&axes[3], argv[i + 1]);
+    else if (!strcmp(argv[i], "-M"))
+      parse_axis(&axes[4], argv[i + 1]);
+    else if (!strcmp(argv[i], "-r"))
+      n_samples = atoi(argv[i + 1]);
+    else if (!strcmp(argv[i], "-u"))
+      n_units = atoi(argv[i + 1]);
+    else if (!strcmp(argv[i], "-d"))
+      hours = atof(argv[i + 1]);
+    else if (!strcmp(argv[i], "-j"))
+      n_threads = atoi(argv[i + 1]);
+    else if (!strcmp(argv[i], "-s"))
+      seed = strtoull(argv[i + 1], NULL, 0);
+    else if (!strcmp(argv[i], "-o"))
+      dir = argv[i + 1];
+    else if (!strcmp(argv[i], "-b"))
+    {
+      if ((n_boxes = plant_load(argv[i + 1], &boxes)) <= 0)
+      {
+        fprintf(stderr, "No box in %s\n", argv[i + 1]);
+        return 1;
+      }
+    }
+    else
+    {
+      fprintf(stderr, "Unknown option %s, see the top of pid_sweep.c\n", argv[i]);
+      return 1;
+    }
+  }
+  if (n_threads <= 0)
+    n_threads = pool_threads();
+  if (n_boxes > 0)
+    n_units = n_boxes;
+  if (n_units <= 0 || hours <= 0.)
+    return 1;
+
+  if (mkdir(dir, 0777) != 0 && errno != EEXIST)
+  {
+    fprintf(stderr, "Cannot create %s\n", dir);
+    return 1;
+  }
+
+  plant_init();
+  draw_family();
+
+  // the points of the grid, or random samples
+  n_points = n_samples;
+  if (n_samples == 0)
+    for (n_points = 1, j = 0; j < 5; j++)
+      n_points *= axes[j].n;
+  points = calloc(n_points, sizeof(struct point));
+
+  s = seed ^ 0x5EEDULL;
+  for (i = 0; i < n_points; i++)
+  {
+    double v[5];
+    int rest = i;
+
+    for (j = 0; j < 5; j++)
+    {
+      if (n_samples)
+        v[j] = axis_value(&axes[j], plant_uniform(&s, 0., 1.));
+      else
+      {
+        v[j] = axis_step(&axes[j], rest % axes[j].n);
+        rest /= axes[j].n;
+      }
+    }
+    points[i].kp = v[0];
+    points[i].ki = v[1];
+    points[i].kd = v[2];
+    points[i].pwm_min = (int)(v[3] + 0.5);
+    points[i].pwm_max = (int)(v[4] + 0.5);
+    if (points[i].pwm_max > 255)
+      points[i].pwm_max = 255;
+    if (points[i].pwm_min > points[i].pwm_max)
+      points[i].pwm_min = points[i].pwm_max;
+  }
+
+  printf("%d points, %d boxes, %.0f h, %d threads\n", n_points, n_units,
+      hours, n_threads);
+  pool_run(n_points, n_threads, evaluate, NULL);
+
+  f = open_out(dir, "points.csv");
+  fprintf(f, "K_p,K_i,K_d,PWM_MIN,PWM_MAX,settle_min,overshoot_C,iae_Ch,switches_per_h,unsettled\n");
+  for (i = 0; i < n_points; i++)
+    write_point(f, &points[i]);
+  fclose(f);
+
+  f = open_out(dir, "pareto.csv");
+  fprintf(f, "K_p,K_i,K_d,PWM_MIN,PWM_MAX,settle_min,overshoot_C,iae_Ch,switches_per_h,unsettled\n");
+  for (i = 0; i < n_points; i++)
+  {
+    for (j = 0; j < n_points; j++)
+      if (dominates(&points[j], &points[i]))
+        break;
+    if (j == n_points)
+    {
+      write_point(f, &points[i]);
+      n_front++;
+    }
+  }
+  fclose(f);
+
+  write_heat(dir, n_points, n_samples > 0);
+
+  printf("%d points on the Pareto front, maps in %s/\n", n_front, dir);
+
+  return 0;
+}
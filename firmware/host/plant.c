@@ -0,0 +1,270 @@
+/*
+ * Simulated incubator, see plant.h
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <avr/eeprom.h>
+
+#include "plant.h"
+#include "../sensor.h"
+#include "../thermistor.h"
+#include "../trim.h"
+
+#ifdef PID_TUNING
+#define FULL_POWER(c) ((c)->pid.pwm_max)
+#else
+#define FULL_POWER(c) PWM_MAX
+#endif
+
+// temperature of every ADC code, the thermistor of the simulation
+static double code_temp[THERM_ADC_N];
+
+// the lid is open from lid_at to lid_end in every run, s
+static double lid_at = -1., lid_end = -1.;
+
+// The calibration is read-only once loaded, shared by the threads
+void plant_init()
+{
+  int i;
+
+  host_eeprom_erase();
+  therm_init();
+  trim_init();
+  for (i = 0; i < THERM_ADC_N; i++)
+    code_temp[i] = therm_convert(i);
+}
+
+// Set before the runs, like the calibration
+void plant_lid(double at, double seconds)
+{
+  lid_at = at;
+  lid_end = at + seconds;
+}
+
+uint64_t plant_rand(uint64_t *s)
+{
+  // splitmix64
+  uint64_t z = (*s += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+double plant_uniform(uint64_t *s, double lo, double hi)
+{
+  return lo + (hi - lo) * (plant_rand(s) >> 11) * (1. / 9007199254740992.);
+}
+
+double plant_gauss(uint64_t *s)
+{
+  double u = plant_uniform(s, 1e-12, 1.), v = plant_uniform(s, 0., 1.);
+  return sqrt(-2. * log(u)) * cos(2. * M_PI * v);
+}
+
+void plant_draw(struct box *b, uint64_t *s)
+{
+  double volume = plant_uniform(s, 20., 80.);   // L
+
+  b->C = 60. * volume;
+  b->G = 0.25 * pow(volume, 2. / 3.);
+  b->P = plant_uniform(s, 60., 150.);
+  b->ambient = plant_uniform(s, 15., 28.);
+  b->tau_s = plant_uniform(s, 5., 20.);
+  b->bias = 0.2 * plant_gauss(s);
+  b->noise = plant_uniform(s, 0.3, 1.5);
+}
+
+/*
+ * Boxes of a CSV written by plant_id -b, identified on real units.
+ * Returns their number, -1 when the file cannot be read.
+ */
+int plant_load(const char *path, struct box **boxes)
+{
+  FILE *f = fopen(path, "r");
+  char line[256];
+  struct box b;
+  int n = 0, cap = 0;
+
+  if (f == NULL)
+    return -1;
+
+  *boxes = NULL;
+  while (fgets(line, sizeof(line), f) != NULL)
+  {
+    // unit,C,G,P,ambient,tau_s,bias,noise, the header does not parse
+    if (sscanf(line, "%*[^,],%lf,%lf,%lf,%lf,%lf,%lf,%lf", &b.C, &b.G, &b.P,
+          &b.ambient, &b.tau_s, &b.bias, &b.noise) != 7)
+      continue;
+    if (n == cap)
+    {
+      cap = cap ? 2 * cap : 16;
+      *boxes = realloc(*boxes, cap * sizeof(struct box));
+    }
+    (*boxes)[n++] = b;
+  }
+
+  fclose(f);
+  return n;
+}
+
+static uint16_t read_adc(double t, uint64_t *s, double noise)
+{
+  int lo = 0, hi = THERM_ADC_N - 1, mid;
+  double code;
+
+  while (hi - lo > 1)
+  {
+    mid = (lo + hi) / 2;
+    if (code_temp[mid] > t)
+      hi = mid;
+    else
+      lo = mid;
+  }
+  code = lo + (t - code_temp[lo]) / (code_temp[hi] - code_temp[lo]);
+  code += noise * plant_gauss(s);
+
+  if (code < 0.)
+    return 0;
+  if (code > THERM_ADC_N - 1)
+    return THERM_ADC_N - 1;
+  return (uint16_t)(code + 0.5);
+}
+
+// Air and thermistor after d seconds with the heater on or off
+static void advance(const struct box *b, double *air, double *therm, int on, double d)
+{
+  double tau = b->C / b->G;
+  double eq = b->ambient + (on ? b->P / b->G : 0.);
+  double a = *air - eq;
+  double k = fabs(tau - b->tau_s) < 1e-6 ? 0. : a * tau / (tau - b->tau_s);
+
+  *air = eq + a * exp(-d / tau);
+  *therm = eq + k * exp(-d / tau) + (*therm - eq - k) * exp(-d / b->tau_s);
+}
+
+/*
+ * Runs c, initialized by the caller, for hours from the ambient with
+ * the trimpot at trimpot.
+ */
+void plant_run(const struct box *b, struct control *c, uint8_t trimpot,
+    double hours, uint64_t *s, struct run *r)
+{
+#if CONFIG_SENSOR_CHECK
+  struct sensor sensor;
+#endif
+  struct box open = *b;
+  const struct box *now;
+  double air, therm, sp, t_end, t_tail, t, d, e;
+  double sum = 0., sum2 = 0.;
+  long n = 0, switches = 0, samples = 0, periods = 0;
+  uint8_t ocr, relay, relay_prev = 0, hold;
+#if CONFIG_OUTPUT == OUTPUT_SIGMA_DELTA
+  uint8_t sigma_delta = 0, previous;
+#endif
+  uint16_t raw;
+  float temp;
+#if CONFIG_LID
+  uint8_t lid;
+#endif
+
+  sensor_init(&sensor);
+  open.G *= LID_LOSS;
+
+  air = therm = b->ambient;
+  sp = control_set_point(trimpot);
+  t_end = hours * 3600.;
+  t_tail = 0.75 * t_end;
+
+  r->reach = -1.;
+  r->settle = 0.;
+  r->overshoot = 0.;
+  r->iae = 0.;
+  r->recovery = lid_at < 0. ? 0. : -1.;
+  r->lid_overshoot = 0.;
+  r->detected = 0.;
+
+  for (t = 0.; t < t_end; t += TIME_INTERVAL, periods++)
+  {
+    // overflow
+#if CONFIG_OUTPUT == OUTPUT_SIGMA_DELTA
+    previous = sigma_delta;
+    sigma_delta += c->pwm_val;
+    relay = c->state == PWM_ON && sigma_delta < previous;
+    ocr = 0;
+#else
+    ocr = c->pwm_val;
+    relay = c->state == PWM_ON && ocr > 0;
+#endif
+    switches += relay != relay_prev;
+
+    // up to the compare match
+    d = TIME_INTERVAL * ocr / 256.;
+    now = t >= lid_at && t < lid_end ? &open : b;
+    advance(now, &air, &therm, relay, d);
+
+    // the compare match interrupt, in the periods it measures
+    if (control_sampling(c))
+    {
+      raw = read_adc(therm + b->bias, s, b->noise);
+      temp = control_temperature(raw);
+      if (sensor_check(&sensor, raw, temp,
+            c->state == PWM_ON && c->pwm_val >= FULL_POWER(c)) == SENSOR_OK)
+        control_filter(c, temp);
+      hold = sensor_fault(&sensor) != SENSOR_OK;
+#if CONFIG_LID
+      lid = c->lid;
+      control_update(c, trimpot, hold);
+      r->detected += lid == LID_CLOSED && c->lid == LID_OPEN;
+#else
+      control_update(c, trimpot, hold);
+#endif
+      samples++;
+    }
+
+#if CONFIG_OUTPUT == OUTPUT_PWM
+    // the relay goes off at the compare match
+    switches += relay;
+    relay = 0;
+#endif
+    relay_prev = relay;
+
+    advance(now, &air, &therm, relay, TIME_INTERVAL - d);
+
+    e = air - sp;
+    r->iae += fabs(e) * TIME_INTERVAL / 3600.;
+    if (fabs(e) < TEMP_SET_ERROR)
+    {
+      if (r->reach < 0.)
+        r->reach = t + TIME_INTERVAL;
+    }
+    else
+      r->settle = t + TIME_INTERVAL;
+    if (r->reach >= 0. && e > r->overshoot)
+      r->overshoot = e;
+    if (lid_at >= 0. && t >= lid_end)
+    {
+      if (fabs(e) >= TEMP_SET_ERROR)
+        r->recovery = -1.;
+      else if (r->recovery < 0.)
+        r->recovery = t + TIME_INTERVAL - lid_end;
+      if (e > r->lid_overshoot && t < lid_end + LID_WINDOW)
+        r->lid_overshoot = e;
+    }
+    if (t >= t_tail)
+    {
+      sum += e;
+      sum2 += e * e;
+      n++;
+    }
+  }
+
+  if (r->settle >= t_end - TIME_INTERVAL)
+    r->settle = -1.;
+  r->error = sum / n;
+  r->rms = sqrt(sum2 / n);
+  r->switches = switches / hours;
+  r->sampled = (double)samples / periods;
+}
@@ -0,0 +1,68 @@
+/*
+ * Simulated incubator
+ * ===================
+ *
+ * One box heated by the relay and controlled by the control step of
+ * the firmware (control.c, sensor.c), shared by the host simulations.
+ *
+ * The air follows one heat capacity and one loss to the ambient, the
+ * thermistor lags the air, both solved exactly over each part of the
+ * period. The period is the one of TIMER1: the relay is on from the
+ * overflow to the compare match, where the thermistor is read with a
+ * calibration offset and ADC noise (see incubalibre.c).
+ *
+ * With plant_lid(), the lid of every box opens once in the run: the
+ * loss to the ambient is LID_LOSS times larger meanwhile.
+ */
+
+#ifndef PLANT_H
+#define PLANT_H
+
+#include <stdint.h>
+
+#include "../control.h"
+
+// the loss to the ambient with the lid open, times the closed one
+#define LID_LOSS 10.
+// the overshoot after the lid closed is looked for over this time, s
+#define LID_WINDOW 3600.
+
+struct box
+{
+  double C;         // heat capacity, J/K
+  double G;         // loss to the ambient, W/K
+  double P;         // heater, W
+  double ambient;   // C
+  double tau_s;     // thermistor, s
+  double bias;      // calibration error, C
+  double noise;     // ADC noise, codes rms
+};
+
+struct run
+{
+  double reach;     // s to the set point within TEMP_SET_ERROR, -1 if never
+  double settle;    // s after which it stays within, -1 if it does not
+  double overshoot; // C above the set point after reaching it
+  double iae;       // integral of the absolute error, C h
+  double error;     // mean error over the last quarter, C
+  double rms;       // C
+  double switches;  // relay operations per hour
+  double sampled;   // share of the control periods measured
+  double recovery;  // s from the lid closed to within TEMP_SET_ERROR for
+                    // good, -1 if it does not
+  double lid_overshoot; // C above the set point in LID_WINDOW after the
+                        // lid closed
+  double detected;  // lid events the controller saw
+};
+
+void plant_init();
+uint64_t plant_rand(uint64_t *s);
+double plant_uniform(uint64_t *s, double lo, double hi);
+double plant_gauss(uint64_t *s);
+void plant_lid(double at, double seconds);
+void plant_draw(struct box *b, uint64_t *s);
+int plant_load(const char *path, struct box **boxes);
+void plant_run(const struct box *b, struct control *c, uint8_t trimpot,
+    double hours, uint64_t *s, struct run *r);
+
+#endif /* PLANT_H */
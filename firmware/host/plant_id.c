@@ -0,0 +1,658 @@
+/*
+ * Plant identification
+ * ====================
+ *
+ * Fits the thermal model of incubators to logs of their control loop,
+ * for the tuning of the gains and for the simulations.
+ *
+ *   ./plant_id [-T period] [-D delays] [-W watts] [-t tau_c]
+ *              [-o params.csv] [-b boxes.csv] [-c profile.h] log ...
+ *
+ * A log line is "time pwm_val temperature", or "unit time pwm_val
+ * temperature" for logs of several units, '#' starts a comment. time
+ * is in s, temperature is the converted reading of the compare match,
+ * before the filter if possible (the filter adds its own lag), and
+ * pwm_val the duty cycle computed from it, out of 256. A relay step
+ * test identifies best, normal operation works when the duty cycle
+ * moves enough. Logs of 3 columns are one unit per file, '-' is the
+ * standard input.
+ *
+ * The logs are streamed: each unit keeps the normal equations of its
+ * least squares fits, a few hundred numbers, whatever the length of
+ * the log. The lines of the units may be interleaved. A gap of more
+ * than half a period between two readings of a unit starts a new
+ * segment.
+ *
+ * Models, with u the duty cycle over the period, y the reading and d
+ * the dead time in periods, the best d from 0 to -D:
+ *
+ *   first order plus dead time
+ *     y[k] = a y[k-1] + b u[k-1-d] + c
+ *     tau = -T / ln a, K = b / (1 - a), ambient = c / (1 - a)
+ *
+ *   second order, the air and the thermistor of plant.h
+ *     y[k] = a1 y[k-1] + a2 y[k-2] + b1 u[k-1-d] + b2 u[k-2-d] + c
+ *     tau1 > tau2 from the poles, K and ambient as above. The fast
+ *     pole needs a quiet log, a step test, it is nan when the fit is
+ *     not physical
+ *
+ * K is the rise over the ambient at full duty. The 95 % intervals come
+ * from the covariance of the least squares, through the derivatives
+ * of the parameters; they assume white residuals, and are too narrow
+ * when the model misses part of the dynamics.
+ *
+ * Outputs:
+ *   -o  every parameter of every unit and their intervals, as CSV
+ *   -b  the fits as boxes of plant.h, for the -b option of fleet_sim
+ *       and pid_sweep. Only the ratios of C, G and P matter, P is -W
+ *       (default 100 W). The ADC noise is not identified
+ *   -c  a profile for config.h with the median of the gains of the
+ *       units, from the first order fits and the SIMC rules, with the
+ *       closed loop time constant -t (default the dead time)
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../pid.h"
+
+#define FO_N 3    // parameters of the models
+#define SO_N 5
+#define D_LIMIT 32
+#define NAME_LEN 32
+#define Z95 1.96
+#define BELS_ITER 50
+#define BOX_NOISE 0.5  // ADC codes rms, not identified
+
+struct normal
+{
+  double xx[SO_N][SO_N];
+  double xy[SO_N];
+  double yy;
+  long n;
+};
+
+struct unit
+{
+  char name[NAME_LEN];
+  double t_last;
+  double y_ref;               // first reading, for the conditioning
+  int n_hist;                 // previous readings of the segment
+  double y[2];                // y[k-1], y[k-2]
+  double u[D_LIMIT + 2];      // u[k-1], u[k-2], ...
+  long samples;
+  struct normal fo[D_LIMIT + 1], so[D_LIMIT + 1];
+};
+
+struct fit
+{
+  int ok;
+  int d;
+  double theta[SO_N];
+  double cov[SO_N][SO_N];
+  double rms;       // of the equation
+  double noise;     // of the readings, C rms
+  long n;
+};
+
+// Derived parameters and their 95 % half intervals
+struct params
+{
+  struct fit fo, so;
+  double tau, tau_ci, K, K_ci, ambient, ambient_ci;        // first order
+  double tau1, tau1_ci, tau2, tau2_ci, K2, K2_ci, ambient2, ambient2_ci;
+  double k_p, k_i;
+};
+
+static double period = TIME_INTERVAL;
+static int d_max = 8;
+static double watts = 100.;
+static double tau_c = -1.;
+
+static struct unit **units;
+static int n_units, cap_units;
+static struct unit **table;   // open addressing on the name
+static int cap_table;
+
+static unsigned hash(const char *s)
+{
+  unsigned h = 2166136261u;
+
+  while (*s)
+    h = (h ^ (unsigned char)*s++) * 16777619u;
+  return h;
+}
+
+static void table_grow()
+{
+  int i;
+
+  free(table);
+  cap_table = cap_table ? 2 * cap_table : 64;
+  table = calloc(cap_table, sizeof(struct unit *));
+  for (i = 0; i < n_units; i++)
+  {
+    unsigned h = hash(units[i]->name) & (cap_table - 1);
+    while (table[h] != NULL)
+      h = (h + 1) & (cap_table - 1);
+    table[h] = units[i];
+  }
+}
+
+static struct unit *unit_find(const char *name)
+{
+  unsigned h;
+  struct unit *u;
+
+  if (2 * (n_units + 1) > cap_table)
+    table_grow();
+
+  h = hash(name) & (cap_table - 1);
+  while (table[h] != NULL)
+  {
+    if (!strncmp(table[h]->name, name, NAME_LEN - 1))
+      return table[h];
+    h = (h + 1) & (cap_table - 1);
+  }
+
+  u = calloc(1, sizeof(struct unit));
+  strncpy(u->name, name, NAME_LEN - 1);
+  if (n_units == cap_units)
+  {
+    cap_units = cap_units ? 2 * cap_units : 64;
+    units = realloc(units, cap_units * sizeof(struct unit *));
+  }
+  units[n_units++] = u;
+  table[h] = u;
+  return u;
+}
+
+static void accumulate(struct normal *m, const double *x, int p, double y)
+{
+  int i, j;
+
+  for (i = 0; i < p; i++)
+  {
+    for (j = 0; j <= i; j++)
+      m->xx[i][j] += x[i] * x[j];
+    m->xy[i] += x[i] * y;
+  }
+  m->yy += y * y;
+  m->n++;
+}
+
+static void sample(struct unit *u, double t, double pwm, double y)
+{
+  double x[SO_N];
+  int d;
+
+  if (u->samples == 0)
+    u->y_ref = y;
+  y -= u->y_ref;
+
+  if (u->n_hist > 0 && fabs(t - u->t_last - period) > 0.5 * period)
+    u->n_hist = 0;
+
+  for (d = 0; d <= d_max; d++)
+  {
+    if (u->n_hist >= d + 1)
+    {
+      x[0] = u->y[0];
+      x[1] = u->u[d];
+      x[2] = 1.;
+      accumulate(&u->fo[d], x, FO_N, y);
+    }
+    if (u->n_hist >= d + 2)
+    {
+      x[0] = u->y[0];
+      x[1] = u->y[1];
+      x[2] = u->u[d];
+      x[3] = u->u[d + 1];
+      x[4] = 1.;
+      accumulate(&u->so[d], x, SO_N, y);
+    }
+  }
+
+  memmove(&u->u[1], &u->u[0], (d_max + 1) * sizeof(double));
+  u->u[0] = pwm / 256.;
+  u->y[1] = u->y[0];
+  u->y[0] = y;
+  if (u->n_hist < d_max + 2)
+    u->n_hist++;
+  u->t_last = t;
+  u->samples++;
+}
+
+// Inverse of the symmetric matrix of m, 0 when singular
+static int invert(const struct normal *m, int p, double inv[SO_N][SO_N])
+{
+  double a[SO_N][2 * SO_N], f;
+  int i, j, k, best;
+
+  for (i = 0; i < p; i++)
+    for (j = 0; j < p; j++)
+    {
+      a[i][j] = i >= j ? m->xx[i][j] : m->xx[j][i];
+      a[i][p + j] = i == j;
+    }
+
+  for (k = 0; k < p; k++)
+  {
+    best = k;
+    for (i = k + 1; i < p; i++)
+      if (fabs(a[i][k]) > fabs(a[best][k]))
+        best = i;
+    if (fabs(a[best][k]) < 1e-12 * (1. + fabs(a[k][k])))
+      return 0;
+    for (j = 0; j < 2 * p; j++)
+    {
+      f = a[k][j];
+      a[k][j] = a[best][j];
+      a[best][j] = f;
+    }
+    f = 1. / a[k][k];
+    for (j = 0; j < 2 * p; j++)
+      a[k][j] *= f;
+    for (i = 0; i < p; i++)
+      if (i != k && a[i][k] != 0.)
+      {
+        f = a[i][k];
+        for (j = 0; j < 2 * p; j++)
+          a[i][j] -= f * a[k][j];
+      }
+  }
+
+  for (i = 0; i < p; i++)
+    for (j = 0; j < p; j++)
+      inv[i][j] = a[i][p + j];
+  return 1;
+}
+
+// Sum of the squared residuals of theta
+static double residuals(const struct normal *m, int p, const double *theta)
+{
+  double ssr = m->yy, x;
+  int i, j;
+
+  for (i = 0; i < p; i++)
+  {
+    ssr -= 2. * theta[i] * m->xy[i];
+    for (j = 0; j < p; j++)
+    {
+      x = i >= j ? m->xx[i][j] : m->xx[j][i];
+      ssr += theta[i] * x * theta[j];
+    }
+  }
+  return ssr > 0. ? ssr : 0.;
+}
+
+/*
+ * Least squares of one set of normal equations, bias compensated: the
+ * noise of the readings also sits in the past readings of the
+ * regressors, and drags the poles towards 0 (the time constants too
+ * short). Its variance is found from the residuals, where at the true
+ * coefficients it is noise (1 + sum a_i^2), and taken off the diagonal
+ * of the past readings, until it settles.
+ */
+static int solve(const struct normal *m, int p, struct fit *f)
+{
+  struct normal c = *m;
+  double inv[SO_N][SO_N], theta[SO_N], ssr, s2, g, noise = 0., last = -1.;
+  int i, j, it, lags = (p - 1) / 2;
+
+  f->ok = 0;
+  if (m->n <= p + 2)
+    return 0;
+
+  for (it = 0; it < BELS_ITER && fabs(noise - last) > 1e-6 * noise; it++)
+  {
+    for (i = 0; i < lags; i++)
+      c.xx[i][i] = m->xx[i][i] - m->n * noise;
+    if (!invert(&c, p, inv))
+      break;
+
+    for (i = 0; i < p; i++)
+    {
+      theta[i] = 0.;
+      for (j = 0; j < p; j++)
+        theta[i] += inv[i][j] * m->xy[j];
+    }
+    ssr = residuals(m, p, theta);
+
+    s2 = ssr / (m->n - p);
+    memcpy(f->theta, theta, sizeof(theta));
+    for (i = 0; i < p; i++)
+      for (j = 0; j < p; j++)
+        f->cov[i][j] = s2 * inv[i][j];
+    f->rms = sqrt(ssr / m->n);
+    f->ok = 1;
+
+    for (g = 1., i = 0; i < lags; i++)
+      g += theta[i] * theta[i];
+    last = noise;
+    noise = ssr / m->n / g;
+  }
+
+  f->noise = sqrt(last > 0. ? last : 0.);
+  f->n = m->n;
+  return f->ok;
+}
+
+// The dead time of the smallest residual
+static void fit_best(const struct normal *m, int p, struct fit *best)
+{
+  struct fit f;
+  int d;
+
+  best->ok = 0;
+  for (d = 0; d <= d_max; d++)
+    if (solve(&m[d], p, &f) && (!best->ok || f.rms < best->rms))
+    {
+      *best = f;
+      best->d = d;
+    }
+}
+
+// Parameters of the models from the coefficients, NAN when not physical
+static void fo_derive(const double *th, double *out)
+{
+  double a = th[0];
+
+  out[0] = a > 0. && a < 1. ? -period / log(a) : NAN;
+  out[1] = th[1] / (1. - a);
+  out[2] = th[2] / (1. - a);
+}
+
+static void so_derive(const double *th, double *out)
+{
+  double disc = th[0] * th[0] + 4. * th[1], z1, z2, g = 1. - th[0] - th[1];
+
+  out[0] = out[1] = NAN;
+  if (disc >= 0.)
+  {
+    z1 = 0.5 * (th[0] + sqrt(disc));
+    z2 = 0.5 * (th[0] - sqrt(disc));
+    if (z1 > 0. && z1 < 1.)
+      out[0] = -period / log(z1);
+    if (z2 > 0. && z2 < 1.)
+      out[1] = -period / log(z2);
+    else if (z2 <= 0. && z2 > -1e-9)
+      out[1] = 0.;
+  }
+  out[2] = (th[2] + th[3]) / g;
+  out[3] = th[4] / g;
+}
+
+/*
+ * 95 % half intervals of the derived parameters, from the covariance of
+ * the coefficients and the derivatives by central differences.
+ */
+static void intervals(const struct fit *f, int p, int q,
+    void (*derive)(const double *, double *), double *value, double *ci)
+{
+  double th[SO_N], hi[4], lo[4], jac[4][SO_N], h, v;
+  int i, j, k;
+
+  derive(f->theta, value);
+
+  for (j = 0; j < p; j++)
+  {
+    memcpy(th, f->theta, sizeof(th));
+    h = 1e-6 * (fabs(th[j]) + 1e-3);
+    th[j] = f->theta[j] + h;
+    derive(th, hi);
+    th[j] = f->theta[j] - h;
+    derive(th, lo);
+    for (i = 0; i < q; i++)
+      jac[i][j] = (hi[i] - lo[i]) / (2. * h);
+  }
+
+  for (i = 0; i < q; i++)
+  {
+    v = 0.;
+    for (j = 0; j < p; j++)
+      for (k = 0; k < p; k++)
+        v += jac[i][j] * f->cov[j][k] * jac[i][k];
+    ci[i] = Z95 * sqrt(v);
+  }
+}
+
+static void identify(const struct unit *u, struct params *r)
+{
+  double v[4], ci[4], theta, k, tc;
+
+  memset(r, 0, sizeof(struct params));
+
+  fit_best(u->fo, FO_N, &r->fo);
+  if (r->fo.ok)
+  {
+    intervals(&r->fo, FO_N, 3, fo_derive, v, ci);
+    r->tau = v[0];
+    r->tau_ci = ci[0];
+    r->K = v[1];
+    r->K_ci = ci[1];
+    r->ambient = v[2] + u->y_ref;
+    r->ambient_ci = ci[2];
+
+    // SIMC, the hold of the duty cycle adds half a period of delay
+    theta = (r->fo.d + 0.5) * period;
+    tc = tau_c > 0. ? tau_c : theta;
+    k = r->K / 256.;
+    r->k_p = r->k_i = NAN;
+    if (!isnan(r->tau) && k > 0.)
+    {
+      r->k_p = r->tau / (k * (tc + theta));
+      r->k_i = r->k_p / fmin(r->tau, 4. * (tc + theta));
+    }
+  }
+
+  fit_best(u->so, SO_N, &r->so);
+  if (r->so.ok)
+  {
+    intervals(&r->so, SO_N, 4, so_derive, v, ci);
+    r->tau1 = v[0];
+    r->tau1_ci = ci[0];
+    r->tau2 = v[1];
+    r->tau2_ci = ci[1];
+    r->K2 = v[2];
+    r->K2_ci = ci[2];
+    r->ambient2 = v[3] + u->y_ref;
+    r->ambient2_ci = ci[3];
+  }
+}
+
+static void read_log(const char *path)
+{
+  FILE *f = strcmp(path, "-") ? fopen(path, "r") : stdin;
+  char line[256], name[NAME_LEN];
+  struct unit *u = NULL;
+  double t, pwm, y;
+  long bad = 0;
+
+  if (f == NULL)
+  {
+    fprintf(stderr, "Cannot read %s\n", path);
+    exit(1);
+  }
+
+  while (fgets(line, sizeof(line), f) != NULL)
+  {
+    if (line[0] == '#')
+      continue;
+    if (sscanf(line, "%31s %lf %lf %lf", name, &t, &pwm, &y) == 4)
+      sample(unit_find(name), t, pwm, y);
+    else if (sscanf(line, "%lf %lf %lf", &t, &pwm, &y) == 3)
+    {
+      if (u == NULL)
+        u = unit_find(path);
+      sample(u, t, pwm, y);
+    }
+    else if (line[strspn(line, " \t\r\n")] != '\0')
+      bad++;
+  }
+
+  if (bad)
+    fprintf(stderr, "%s: %ld lines skipped\n", path, bad);
+  if (f != stdin)
+    fclose(f);
+}
+
+static int compare(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static double median(double *v, int n)
+{
+  qsort(v, n, sizeof(double), compare);
+  return n % 2 ? v[n / 2] : 0.5 * (v[n / 2 - 1] + v[n / 2]);
+}
+
+int main(int argc, char **argv)
+{
+  const char *csv = NULL, *boxes = NULL, *profile = NULL;
+  struct params *r;
+  double *kp, *ki;
+  int i, n_gains = 0;
+  FILE *f;
+
+  for (i = 1; i < argc; i++)
+  {
+    if (argv[i][0] != '-' || argv[i][1] == '\0')
+      read_log(argv[i]);
+    else if (i + 1 == argc)
+      break;
+    else if (!strcmp(argv[i], "-T"))
+      period = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-D"))
+      d_max = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-W"))
+      watts = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-t"))
+      tau_c = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-o"))
+      csv = argv[++i];
+    else if (!strcmp(argv[i], "-b"))
+      boxes = argv[++i];
+    else if (!strcmp(argv[i], "-c"))
+      profile = argv[++i];
+    else
+      break;
+
+    // -T and -D apply to the logs after them
+    if (d_max < 0 || d_max > D_LIMIT)
+    {
+      fprintf(stderr, "-D from 0 to %d\n", D_LIMIT);
+      return 1;
+    }
+  }
+  if (i < argc || n_units == 0)
+  {
+    fprintf(stderr, "%s [-T period] [-D delays] [-W watts] [-t tau_c] "
+        "[-o params.csv] [-b boxes.csv] [-c profile.h] log ...\n", argv[0]);
+    return 1;
+  }
+
+  r = malloc(n_units * sizeof(struct params));
+  kp = malloc(n_units * sizeof(double));
+  ki = malloc(n_units * sizeof(double));
+
+  printf("%-16s %8s %6s %16s %14s %14s %8s %8s %8s\n", "unit", "samples",
+      "dead s", "tau s", "K C", "tau1/tau2 s", "rms C", "K_P", "K_I");
+  for (i = 0; i < n_units; i++)
+  {
+    identify(units[i], &r[i]);
+    if (!r[i].fo.ok)
+    {
+      printf("%-16s %8ld no fit, the duty cycle does not move\n",
+          units[i]->name, units[i]->samples);
+      continue;
+    }
+    printf("%-16s %8ld %6.1f %7.1f +- %5.1f %6.2f +- %4.2f %6.1f/%-6.1f %8.3f %8.2f %8.3f\n",
+        units[i]->name, units[i]->samples, r[i].fo.d * period, r[i].tau,
+        r[i].tau_ci, r[i].K, r[i].K_ci, r[i].tau1, r[i].tau2, r[i].fo.rms,
+        r[i].k_p, r[i].k_i);
+    if (!isnan(r[i].k_p))
+    {
+      kp[n_gains] = r[i].k_p;
+      ki[n_gains++] = r[i].k_i;
+    }
+  }
+
+  if (csv != NULL && (f = fopen(csv, "w")) != NULL)
+  {
+    fprintf(f, "unit,samples,fo_dead_s,fo_tau_s,fo_tau_ci,fo_K_C,fo_K_ci,"
+        "fo_ambient_C,fo_ambient_ci,fo_rms_C,so_dead_s,so_tau1_s,so_tau1_ci,"
+        "so_tau2_s,so_tau2_ci,so_K_C,so_K_ci,so_ambient_C,so_ambient_ci,"
+        "so_rms_C,K_P,K_I\n");
+    for (i = 0; i < n_units; i++)
+    {
+      if (!r[i].fo.ok)
+        continue;
+      fprintf(f, "%s,%ld,%.1f,%.2f,%.2f,%.3f,%.3f,%.2f,%.2f,%.4f,",
+          units[i]->name, units[i]->samples, r[i].fo.d * period, r[i].tau,
+          r[i].tau_ci, r[i].K, r[i].K_ci, r[i].ambient, r[i].ambient_ci,
+          r[i].fo.rms);
+      if (r[i].so.ok)
+        fprintf(f, "%.1f,%.2f,%.2f,%.2f,%.2f,%.3f,%.3f,%.2f,%.2f,%.4f,",
+            r[i].so.d * period, r[i].tau1, r[i].tau1_ci, r[i].tau2,
+            r[i].tau2_ci, r[i].K2, r[i].K2_ci, r[i].ambient2,
+            r[i].ambient2_ci, r[i].so.rms);
+      else
+        fprintf(f, ",,,,,,,,,,");
+      fprintf(f, "%.4g,%.4g\n", r[i].k_p, r[i].k_i);
+    }
+    fclose(f);
+  }
+
+  if (boxes != NULL && (f = fopen(boxes, "w")) != NULL)
+  {
+    /*
+     * The air is the slow pole and the thermistor the fast one. When
+     * the second order fit is not physical, the noise of the log hides
+     * the fast pole: the first order fit, with its dead time and the
+     * half period of the hold as the lag of the thermistor.
+     */
+    fprintf(f, "unit,C,G,P,ambient,tau_s,bias,noise\n");
+    for (i = 0; i < n_units; i++)
+    {
+      double tau, tau_s, K, ambient;
+
+      if (r[i].so.ok && !isnan(r[i].tau1) && !isnan(r[i].tau2) && r[i].K2 > 0.)
+      {
+        tau = r[i].tau1;
+        tau_s = r[i].tau2;
+        K = r[i].K2;
+        ambient = r[i].ambient2;
+      }
+      else if (r[i].fo.ok && !isnan(r[i].tau) && r[i].K > 0.)
+      {
+        tau = r[i].tau;
+        tau_s = (r[i].fo.d + 0.5) * period;
+        K = r[i].K;
+        ambient = r[i].ambient;
+      }
+      else
+        continue;
+      fprintf(f, "%s,%.1f,%.4f,%.1f,%.2f,%.2f,0,%.2f\n", units[i]->name,
+          watts / K * tau, watts / K, watts, ambient, tau_s, BOX_NOISE);
+    }
+    fclose(f);
+  }
+
+  if (profile != NULL && n_gains > 0 && (f = fopen(profile, "w")) != NULL)
+  {
+    fprintf(f, "/*\n * Identified profile: median gains of %d units, from"
+        " plant_id.\n */\n\n", n_gains);
+    fprintf(f, "#define CONFIG_CONTROLLER   CONTROLLER_PID\n");
+    fprintf(f, "#define CONFIG_K_P          %.3g\n", median(kp, n_gains));
+    fprintf(f, "#define CONFIG_K_I          %.3g\n", median(ki, n_gains));
+    fprintf(f, "#define CONFIG_K_D          0.0\n");
+    fclose(f);
+  }
+
+  return 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * Work-stealing pool, see pool.h
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "pool.h"
+
+struct deque
+{
+  pthread_mutex_t lock;
+  int *tasks;
+  int head, tail;   // tasks[head..tail-1]
+};
+
+struct pool
+{
+  struct deque *deques;
+  int n_threads;
+  void (*fn)(int task, void *arg);
+  void *arg;
+};
+
+struct worker
+{
+  struct pool *pool;
+  int self;
+};
+
+int pool_threads()
+{
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? n : 1;
+}
+
+static int take(struct pool *p, int self)
+{
+  struct deque *q;
+  int i, task = -1;
+
+  // own tasks from the back
+  q = &p->deques[self];
+  pthread_mutex_lock(&q->lock);
+  if (q->tail > q->head)
+    task = q->tasks[--q->tail];
+  pthread_mutex_unlock(&q->lock);
+  if (task >= 0)
+    return task;
+
+  // steal from the front of the others
+  for (i = 1; i < p->n_threads && task < 0; i++)
+  {
+    q = &p->deques[(self + i) % p->n_threads];
+    pthread_mutex_lock(&q->lock);
+    if (q->tail > q->head)
+      task = q->tasks[q->head++];
+    pthread_mutex_unlock(&q->lock);
+  }
+
+  return task;
+}
+
+static void *work(void *arg)
+{
+  struct worker *w = arg;
+  int task;
+
+  // no task is created while running, all empty is the end
+  while ((task = take(w->pool, w->self)) >= 0)
+    w->pool->fn(task, w->pool->arg);
+
+  return NULL;
+}
+
+void pool_run(int n_tasks, int n_threads, void (*fn)(int task, void *arg),
+    void *arg)
+{
+  struct pool p;
+  struct worker *workers;
+  pthread_t *threads;
+  int i;
+
+  if (n_threads < 1)
+    n_threads = 1;
+
+  p.n_threads = n_threads;
+  p.fn = fn;
+  p.arg = arg;
+  p.deques = calloc(n_threads, sizeof(struct deque));
+  workers = calloc(n_threads, sizeof(struct worker));
+  threads = calloc(n_threads, sizeof(pthread_t));
+
+  for (i = 0; i < n_threads; i++)
+  {
+    pthread_mutex_init(&p.deques[i].lock, NULL);
+    p.deques[i].tasks = malloc((n_tasks + 1) * sizeof(int));
+  }
+  for (i = 0; i < n_tasks; i++)
+  {
+    struct deque *q = &p.deques[(long)i * n_threads / n_tasks];
+    q->tasks[q->tail++] = i;
+  }
+
+  for (i = 0; i < n_threads; i++)
+  {
+    workers[i].pool = &p;
+    workers[i].self = i;
+    pthread_create(&threads[i], NULL, work, &workers[i]);
+  }
+  for (i = 0; i < n_threads; i++)
+    pthread_join(threads[i], NULL);
+
+  for (i = 0; i < n_threads; i++)
+  {
+    pthread_mutex_destroy(&p.deques[i].lock);
+    free(p.deques[i].tasks);
+  }
+  free(p.deques);
+  free(workers);
+  free(threads);
+}
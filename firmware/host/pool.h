@@ -0,0 +1,18 @@
+/*
+ * Work-stealing pool
+ * ==================
+ *
+ * Runs fn(task, arg) for the tasks 0 to n_tasks - 1 on n_threads
+ * threads. The tasks are dealt in contiguous blocks to one deque per
+ * thread. A thread takes its own tasks from the back of its deque and,
+ * once empty, steals from the front of the others.
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+int pool_threads();
+void pool_run(int n_tasks, int n_threads, void (*fn)(int task, void *arg),
+    void *arg);
+
+#endif /* POOL_H */
@@ -0,0 +1,165 @@
+/*
+ * Over-temperature protection simulation
+ * ======================================
+ *
+ * Runs protect_update() of protect.c against a chamber whose heater is
+ * stuck on: the chamber sits at T0 long enough to fill the rate window,
+ * then heats up linearly. The thermistor follows the air through a
+ * first order lag, its reading is quantized by the ADC with one code of
+ * noise, and it is sampled at the watchdog tick with a random phase.
+ *
+ *   ./protect_sim [-t sensor_tau] [-s tick_scale] [-l latency] [-n runs]
+ *
+ *   -t  time constant of the thermistor in s (default 0, ideal)
+ *   -s  actual over nominal watchdog period, the watchdog oscillator is
+ *       not trimmed (default 1.2)
+ *   -l  worst delay of the tick behind a control interrupt in s, plus
+ *       the release of the relay (default 0.02)
+ *   -n  runs per heating rate (default 1000)
+ *
+ * For every heating rate it prints the fault class that tripped, the
+ * worst time from the start of the runaway to the trip, the worst time
+ * after the chamber crossed CONFIG_PROTECT_TMAX (negative when the rate
+ * of rise tripped first), and the hottest chamber at the trip.
+ *
+ * It also checks that one bad reading and an hour at T0 do not trip.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <avr/eeprom.h>
+
+#include "../protect.h"
+#include "../supervisor.h"
+#include "../thermistor.h"
+#include "../trim.h"
+
+#define T0 45.0
+#define WARMUP 20.0
+
+static double tau = 0.;
+static double tick_scale = 1.2;
+static double latency = 0.02;
+
+// Fractional ADC code of a temperature, by bisection of the conversion
+static double code_of(double t)
+{
+  double lo = 0., hi = THERM_ADC_N - 1, mid;
+  int k;
+
+  for (k = 0; k < 30; k++)
+  {
+    mid = (lo + hi) / 2;
+    if (therm_convert(trim_apply((uint16_t)(mid + 0.5))) > t)
+      hi = mid;
+    else
+      lo = mid;
+  }
+  return lo;
+}
+
+static uint16_t adc_of(double t)
+{
+  double code = code_of(t) + (rand() / (RAND_MAX + 1.) - 0.5) * 2.;
+
+  if (code < 0.)
+    return 0;
+  if (code > THERM_ADC_N - 1)
+    return THERM_ADC_N - 1;
+  return (uint16_t)(code + 0.5);
+}
+
+// Thermistor temperature, the air ramps at rate from time 0
+static double sensor(double t, double rate)
+{
+  if (t <= 0.)
+    return T0;
+  if (tau <= 0.)
+    return T0 + rate * t;
+  return T0 + rate * (t - tau * (1. - exp(-t / tau)));
+}
+
+int main(int argc, char **argv)
+{
+  static const double rates[] = { 0.01, 0.02, 0.05, 0.1, 0.2, 0.5, 1., 2., 5. };
+  double tick, t, onset, after, hottest;
+  int runs = 1000;
+  int i, r, n, tripped;
+  uint8_t fault, fault_class;
+
+  for (i = 1; i + 1 < argc; i += 2)
+  {
+    if (!strcmp(argv[i], "-t"))
+      tau = atof(argv[i + 1]);
+    else if (!strcmp(argv[i], "-s"))
+      tick_scale = atof(argv[i + 1]);
+    else if (!strcmp(argv[i], "-l"))
+      latency = atof(argv[i + 1]);
+    else if (!strcmp(argv[i], "-n"))
+      runs = atoi(argv[i + 1]);
+  }
+
+  host_eeprom_erase();
+  therm_init();
+  trim_init();
+  srand(1);
+
+  tick = SUPERVISOR_TICK * tick_scale;
+
+  printf("tick %.3f s, sensor tau %.1f s, latency %.3f s, limit %.1f C, rate %.2f C/s\n",
+      tick, tau, latency, CONFIG_PROTECT_TMAX, CONFIG_PROTECT_RATE);
+  printf("  rate C/s  fault  onset s  after limit s  chamber C\n");
+
+  for (r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+  {
+    double crossing = (CONFIG_PROTECT_TMAX - T0) / rates[r];
+
+    onset = after = hottest = -1e9;
+    fault_class = PROTECT_OK;
+
+    for (n = 0; n < runs; n++)
+    {
+      protect_init(0);
+      fault = PROTECT_OK;
+
+      // random phase of the tick with respect to the runaway
+      t = -WARMUP - tick * rand() / (RAND_MAX + 1.);
+      while (fault == PROTECT_OK && t < crossing + 3600.)
+      {
+        fault = protect_update(adc_of(sensor(t, rates[r])));
+        t += tick;
+      }
+      t += latency - tick;
+
+      fault_class |= 1 << fault;
+      if (t > onset)
+        onset = t;
+      if (t - crossing > after)
+        after = t - crossing;
+      if (T0 + rates[r] * t > hottest)
+        hottest = T0 + rates[r] * t;
+    }
+
+    printf("  %8.2f  %5s  %7.2f  %13.2f  %9.2f\n", rates[r],
+        fault_class == (1 << PROTECT_OVER) ? "over" :
+        fault_class == (1 << PROTECT_RISE) ? "rise" :
+        fault_class & 1 ? "none" : "both",
+        onset, after, hottest);
+  }
+
+  // nuisance trips
+  protect_init(0);
+  tripped = 0;
+  for (i = 0; i < 3600. / tick; i++)
+  {
+    fault = protect_update(i == 100 ? THERM_ADC_N - 1 : adc_of(T0));
+    tripped |= fault != PROTECT_OK;
+  }
+  printf("one bad reading and an hour at %.1f C: %s\n", T0,
+      tripped ? "TRIPPED" : "no trip");
+
+  return tripped;
+}
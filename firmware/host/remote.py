@@ -0,0 +1,291 @@
+""" Remote configuration of IncubaLibre units
+
+Reads and sets the gains, set points and duty cycle limits of units built
+with CONFIG_REMOTE, over the half-duplex serial line of PB4 (see
+../remote.h), without reflashing.
+
+1. Read the parameters of unit 1 on one adapter, and the statistics of
+   the tasks of its main loop
+
+> python remote.py -p /dev/ttyUSB0 -u 1
+
+2. Push a configuration to units 1 to 4 of a bus, and to the units of
+   a second adapter, store it in EEPROM and read it back
+
+> python remote.py -p /dev/ttyUSB0 -p /dev/ttyUSB1 -u 1-4 -c kp=12 ki=0.05 sp1=37.7
+
+3. The same to every unit of the buses, without replies nor read back
+
+> python remote.py -p /dev/ttyUSB0 -u '*' -c kp=12
+
+4. Read the EEPROM of unit 3 into an Intel HEX file, and decode its
+   temperature history (see ../history.h) and its energy counters (see
+   ../energy.h)
+
+> python remote.py -p /dev/ttyUSB0 -u 3 -d unit3.hex
+> ./history_dump unit3.hex
+> ./history_dump -e unit3.hex
+
+The ports run in parallel, one thread each. A command without a reply
+or with a bad checksum is sent again. The new values are taken by all
+the units at once with apply (or commit), after all the sets went
+through, and a unit that rejects them keeps its previous ones.
+
+(c) 2014, Robin Scheibler/fakufaku
+This script is released in the public domain.
+"""
+
+from __future__ import division, print_function
+
+import threading
+import sys
+
+NAMES = ['kp', 'ki', 'kd', 'sp1', 'sp2', 'sp3', 'pmin', 'pmax', 'id']
+
+# ATtiny85, and REMOTE_DUMP of ../remote.h
+EEPROM_SIZE = 512
+DUMP_BYTES = 16
+
+# a tick of TIMER1, SCHED_TICK of ../sched.h
+TICK_MS = 16.384
+
+
+def crc8(data):
+    ''' The crc8 of thermistor.h, Dallas/Maxim '''
+    crc = 0
+    for c in bytearray(data.encode('ascii')):
+        crc ^= c
+        for i in range(8):
+            crc = (crc >> 1) ^ 0x8C if crc & 1 else crc >> 1
+    return crc
+
+
+class Bus(object):
+    ''' The units on one serial adapter '''
+
+    def __init__(self, port, baud, timeout, retries):
+        import serial
+        self.port = port
+        self.s = serial.Serial(port, baud, timeout=timeout)
+        self.retries = retries
+
+    def send(self, line):
+        self.s.write(('%s*%02x\n' % (line, crc8(line))).encode('ascii'))
+
+    def reply(self, sent):
+        ''' The next line with a good checksum, None on a timeout '''
+        while True:
+            line = self.s.readline().decode('ascii', 'ignore').strip()
+            if line == '':
+                return None
+            payload, _, crc = line.rpartition('*')
+            # the adapter hears itself on a half-duplex line
+            if payload == sent:
+                continue
+            if payload and len(crc) == 2 and int(crc, 16) == crc8(payload):
+                return payload.split()
+
+    def command(self, unit, line):
+        ''' Sends until the unit replies, returns the words after the id '''
+        line = '%s %s' % (unit, line)
+        for attempt in range(self.retries):
+            self.s.reset_input_buffer()
+            self.send(line)
+            if unit == '*':
+                continue
+            words = self.reply(line)
+            if words is not None and words[0] == str(unit):
+                return words[1:]
+        return None
+
+    def close(self):
+        self.s.close()
+
+
+def configure(bus, units, values, store, results):
+    ''' Sets, applies and reads back on the units of a bus '''
+    action = 'commit' if store else 'apply'
+
+    for unit in units:
+        report = []
+        ok = True
+
+        for name, value in values:
+            r = bus.command(unit, 'set %s %s' % (name, value))
+            if unit != '*' and r != ['ok']:
+                report.append('set %s %s: %s' % (name, value, 'no reply' if r is None else r[0]))
+                ok = False
+
+        if values and ok:
+            r = bus.command(unit, action)
+            if unit != '*' and r != ['ok']:
+                report.append('%s: %s' % (action, 'no reply' if r is None else 'rejected'))
+                ok = False
+
+        # read back, the id may just have changed
+        if unit != '*':
+            new_id = dict(values).get('id', unit) if ok else unit
+            for name in NAMES:
+                if name == 'id':
+                    continue
+                r = bus.command(new_id, 'get %s' % name)
+                if r is None or len(r) != 2 or r[0] != name:
+                    report.append('get %s: no reply' % name)
+                    ok = False
+                    continue
+                report.append('%s=%s' % (name, r[1]))
+                for n, v in values:
+                    if n == name and abs(float(r[1]) - float(v)) > 0.0005:
+                        report.append('(%s=%s not taken)' % (name, v))
+                        ok = False
+
+            # the tasks of the main loop (see ../sched.h), up to the
+            # first number the unit rejects
+            task = 0
+            while True:
+                r = bus.command(new_id, 'task %d' % task)
+                if r is None or len(r) != 6 or r[:2] != ['task', str(task)]:
+                    break
+                report.append('task%d=%s runs/%s late/%s skipped/%.0f ms'
+                              % (task, r[2], r[3], r[4], int(r[5]) * TICK_MS))
+                task += 1
+
+        results.append((bus.port, unit, ok, report))
+
+
+def write_hex(filename, data):
+    ''' Intel HEX, as avrdude reads and writes it '''
+    with open(filename, 'w') as f:
+        for address in range(0, len(data), DUMP_BYTES):
+            record = bytearray([DUMP_BYTES, address >> 8, address & 0xFF, 0])
+            record += data[address:address + DUMP_BYTES]
+            record.append(-sum(record) & 0xFF)
+            f.write(':' + ''.join('%02X' % b for b in record) + '\n')
+        f.write(':00000001FF\n')
+
+
+def dump(bus, unit, filename, results):
+    ''' Reads the EEPROM of a unit into an Intel HEX file '''
+    data = bytearray()
+
+    for address in range(0, EEPROM_SIZE, DUMP_BYTES):
+        r = bus.command(unit, 'dump %d' % address)
+        if r is None or len(r) != 3 or r[:2] != ['dump', str(address)] \
+                or len(r[2]) != 2 * DUMP_BYTES:
+            results.append((bus.port, unit, False, ['dump %d: no reply' % address]))
+            return
+        data += bytearray.fromhex(r[2])
+
+    write_hex(filename, data)
+    results.append((bus.port, unit, True, ['EEPROM in %s' % filename]))
+
+
+def parse_units(text):
+    ''' "1,3,5-8" or "*" '''
+    if text == '*':
+        return ['*']
+    units = []
+    for part in text.split(','):
+        if '-' in part:
+            a, b = part.split('-')
+            units.extend(range(int(a), int(b) + 1))
+        else:
+            units.append(int(part))
+    return units
+
+
+def print_help():
+    print(sys.argv[0] + ' -p port [-p port ...] [-u units] [-c] [-d file.hex] [name=value ...]')
+    print('Reads the parameters of IncubaLibre units built with CONFIG_REMOTE,')
+    print('or sets them and reads them back.')
+    print('')
+    print('Options:')
+    print('   -p  a serial port, can be repeated, the ports run in parallel')
+    print('   -u  the ids of the units on each port, as 1,3,5-8, or * for')
+    print('       all of them without replies (default 1)')
+    print('   -c  store the values in EEPROM, instead of until the next reset')
+    print('   -d  read the EEPROM of one unit into an Intel HEX file instead')
+    print('   -s  the baud rate (default 4800, CONFIG_REMOTE_BAUD)')
+    print('   -t  the timeout of a reply in seconds (default 0.5)')
+    print('   -r  the attempts per command (default 4)')
+    print('   -h  display this help')
+    print('')
+    print('Names: ' + ' '.join(NAMES))
+
+
+def main():
+    # default values
+    ports = []
+    units = [1]
+    store = False
+    baud = 4800
+    timeout = 0.5
+    retries = 4
+    values = []
+    dump_file = None
+
+    # parse arguments
+    i = 1
+    while i < len(sys.argv):
+        if sys.argv[i] == '-p':
+            ports.append(sys.argv[i + 1])
+            i += 2
+        elif sys.argv[i] == '-u':
+            units = parse_units(sys.argv[i + 1])
+            i += 2
+        elif sys.argv[i] == '-c':
+            store = True
+            i += 1
+        elif sys.argv[i] == '-d':
+            dump_file = sys.argv[i + 1]
+            i += 2
+        elif sys.argv[i] == '-s':
+            baud = int(sys.argv[i + 1])
+            i += 2
+        elif sys.argv[i] == '-t':
+            timeout = float(sys.argv[i + 1])
+            i += 2
+        elif sys.argv[i] == '-r':
+            retries = int(sys.argv[i + 1])
+            i += 2
+        elif '=' in sys.argv[i] and sys.argv[i].split('=')[0] in NAMES:
+            name, value = sys.argv[i].split('=', 1)
+            float(value)
+            values.append((name, value))
+            i += 1
+        else:
+            print_help()
+            sys.exit(1)
+
+    if not ports or (units == ['*'] and not values):
+        print_help()
+        sys.exit(1)
+    if dump_file is not None and (len(ports) != 1 or len(units) != 1
+                                  or units == ['*'] or values):
+        print_help()
+        sys.exit(1)
+
+    buses = [Bus(p, baud, timeout, retries) for p in ports]
+    results = []
+    if dump_file is not None:
+        threads = [threading.Thread(target=dump, args=(buses[0], units[0], dump_file, results))]
+    else:
+        threads = [threading.Thread(target=configure, args=(b, units, values, store, results))
+                   for b in buses]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    for b in buses:
+        b.close()
+
+    failed = 0
+    for port, unit, ok, report in sorted(results, key=lambda r: (r[0], str(r[1]))):
+        print('%s unit %s: %s %s' % (port, unit, 'ok' if ok else 'FAILED', ' '.join(report)))
+        failed += not ok
+
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,307 @@
+/*
+ * Trace replay
+ * ============
+ *
+ * Replays raw ADC readings recorded on a unit through the interrupts of
+ * incubalibre.c itself, built for the host with the register shims of
+ * avr/ and io.c, and checks the duty cycles against a golden output.
+ *
+ *   ./replay [-p trimpot] [-e unit.eep] [-w after.eep] [-o output]
+ *            [-g golden] trace
+ *
+ * A trace line is "thermistor trimpot", the two 10-bit conversions of
+ * a control period, or "thermistor" alone with the trimpot at -p
+ * (default 256, the first set point, or 33.2 C on the dial of dial.h).
+ * '#' starts a comment, '-' is the standard input. -e loads the EEPROM
+ * of the unit, its calibration record and field trim. -w saves it
+ * after the replay, with the history of history.h and the counters of
+ * energy.h for host/history_dump.
+ *
+ * The firmware starts cold with main_init() of incubalibre.c, what
+ * main() runs before the infinite loop, and the tasks are released at
+ * the first overflow.
+ *
+ * Each period runs as on the ATtiny85: the overflow interrupt, the
+ * compare match at OCR1A, the watchdog ticks and the compare matches B
+ * of the tasks that fall in the period, each followed by the stages of
+ * the main loop, reading the thermistor of the period. The firmware options
+ * are the ones of config.h, DEFS of the Makefile changes them.
+ *
+ * An output line is "pwm_val relay" for each period: the duty cycle
+ * computed at the compare match, and the duty cycle out of 256 the
+ * relay had over the period. With -g, the output is compared to a
+ * golden one, line by line; the first differences are printed, and
+ * the exit status is 1 when there is any. The statistics of the tasks
+ * of sched.h and the energy counters follow the summary.
+ *
+ * The replay is bit exact with any other host build of the firmware.
+ * The float library of avr-libc may round differently in the last bit.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <avr/io.h>
+#include <avr/eeprom.h>
+
+#include "../config.h"
+#include "../thermistor.h"
+#include "../trim.h"
+#include "../lowpower.h"
+#include "../supervisor.h"
+#include "../protect.h"
+#include "../sensor.h"
+#include "../control.h"
+#include "../dial.h"
+#include "../params.h"
+#include "../remote.h"
+#include "../history.h"
+#include "../energy.h"
+#include "../sched.h"
+
+#define THERMISTOR_CHANNEL 3
+#define TRIMPOT_CHANNEL 1
+#define SHOW_DIFFS 10
+
+// the globals and interrupts of incubalibre.c
+extern struct control control;
+#if CONFIG_HISTORY
+extern struct history history;
+#endif
+#if CONFIG_SENSOR_CHECK
+extern struct sensor sensor;
+#endif
+#if CONFIG_SETPOINT_DIAL
+extern struct dial dial;
+#endif
+void TIMER1_OVF_vect(void);
+void TIMER1_COMPA_vect(void);
+void TIMER1_COMPB_vect(void);
+#if CONFIG_WATCHDOG
+void WDT_vect(void);
+#endif
+void main_init(void);
+void main_stages(void);
+
+static double t_now = 0.;
+static long resets = 0;
+#if CONFIG_WATCHDOG
+static double t_wdt = 0.;
+#endif
+
+// The time, and TIMER1 in the period from t0
+static void set_time(double t0, double t)
+{
+  // a compare match falls on its count, in spite of the rounding of
+  // the single precision constants
+  int count = (t - t0) / SCHED_TICK + 0.001;
+
+  t_now = t;
+  TCNT1 = count > 0xFF ? 0xFF : count;
+}
+
+// The watchdog ticks and the compare matches B up to the time until,
+// in the period from t0, each followed by the main loop
+static void interrupts_until(double t0, double until)
+{
+  double t_b;
+
+  while (1)
+  {
+    t_b = TIMSK & (1 << OCIE1B) ? t0 + OCR1B * SCHED_TICK : until;
+    if (t_b <= t_now)
+      t_b = until;
+
+#if CONFIG_WATCHDOG
+    if (t_wdt < until && t_wdt <= t_b)
+    {
+      set_time(t0, t_wdt);
+      t_wdt += SUPERVISOR_TICK;
+
+      // a tick with the interrupt disarmed resets the board
+      if (!(WDTCR & (1 << WDIE)))
+        resets++;
+      WDT_vect();
+      main_stages();
+      continue;
+    }
+#endif
+
+    if (t_b >= until)
+      break;
+    set_time(t0, t_b);
+    TIMER1_COMPB_vect();
+    main_stages();
+  }
+
+  set_time(t0, until);
+}
+
+// Duty cycle of the relay over the period, as set at the overflow
+static uint16_t relay_duty()
+{
+  if (TCCR1 & (1 << PWM1A))
+    return OCR1A;
+  return PORTB & (1 << PB1) ? 0 : 256;
+}
+
+int main(int argc, char **argv)
+{
+  const char *trace = NULL, *out = NULL, *golden = NULL, *eep_out = NULL;
+  FILE *ft, *fo = NULL, *fg = NULL;
+  char line[128], gline[128];
+  unsigned therm, pot, pot_default = 256;
+  long period = 0, diffs = 0, bad = 0;
+  double t, wall;
+  struct timespec start, stop;
+  uint16_t duty;
+  int i, n, usage = 0;
+
+  host_eeprom_erase();
+
+  for (i = 1; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "-p") && i + 1 < argc)
+      pot_default = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-e") && i + 1 < argc)
+    {
+      if (host_eeprom_load_hex(argv[++i]) != 0)
+      {
+        fprintf(stderr, "Cannot read %s\n", argv[i]);
+        return 2;
+      }
+    }
+    else if (!strcmp(argv[i], "-w") && i + 1 < argc)
+      eep_out = argv[++i];
+    else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+      out = argv[++i];
+    else if (!strcmp(argv[i], "-g") && i + 1 < argc)
+      golden = argv[++i];
+    else if (trace == NULL && (argv[i][0] != '-' || argv[i][1] == '\0'))
+      trace = argv[i];
+    else
+      usage = 1;
+  }
+  if (trace == NULL || usage)
+  {
+    fprintf(stderr, "%s [-p trimpot] [-e unit.eep] [-w after.eep] [-o output] [-g golden] trace\n", argv[0]);
+    return 2;
+  }
+
+  ft = strcmp(trace, "-") ? fopen(trace, "r") : stdin;
+  if (ft == NULL
+      || (out != NULL && (fo = fopen(out, "w")) == NULL)
+      || (golden != NULL && (fg = fopen(golden, "r")) == NULL))
+  {
+    fprintf(stderr, "Cannot open the trace, the output or the golden output\n");
+    return 2;
+  }
+
+  // a cold start of main() of incubalibre.c, up to the infinite loop,
+  // with the trimpot at -p
+  MCUSR = 1 << PORF;
+  host_adc_input[TRIMPOT_CHANNEL] = pot_default;
+  main_init();
+
+  if (fo != NULL)
+    fprintf(fo, "# pwm_val relay, replay of %s\n", trace);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  while (fgets(line, sizeof(line), ft) != NULL)
+  {
+    if (line[0] == '#')
+      continue;
+    n = sscanf(line, "%u %u", &therm, &pot);
+    if (n < 1)
+    {
+      if (line[strspn(line, " \t\r\n")] != '\0')
+        bad++;
+      continue;
+    }
+    host_adc_input[THERMISTOR_CHANNEL] = therm;
+    host_adc_input[TRIMPOT_CHANNEL] = n == 2 ? pot : pot_default;
+
+    // the period, from the overflow
+    t = period * TIME_INTERVAL;
+    set_time(t, t);
+    TIMER1_OVF_vect();
+
+    // the replay starts at an overflow, the tasks from it
+    if (period == 0)
+      sched_start(tasks, tasks_n);
+    main_stages();
+    duty = relay_duty();
+
+    // the compare match, with the other interrupts before and after it
+    interrupts_until(t, t + TIME_INTERVAL * OCR1A / 256.);
+    TIMER1_COMPA_vect();
+    main_stages();
+    interrupts_until(t, t + TIME_INTERVAL);
+
+    sprintf(line, "%u %u\n", control.pwm_val, duty);
+    if (fo != NULL)
+      fputs(line, fo);
+
+    if (fg != NULL)
+    {
+      do
+        n = fgets(gline, sizeof(gline), fg) != NULL;
+      while (n && gline[0] == '#');
+
+      if (!n || strcmp(line, gline))
+      {
+        if (diffs++ < SHOW_DIFFS)
+          printf("period %ld at %.0f s: replay %s%*s golden %s", period, t,
+              line, 17, "", n ? gline : "ended\n");
+      }
+    }
+
+    period++;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &stop);
+  wall = (stop.tv_sec - start.tv_sec) + 1e-9 * (stop.tv_nsec - start.tv_nsec);
+
+  if (fg != NULL)
+  {
+    do
+      n = fgets(gline, sizeof(gline), fg) != NULL;
+    while (n && gline[0] == '#');
+    if (n)
+    {
+      printf("the golden output is longer than the trace\n");
+      diffs++;
+    }
+  }
+
+  if (eep_out != NULL && host_eeprom_save_hex(eep_out) != 0)
+  {
+    fprintf(stderr, "Cannot write %s\n", eep_out);
+    return 2;
+  }
+
+  printf("%ld periods, %.1f days in %.2f s", period,
+      period * TIME_INTERVAL / 86400., wall);
+  if (bad)
+    printf(", %ld lines skipped", bad);
+  if (resets)
+    printf(", %ld watchdog resets", resets);
+  if (fg != NULL)
+    printf(", %ld differences with %s", diffs, golden);
+  printf("\n");
+
+  for (i = 0; i < tasks_n; i++)
+    printf("task %d: %u runs, %u late, %u skipped, %.0f ms at most\n", i,
+        tasks[i].runs, tasks[i].late, tasks[i].skipped,
+        tasks[i].response_max * SCHED_TICK * 1000.);
+
+#if CONFIG_ENERGY
+  printf("heater on %.2f h at set point 1, %.3f kWh at %.0f W, %lu closings\n",
+      energy.count.heater[0] * ENERGY_UNIT / 3600.,
+      ENERGY_WH(energy.count.heater[0]) / 1000., CONFIG_HEATER_WATTS,
+      (unsigned long)energy.count.switches);
+#endif
+
+  return diffs ? 1 : 0;
+}
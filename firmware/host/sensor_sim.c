@@ -0,0 +1,169 @@
+/*
+ * Sensor health simulation
+ * ========================
+ *
+ * Runs sensor_check() of sensor.c in a simulated chamber controlled on
+ * and off around the set point, one reading per control period, and
+ * injects each thermistor fault after an hour of normal operation.
+ *
+ *   ./sensor_sim
+ *
+ * For every fault it prints the class detected, the number of readings
+ * between the injection and the heater off (0 is the faulty reading
+ * itself), whether the fault still holds the heater off at the end,
+ * and the hottest chamber after the injection.
+ *
+ * The weak box has no fault, but a heater that cannot reach the set
+ * point, and a quiet ADC: it sits at full power on a steady reading,
+ * which must not be taken for a stuck thermistor for good.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <avr/eeprom.h>
+
+#include "../sensor.h"
+#include "../thermistor.h"
+#include "../trim.h"
+
+#define PERIOD 4.194304
+#define SET_POINT 37.5
+#define AMBIENT 25.0
+#define HEATER 30.0     // C above ambient at full power
+#define WEAK_HEATER 10.0
+#define TAU 600.0       // s
+#define INJECT 860      // about an hour of periods
+#define RUN 1200
+
+enum { NONE, OPEN, SHORT, GLITCH, DRIFT, FROZEN, WEAK, N_SCENARIOS };
+
+static const char *names[N_SCENARIOS] =
+  { "none", "open", "short", "glitch", "drift", "frozen", "weak" };
+
+static const char *classes[] = { "ok", "open", "short", "jump", "stuck" };
+
+static uint16_t adc_of(double t, double noise)
+{
+  uint16_t lo = 0, hi = THERM_ADC_N - 1, mid;
+  double code;
+
+  while (hi - lo > 1)
+  {
+    mid = (lo + hi) / 2;
+    if (therm_convert(trim_apply(mid)) > t)
+      hi = mid;
+    else
+      lo = mid;
+  }
+
+  // up to noise codes
+  code = lo + (rand() / (RAND_MAX + 1.) - 0.5) * 2. * noise;
+  return code < 0. ? 0 : (uint16_t)(code + 0.5);
+}
+
+static void run(int scenario)
+{
+  double T = SET_POINT;
+  double heater = scenario == WEAK ? WEAK_HEATER : HEATER;
+  double noise = scenario == WEAK ? 0. : 1.;
+  uint16_t adc, frozen = 0;
+  uint8_t heating = 0, full = 0, fault, detected = SENSOR_OK;
+  int k, safe = -1, held = 0;
+  double hottest = T;
+  struct sensor sensor;
+  float t;
+
+  sensor_init(&sensor);
+  srand(scenario + 1);
+
+  for (k = 0; k < RUN; k++)
+  {
+    adc = adc_of(T, noise);
+    if (k == INJECT - 1)
+      frozen = adc;
+
+    if (k >= INJECT)
+    {
+      switch (scenario)
+      {
+        case OPEN:
+          adc = 0;
+          break;
+        case SHORT:
+          adc = THERM_ADC_N - 1;
+          break;
+        case GLITCH:
+          if (k == INJECT)
+            adc = 0;
+          break;
+        case DRIFT:
+          adc = adc_of(T - 8., noise);
+          break;
+        case FROZEN:
+          adc = frozen;
+          break;
+      }
+    }
+
+    t = therm_convert(trim_apply(adc));
+    fault = sensor_check(&sensor, adc, t, full);
+
+    // on and off control, the heater is off on a faulty reading
+    heating = fault == SENSOR_OK ? t < SET_POINT : 0;
+    full = heating;
+
+    if (scenario == WEAK)
+      held += fault != SENSOR_OK;
+    else if (k >= INJECT)
+    {
+      if (detected == SENSOR_OK)
+        detected = fault;
+      if (safe < 0 && !heating && fault != SENSOR_OK)
+        safe = k - INJECT;
+      if (T > hottest)
+        hottest = T;
+    }
+    else if (fault != SENSOR_OK)
+    {
+      printf("  %-7s false %s fault at reading %d\n", names[scenario],
+          classes[fault], k);
+      return;
+    }
+
+    T += (AMBIENT + (heating ? heater : 0.) - T) * (1. - exp(-PERIOD / TAU));
+  }
+
+  if (scenario == WEAK)
+  {
+    printf("  %-7s heater held off %d of %d readings, %s at the end, %.2f C\n",
+        names[scenario], held, RUN,
+        sensor_fault(&sensor) != SENSOR_OK ? "off" : "on", T);
+    return;
+  }
+
+  if (scenario == NONE)
+  {
+    printf("  %-7s no fault in %d readings\n", names[scenario], RUN);
+    return;
+  }
+
+  printf("  %-7s %-6s %9d  %-7s %6.2f\n", names[scenario], classes[detected],
+      safe, sensor_fault(&sensor) != SENSOR_OK ? "yes" : "no", hottest);
+}
+
+int main()
+{
+  int s;
+
+  host_eeprom_erase();
+  therm_init();
+  trim_init();
+
+  printf("  fault   class  readings  held     hottest C\n");
+  for (s = 0; s < N_SCENARIOS; s++)
+    run(s);
+
+  return 0;
+}
@@ -0,0 +1,102 @@
+/*
+ * Thermistor conversion bench
+ * ===========================
+ *
+ * Compares the conversion compiled in thermistor.c (look-up table or
+ * fixed-point Steinhart-Hart, see THERM in the Makefile) against the
+ * Steinhart-Hart equation evaluated in double precision, for every ADC
+ * code.
+ *
+ *   ./therm_bench_lut [calibration.hex]
+ *   ./therm_bench_sh  [calibration.hex]
+ *
+ * Without a calibration record the reference is the fit of
+ * ThermistorCalibration/data.txt, the one the firmware table comes from.
+ *
+ * Flash usage is given by 'make size' and cycle counts by the
+ * therm_cycles firmware, both in the firmware directory.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <avr/eeprom.h>
+
+#include "../thermistor.h"
+#include "../eeprom_map.h"
+
+#define ZERO_CELSIUS 273.15
+
+static void stats(const char *name, double t_lo, double t_hi,
+    const double *ref, const double *err)
+{
+  double max = 0., sum = 0.;
+  int i, n = 0;
+
+  for (i = 0; i < THERM_ADC_N; i++)
+  {
+    if (ref[i] < t_lo || ref[i] > t_hi)
+      continue;
+    if (fabs(err[i]) > max)
+      max = fabs(err[i]);
+    sum += err[i] * err[i];
+    n++;
+  }
+
+  printf("  %-12s %4d codes  max %.4f C  rms %.4f C\n",
+      name, n, max, sqrt(sum / n));
+}
+
+int main(int argc, char **argv)
+{
+  struct therm_cal cal;
+  double a = 1.30598061e-03, b = 2.62708333e-04, c = -9.97425762e-09;
+  double R2 = 1500.;
+  double ref[THERM_ADC_N], err[THERM_ADC_N];
+  volatile float sink;
+  clock_t start;
+  int i, k, reps = 2000;
+
+  host_eeprom_erase();
+  if (argc > 1 && host_eeprom_load_hex(argv[1]) != 0)
+  {
+    fprintf(stderr, "Cannot read %s\n", argv[1]);
+    return 1;
+  }
+  therm_init();
+
+  eeprom_read_block(&cal, (const void *)EE_THERM_CAL, sizeof(cal));
+  if (therm_cal_kind() == THERM_CAL_SH)
+  {
+    a = cal.a;
+    b = cal.b;
+    c = cal.c;
+    R2 = cal.R2;
+  }
+
+  for (i = 0; i < THERM_ADC_N; i++)
+  {
+    double alpha = i + 0.5;
+    double lnR = log(R2 * (THERM_ADC_N - alpha) / alpha);
+
+    ref[i] = 1. / (a + b * lnR + c * lnR * lnR * lnR) - ZERO_CELSIUS;
+    if (therm_cal_kind() == THERM_CAL_DELTA)
+      ref[i] += cal.delta * 0.01;
+    err[i] = therm_convert(i) - ref[i];
+  }
+
+  start = clock();
+  for (k = 0; k < reps; k++)
+    for (i = 0; i < THERM_ADC_N; i++)
+      sink = therm_convert(i);
+  (void)sink;
+
+  printf("%s, calibration record %d\n", THERM_NAME, therm_cal_kind());
+  stats("30 to 45 C", 30., 45., ref, err);
+  stats("0 to 100 C", 0., 100., ref, err);
+  printf("  host time    %.1f ns/conversion\n",
+      1e9 * (clock() - start) / CLOCKS_PER_SEC / reps / THERM_ADC_N);
+
+  return 0;
+}
@@ -0,0 +1,404 @@
+/*
+ * I2C poller
+ * ==========
+ *
+ * Supervises units built with CONFIG_TWI on one I2C bus (see twi.h):
+ * finds them, sets their parameters, and polls their registers.
+ *
+ *   ./twi_poll [-n units | -d /dev/i2c-N] [-a first-last] [-r rounds]
+ *              [-f scl_hz] [-s seed] [-g] [-c] [-v] [-e] [name=value ...]
+ *
+ * -n runs the units on the simulated bus of twi_sim.h, -d on a Linux
+ * I2C adapter. The addresses first to last (hexadecimal, default
+ * CONFIG_TWI_BASE + 1 to 0x77) are probed for the magic of the map.
+ *
+ * Each name=value (kp, ki, kd, sp1, sp2, sp3, pmin, pmax, id, run) is
+ * written to every unit found, or to all of them at once by a general
+ * call with -g, followed by TWI_APPLY, or TWI_COMMIT with -c. After the
+ * next control period, the result of each unit is read back.
+ *
+ * Then the status registers of every unit are read -r times (default
+ * 10), one round after the other, and the last ones printed. -v prints
+ * every round. On the simulated bus, every read is also checked
+ * against the registers of the unit.
+ *
+ * -e then reads the energy counters of every unit (see energy.h): the
+ * hours the heater was on at each set point, the energy at the power
+ * of the heater the unit was built with, and the closings of the relay.
+ *
+ * It prints the reads per second over the time of the bus; on the
+ * simulated bus, the time is the one the bits and the interrupts of
+ * the units take (see twi_sim.h), not the time of the simulation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#endif
+
+#include "twi_sim.h"
+
+#define MAX_UNITS 128
+#define FIRST_ADDRESS (CONFIG_TWI_BASE + 1)
+#define LAST_ADDRESS 0x77
+
+// the bus, simulated or not
+static int (*transfer)(uint8_t address, const uint8_t *w, int nw,
+    uint8_t *r, int nr);
+static void (*wait)(double seconds);
+static double (*bus_time)();
+
+#ifdef __linux__
+static int fd;
+
+static int dev_transfer(uint8_t address, const uint8_t *w, int nw,
+    uint8_t *r, int nr)
+{
+  struct i2c_msg m[2];
+  struct i2c_rdwr_ioctl_data d = { m, 0 };
+
+  if (nw > 0)
+  {
+    m[d.nmsgs].addr = address;
+    m[d.nmsgs].flags = 0;
+    m[d.nmsgs].len = nw;
+    m[d.nmsgs].buf = (uint8_t *)w;
+    d.nmsgs++;
+  }
+  if (nr > 0)
+  {
+    m[d.nmsgs].addr = address;
+    m[d.nmsgs].flags = I2C_M_RD;
+    m[d.nmsgs].len = nr;
+    m[d.nmsgs].buf = r;
+    d.nmsgs++;
+  }
+
+  return ioctl(fd, I2C_RDWR, &d) < 0 ? -1 : 0;
+}
+
+static void dev_wait(double seconds)
+{
+  usleep(seconds * 1e6);
+}
+#endif
+
+static double wall_time()
+{
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+// the registers name=value can set
+struct field
+{
+  const char *name;
+  size_t offset;
+  int is_float;
+};
+
+static const struct field fields[] =
+{
+  { "kp",   offsetof(struct twi_regs, k_p), 1 },
+  { "ki",   offsetof(struct twi_regs, k_i), 1 },
+  { "kd",   offsetof(struct twi_regs, k_d), 1 },
+  { "sp1",  offsetof(struct twi_regs, setpoints[0]), 1 },
+  { "sp2",  offsetof(struct twi_regs, setpoints[1]), 1 },
+  { "sp3",  offsetof(struct twi_regs, setpoints[2]), 1 },
+  { "pmin", offsetof(struct twi_regs, pwm_min), 0 },
+  { "pmax", offsetof(struct twi_regs, pwm_max), 0 },
+  { "id",   offsetof(struct twi_regs, id), 0 },
+  { "run",  offsetof(struct twi_regs, run), 0 },
+};
+
+#define N_FIELDS (sizeof(fields) / sizeof(fields[0]))
+
+static const struct field command_field =
+{
+  "command", offsetof(struct twi_regs, command), 0
+};
+
+struct setting
+{
+  const struct field *field;
+  double value;
+};
+
+// Writes a register of the map, 0 on success
+static int write_register(uint8_t address, const struct field *f, double value)
+{
+  uint8_t buf[1 + sizeof(float)];
+  float x = value;
+  int n;
+
+  buf[0] = f->offset;
+  if (f->is_float)
+  {
+    memcpy(&buf[1], &x, sizeof(x));
+    n = 1 + sizeof(x);
+  }
+  else
+  {
+    buf[1] = (uint8_t)value;
+    n = 2;
+  }
+
+  return transfer(address, buf, n, NULL, 0);
+}
+
+// Reads n registers from offset, 0 on success
+static int read_registers(uint8_t address, uint8_t offset, void *regs, int n)
+{
+  return transfer(address, &offset, 1, (uint8_t *)regs + offset, n);
+}
+
+// Reads the status of the last control period, 0 when it is one
+static int read_status(uint8_t address, struct twi_regs *regs)
+{
+  if (read_registers(address, 0, regs, sizeof(struct twi_status)) != 0)
+    return -1;
+  return regs->status.magic == TWI_MAGIC ? 0 : -1;
+}
+
+/*
+ * The status read on the simulated bus is the copy the unit made when
+ * addressed, of its last control period or of the one before when a
+ * period ran during the read.
+ */
+static int check(uint8_t address, const struct twi_regs *regs)
+{
+  struct twi_sim_unit *u = twi_sim_find(address);
+
+  if (u == NULL || memcmp(&regs->status, &u->twi.regs.status,
+        offsetof(struct twi_status, reserved)))
+    return -1;
+  return (uint8_t)(u->twi.status.sequence - regs->status.sequence) <= 1
+    ? 0 : -1;
+}
+
+static void print_status(uint8_t address, const struct twi_regs *regs)
+{
+  const struct twi_status *s = &regs->status;
+
+  printf("  0x%02x %4u %-4s %02x %7.2f %7.2f %4u %8.2f\n", address,
+      s->sequence, s->state == PWM_ON ? "on" : "off", s->faults,
+      s->temperature, s->set_point, s->pwm_val, s->iterm);
+}
+
+// Reads and prints the energy counters, 0 on success
+static int print_energy(uint8_t address)
+{
+  struct twi_regs regs;
+  const struct energy_record *e = &regs.energy;
+  double hours = 3600. / ENERGY_UNIT, wh;
+  int i;
+
+  if (read_registers(address, offsetof(struct twi_regs, energy), &regs,
+        TWI_SIZE - offsetof(struct twi_regs, energy)) != 0)
+    return -1;
+
+  wh = regs.watts * ENERGY_UNIT / 3600.;
+  printf("  0x%02x", address);
+  for (i = 0; i < 3; i++)
+    printf(" %8.2f", e->heater[i] / hours);
+  printf(" %8.3f %4u %10lu\n",
+      (e->heater[0] + e->heater[1] + e->heater[2]) * wh / 1000., regs.watts,
+      (unsigned long)e->switches);
+  return 0;
+}
+
+static void print_help(const char *name)
+{
+  fprintf(stderr, "%s [-n units | -d /dev/i2c-N] [-a first-last] [-r rounds]\n"
+      "    [-f scl_hz] [-s seed] [-g] [-c] [-v] [-e] [name=value ...]\n"
+      "names: kp ki kd sp1 sp2 sp3 pmin pmax id run\n", name);
+}
+
+int main(int argc, char **argv)
+{
+  struct setting settings[N_FIELDS];
+  struct twi_regs regs;
+  uint8_t found[MAX_UNITS];
+  unsigned first = FIRST_ADDRESS, last = LAST_ADDRESS;
+  const char *device = NULL;
+  char *eq;
+  int sim_units = 0, rounds = 10, general = 0, verbose = 0, energy = 0;
+  int n_found = 0, n_settings = 0, command = TWI_APPLY, params = 0, id = 0;
+  long reads = 0, failed = 0, mismatches = 0;
+  double scl = 100000., t0, wall0;
+  uint64_t seed = 1;
+  unsigned a, i, j;
+  int r;
+
+  for (i = 1; i < (unsigned)argc; i++)
+  {
+    if (!strcmp(argv[i], "-n") && i + 1 < (unsigned)argc)
+      sim_units = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-d") && i + 1 < (unsigned)argc)
+      device = argv[++i];
+    else if (!strcmp(argv[i], "-a") && i + 1 < (unsigned)argc
+        && sscanf(argv[++i], "%x-%x", &first, &last) == 2)
+      ;
+    else if (!strcmp(argv[i], "-r") && i + 1 < (unsigned)argc)
+      rounds = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-f") && i + 1 < (unsigned)argc)
+      scl = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-s") && i + 1 < (unsigned)argc)
+      seed = strtoull(argv[++i], NULL, 0);
+    else if (!strcmp(argv[i], "-g"))
+      general = 1;
+    else if (!strcmp(argv[i], "-c"))
+      command = TWI_COMMIT;
+    else if (!strcmp(argv[i], "-v"))
+      verbose = 1;
+    else if (!strcmp(argv[i], "-e"))
+      energy = 1;
+    else if ((eq = strchr(argv[i], '=')) != NULL)
+    {
+      *eq = '\0';
+      for (j = 0; j < N_FIELDS && strcmp(argv[i], fields[j].name); j++)
+        ;
+      if (j == N_FIELDS || n_settings == N_FIELDS)
+      {
+        print_help(argv[0]);
+        return 2;
+      }
+      settings[n_settings].field = &fields[j];
+      settings[n_settings].value = atof(eq + 1);
+      params += strcmp(fields[j].name, "run") != 0;
+      id |= !strcmp(fields[j].name, "id");
+      n_settings++;
+    }
+    else
+    {
+      print_help(argv[0]);
+      return 2;
+    }
+  }
+
+  if (sim_units > 0 && device == NULL)
+  {
+    twi_sim_init(sim_units, scl, seed);
+    transfer = twi_sim_transfer;
+    wait = twi_sim_wait;
+    bus_time = twi_sim_time;
+  }
+#ifdef __linux__
+  else if (device != NULL && sim_units == 0)
+  {
+    if ((fd = open(device, O_RDWR)) < 0)
+    {
+      fprintf(stderr, "Cannot open %s\n", device);
+      return 2;
+    }
+    transfer = dev_transfer;
+    wait = dev_wait;
+    bus_time = wall_time;
+  }
+#endif
+  else
+  {
+    print_help(argv[0]);
+    return 2;
+  }
+
+  // the units on the bus
+  for (a = first; a <= last && n_found < MAX_UNITS; a++)
+    if (read_status(a, &regs) == 0)
+      found[n_found++] = a;
+  printf("%d units between 0x%02x and 0x%02x\n", n_found, first, last);
+
+  if (id && (general || n_found > 1))
+  {
+    fprintf(stderr, "The units would share the id\n");
+    return 2;
+  }
+
+  // the settings, then the command for the parameters
+  if (n_settings > 0)
+  {
+    for (i = 0; i < (general ? 1 : (unsigned)n_found); i++)
+    {
+      a = general ? 0 : found[i];
+      r = 0;
+      for (j = 0; j < (unsigned)n_settings; j++)
+        r |= write_register(a, settings[j].field, settings[j].value);
+      if (params > 0)
+        r |= write_register(a, &command_field, command);
+      if (r != 0)
+        printf("  0x%02x did not take the settings\n", a);
+    }
+
+    // taken at the next control period, the unit moves with a new id
+    wait(TIME_INTERVAL * 1.1);
+    if (id)
+    {
+      first = FIRST_ADDRESS;
+      last = LAST_ADDRESS;
+    }
+    n_found = 0;
+    for (a = first; a <= last && n_found < MAX_UNITS; a++)
+      if (read_status(a, &regs) == 0)
+      {
+        found[n_found++] = a;
+        if (params > 0)
+          printf("  0x%02x %s\n", a, regs.status.result == TWI_OK
+              ? "ok" : "rejected the parameters");
+      }
+  }
+
+  // the polling rounds
+  t0 = bus_time();
+  wall0 = wall_time();
+  for (r = 0; r < rounds; r++)
+  {
+    if (verbose || r == rounds - 1)
+      printf("round %d\n  addr  seq stat fl    temp     set  pwm    iterm\n", r);
+
+    for (i = 0; i < (unsigned)n_found; i++)
+    {
+      reads++;
+      if (read_status(found[i], &regs) != 0)
+      {
+        failed++;
+        continue;
+      }
+      if (sim_units > 0)
+        mismatches += check(found[i], &regs) != 0;
+      if (verbose || r == rounds - 1)
+        print_status(found[i], &regs);
+    }
+  }
+
+  if (energy)
+  {
+    printf("energy\n  addr   h sp1    h sp2    h sp3      kWh    W   switches\n");
+    for (i = 0; i < (unsigned)n_found; i++)
+      if (print_energy(found[i]) != 0)
+        printf("  0x%02x failed\n", found[i]);
+  }
+
+  printf("%ld reads, %ld failed", reads, failed);
+  if (sim_units > 0)
+    printf(", %ld not matching the unit", mismatches);
+  if (reads > 0)
+  {
+    printf("\n%.3f s of bus time, %.0f units/s at %.0f kHz",
+        bus_time() - t0, reads / (bus_time() - t0), scl / 1000.);
+    if (sim_units > 0)
+      printf(", simulated in %.3f s", wall_time() - wall0);
+  }
+  printf("\n");
+
+  return failed || mismatches ? 1 : 0;
+}
@@ -0,0 +1,257 @@
+/*
+ * Simulated I2C bus, see twi_sim.h
+ */
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <avr/io.h>
+#include <avr/eeprom.h>
+
+#include "twi_sim.h"
+
+static struct twi_sim_unit *units;
+static int n_units = 0;
+static double bit_time;
+static double now = 0.;
+static double next_period = 0.;
+
+// The registers and parameters of the unit are the ones of the firmware
+static void enter(struct twi_sim_unit *u)
+{
+#if CONFIG_ENERGY
+  energy = u->energy;
+#endif
+  params = u->params;
+  params_next = u->params_next;
+  USICR = u->usicr;
+  USISR = u->usisr;
+  USIDR = u->usidr;
+  DDRB = u->ddrb;
+}
+
+static void leave(struct twi_sim_unit *u)
+{
+#if CONFIG_ENERGY
+  u->energy = energy;
+#endif
+  u->params = params;
+  u->params_next = params_next;
+  u->usicr = USICR;
+  u->usisr = USISR;
+  u->usidr = USIDR;
+  u->ddrb = DDRB;
+}
+
+// A control period of every unit, as the compare match interrupt
+static void period()
+{
+  struct twi_sim_unit *u;
+  uint8_t run;
+  double tau, eq;
+  int i;
+
+  for (i = 0; i < n_units; i++)
+  {
+    u = &units[i];
+    enter(u);
+
+    // the overflow, with the duty cycle of the period before
+    energy_overflow(u->control.state == PWM_ON ? u->control.pwm_val : 0);
+
+    run = twi_period(&u->twi);
+    control_filter(&u->control, u->air + u->box.bias);
+    control_update(&u->control, run, 0);
+    energy_set_point(run);
+    twi_publish(&u->twi, &u->control, 0, control_set_point(run));
+
+    // and the main loop after it
+    params_save();
+
+    // the box over the period, at the mean power of the duty cycle
+    tau = u->box.C / u->box.G;
+    eq = u->box.ambient + (u->control.state == PWM_ON
+        ? u->box.P * u->control.pwm_val / 256. / u->box.G : 0.);
+    u->air = eq + (u->air - eq) * exp(-TIME_INTERVAL / tau);
+
+    leave(u);
+  }
+}
+
+void twi_sim_init(int n, double scl_hz, uint64_t seed)
+{
+  struct twi_sim_unit *u;
+  int i;
+
+  host_eeprom_erase();
+
+  n_units = n;
+  units = calloc(n, sizeof(struct twi_sim_unit));
+  bit_time = 1. / scl_hz;
+
+  for (i = 0; i < n; i++)
+  {
+    u = &units[i];
+    plant_draw(&u->box, &seed);
+    u->air = u->box.ambient;
+
+    enter(u);
+    params_init();
+    energy_init();
+    params.id = i + 1;
+    params_next = params;
+    control_init(&u->control);
+    twi_init(&u->twi);
+    leave(u);
+  }
+
+  now = 0.;
+  next_period = TIME_INTERVAL;
+}
+
+// Runs the control periods that fell in the time on the bus
+static void advance(double t)
+{
+  now += t;
+  while (now >= next_period)
+  {
+    period();
+    next_period += TIME_INTERVAL;
+  }
+}
+
+// A start condition, repeated or not
+static void start()
+{
+  struct twi_sim_unit *u;
+  int i;
+
+  for (i = 0; i < n_units; i++)
+  {
+    u = &units[i];
+    if (!(u->usicr & (1 << USISIE)))
+      continue;
+    enter(u);
+    // SDA fell, then SCL
+    PINB = 0;
+    twi_start(&u->twi);
+    leave(u);
+  }
+
+  advance(bit_time);
+}
+
+// One bit on the bus, returns SDA
+static int bit(int master)
+{
+  struct twi_sim_unit *u;
+  int i, sda = master, counter, interrupts = 0;
+
+  // open drain, any unit driving low wins
+  for (i = 0; i < n_units; i++)
+  {
+    u = &units[i];
+    if ((u->ddrb & (1 << TWI_SDA)) && !(u->usidr & 0x80))
+      sda = 0;
+  }
+
+  for (i = 0; i < n_units; i++)
+  {
+    u = &units[i];
+    if (!(u->usicr & (1 << USIOIE)))
+      continue;
+
+    // shifted in on the rising edge, counted on both edges
+    u->usidr = (u->usidr << 1) | sda;
+    counter = (u->usisr & 0x0F) + 2;
+    u->usisr = (u->usisr & 0xF0) | (counter & 0x0F);
+
+    if (counter >= 16)
+    {
+      enter(u);
+      twi_overflow(&u->twi);
+      leave(u);
+      interrupts = 1;
+    }
+  }
+
+  // the units hold SCL low at the same time
+  advance(bit_time + interrupts * TWI_SIM_ISR_CYCLES / TWI_SIM_F_CPU);
+
+  return sda;
+}
+
+// Returns 0 when acked
+static int write_byte(uint8_t b)
+{
+  int i;
+
+  for (i = 7; i >= 0; i--)
+    bit((b >> i) & 1);
+
+  return bit(1);
+}
+
+static uint8_t read_byte(int ack)
+{
+  uint8_t b = 0;
+  int i;
+
+  for (i = 0; i < 8; i++)
+    b = (b << 1) | bit(1);
+  bit(!ack);
+
+  return b;
+}
+
+/*
+ * Writes nw bytes and reads nr bytes after a repeated start, as the
+ * I2C_RDWR of Linux. Returns 0, or -1 on a nack.
+ */
+int twi_sim_transfer(uint8_t address, const uint8_t *w, int nw,
+    uint8_t *r, int nr)
+{
+  int i, nack = 0;
+
+  if (nw > 0)
+  {
+    start();
+    nack = write_byte(address << 1);
+    for (i = 0; i < nw && !nack; i++)
+      nack = write_byte(w[i]);
+  }
+
+  if (nr > 0 && !nack)
+  {
+    start();
+    nack = write_byte((address << 1) | 1);
+    for (i = 0; i < nr && !nack; i++)
+      r[i] = read_byte(i < nr - 1);
+  }
+
+  // stop, the USI of the units ignores it
+  advance(bit_time);
+
+  return nack ? -1 : 0;
+}
+
+void twi_sim_wait(double seconds)
+{
+  advance(seconds);
+}
+
+double twi_sim_time()
+{
+  return now;
+}
+
+struct twi_sim_unit *twi_sim_find(uint8_t address)
+{
+  int i;
+
+  for (i = 0; i < n_units; i++)
+    if (CONFIG_TWI_BASE + units[i].params.id == address)
+      return &units[i];
+
+  return NULL;
+}
@@ -0,0 +1,54 @@
+/*
+ * Simulated I2C bus
+ * =================
+ *
+ * Units running the I2C slave of twi.c on one bus, with the host as
+ * the master, bit by bit: each bit drives SDA from the master and the
+ * units, shifts it into the USIDR of the units, and runs their counter
+ * overflow interrupt every 8 or 1 bits as the USI would.
+ *
+ * Each unit has its own USI registers, struct twi and parameters,
+ * swapped in around the calls into the firmware. Every TIME_INTERVAL
+ * of bus time, the units run a control period of control.c on a box of
+ * plant.h, taking the commands of the master and publishing their
+ * registers as incubalibre.c does.
+ *
+ * The time of the bus counts the bits at the SCL frequency, and SCL
+ * held low by the USI while the interrupts of the units run,
+ * TWI_SIM_ISR_CYCLES at F_CPU each.
+ */
+
+#ifndef TWI_SIM_H
+#define TWI_SIM_H
+
+#include <stdint.h>
+
+#include "plant.h"
+#include "../params.h"
+#include "../twi.h"
+
+// an interrupt of twi.c with its prologue and epilogue, estimated
+#define TWI_SIM_ISR_CYCLES 80
+#define TWI_SIM_F_CPU 1000000.
+
+struct twi_sim_unit
+{
+  struct twi twi;
+  struct params params, params_next;
+#if CONFIG_ENERGY
+  struct energy energy;
+#endif
+  struct control control;
+  uint8_t usicr, usisr, usidr, ddrb;
+  struct box box;
+  double air;
+};
+
+void twi_sim_init(int units, double scl_hz, uint64_t seed);
+int twi_sim_transfer(uint8_t address, const uint8_t *w, int nw,
+    uint8_t *r, int nr);
+void twi_sim_wait(double seconds);
+double twi_sim_time();
+struct twi_sim_unit *twi_sim_find(uint8_t address);
+
+#endif /* TWI_SIM_H */
@@ -0,0 +1,8 @@
+/* Host shim of avr-libc <util/delay.h>, no time passes */
+#ifndef HOST_DELAY_H
+#define HOST_DELAY_H
+
+#define _delay_ms(ms)
+#define _delay_us(us)
+
+#endif
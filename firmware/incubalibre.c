@@ -35,109 +35,183 @@
  * |               |   - measure trimpot                      |
  * |               |     - if trimpot != 0, start pwm         |
  * |               |     - else stop pwm                      |
- * |               |   - measure temperature                  |
+ * |               |   - measure temperature, every few       |
+ * |               |     periods when steady (see control.h)  |
  * |               |     - if incubator running recompute PID |
+ * |               |   - queue the period for the main loop   |
  * +---------------+------------------------------------------+
  *
+ * The main loop sleeps between the interrupts, and takes the records
+ * the compare match queues on waking up: what is slow and needs no
+ * precise timing, the writes to EEPROM, runs there (see queue.h). So
+ * do the tasks at their own rates, as the fault display (see sched.h).
+ *
  * Thermistor
  * ----------
  *
  * The thermistor was calibrated using a thermocouple and some hot water.
  * A look up table indexed on the ADC value is stored in the flash
- * memory.
+ * memory. A per-device calibration stored in EEPROM takes precedence
+ * over the table when present (see thermistor.h).
+ *
+ * Configuration
+ * -------------
+ *
+ * Conversion, filter, controller and output are chosen at compile time
+ * in config.h, through a profile of profiles/ (make PROFILE=precise).
+ * The trimpot picks one of a few set points, or dials it in tenths of
+ * a degree (see dial.h).
+ *
+ * Power
+ * -----
+ *
+ * The CPU sleeps in Idle mode between the interrupts and the ADC is
+ * only powered while measuring (see lowpower.h). The computations
+ * can run at 8 MHz (see clock.h).
+ *
+ * Supervision
+ * -----------
+ *
+ * The watchdog is fed at the end of every control period, with a
+ * snapshot of the control state. After a watchdog or brown-out reset,
+ * the control resumes from the snapshot (see supervisor.h).
+ *
+ * On every watchdog tick, the thermistor is also sampled by a separate
+ * over-temperature cutoff that latches the heater off (see protect.h).
+ * A reading of an open, shorted, jumping or stuck thermistor holds the
+ * heater off from the period it is taken in (see sensor.h).
+ *
+ * History
+ * -------
+ *
+ * The mean temperature and duty cycle of the last days are kept in
+ * EEPROM, with the faults and the resets, to audit a run without a
+ * host attached (see history.h). So are the time the heater was on at
+ * each set point and the closings of the relay, for the energy the
+ * unit burns (see energy.h).
+ *
+ * Remote
+ * ------
+ *
+ * The gains, set points and duty cycle limits can be changed without
+ * reflashing, over a serial line (see remote.h), or by a host that
+ * polls many units on an I2C bus (see twi.h).
  *
  */
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <avr/pgmspace.h>
+#include <util/delay.h>
 #include <math.h>
 
-// Allows to disable interrupt in some parts of the code
-#define ENTER_CRIT()    {char volatile saved_sreg = SREG; cli()
-#define LEAVE_CRIT()    SREG = saved_sreg;}
-
-// Time interval is 1MHz/16384/256
-#define TIME_INTERVAL 4.194304
-#define TIME_INTERVAL_INV 0.2384186
-
-// the state variable
-#define PWM_ON 0
-#define PWM_OFF 1
-static uint8_t state = PWM_OFF;
-
-// error when we consider set point is reached
-#define TEMP_SET_ERROR 1.0
-
-// measurements
-uint8_t trimpot_val = 0;
-float temperature_avg = 0.;
-uint8_t temp_avg_n = 0;
-
-// Temperature set point
-float temperature_setPoints[4] = { 0.0, 37.5, 40.0, 45.0 };
-
-// PID constants
-float K_p = 10.;
-float K_i = 0.5;
-float K_d = 0.0;
-
-// PID values
-float error_previous = 0.;
-float ITerm = 0.0;
+#include "config.h"
+#include "thermistor.h"
+#include "trim.h"
+#include "lowpower.h"
+#include "clock.h"
+#include "supervisor.h"
+#include "protect.h"
+#include "sensor.h"
+#include "control.h"
+#include "dial.h"
+#include "params.h"
+#include "remote.h"
+#include "twi.h"
+#include "history.h"
+#include "energy.h"
+#include "queue.h"
+#include "sched.h"
+
+// state, filter and PID, see control.h
+struct control control;
+
+#if CONFIG_SENSOR_CHECK
+struct sensor sensor;
+#endif
+
+#if CONFIG_SETPOINT_DIAL
+// the trimpot as a set point dial, see dial.h
+struct dial dial;
+#endif
+
+#if CONFIG_TWI
+// registers of the I2C slave, see twi.h
+struct twi twi;
+#endif
+
+#if CONFIG_HISTORY
+// the samples being taken, see history.h
+struct history history;
+
+// the periods, from the compare match to the main loop
+QUEUE(struct sample, 4) samples;
+#endif
+
+#if CONFIG_OUTPUT == OUTPUT_SIGMA_DELTA
+// duty cycle accumulated over the periods
+uint8_t sigma_delta = 0;
+#endif
+
+#if CONFIG_WATCHDOG
+// control state saved at the end of each period
+struct checkpoint
+{
+  struct control control;
+#if CONFIG_OUTPUT == OUTPUT_SIGMA_DELTA
+  uint8_t sigma_delta;
+#endif
+};
 
-// We limit PWM value to 4 from below to spare the relay
-// and to 128 from above to avoid overheating of the incubator
-#define PWM_MAX 200
-#define PWM_MIN 6
-uint8_t pwm_val = 0;
+// the snapshot of supervisor.c has room for it
+typedef char checkpoint_fits[sizeof(struct checkpoint)
+  <= SUPERVISOR_SNAPSHOT_MAX ? 1 : -1];
+#endif
 
 // Relay and LEDs macros
 #define RELAY_ON()  PORTB &= ~(1 << PB1)
 #define RELAY_OFF() PORTB |= (1 << PB1)
+#if CONFIG_TWI
+// PB0 is SDA of twi.h
+#define LED1_ON()   ((void)0)
+#define LED1_OFF()  ((void)0)
+#define LED1_DDR    0
+#else
 #define LED1_ON()   PORTB |= (1 << PB0)
 #define LED1_OFF()  PORTB &= ~(1 << PB0)
+#define LED1_DDR    (1 << PB0)
+#endif
+#if CONFIG_REMOTE
+// PB4 is the serial line of remote.h
+#define LED2_ON()   ((void)0)
+#define LED2_OFF()  ((void)0)
+#define LED2_TOGGLE() ((void)0)
+#define LED2_DDR    0
+#else
 #define LED2_ON()   PORTB |= (1 << PB4)
 #define LED2_OFF()  PORTB &= ~(1 << PB4)
+// in one write, the main loop shares PORTB with the interrupts
+#define LED2_TOGGLE() PINB = (1 << PB4)
+#define LED2_DDR    (1 << PB4)
+#endif
 
 #define START_PWM_1A() TCCR1 |= (1 << PWM1A) | (1 << COM1A1) | (1 << COM1A0)
 #define STOP_PWM_1A()  TCCR1 &= ~((1 << PWM1A) | (1 << COM1A1) | (1 << COM1A0))
 
-// Look-up table of Thermistor values
-const float therm_lut[] PROGMEM = { -66.89, -53.98, -47.36, -42.76, -39.19, -36.24, -33.71, -31.49, -29.51, -27.72, 
-  -26.07, -24.55, -23.14, -21.81, -20.56, -19.37, -18.25, -17.17, -16.15, -15.17, 
-  -14.22, -13.31, -12.43, -11.58, -10.76, -9.96, -9.18, -8.43, -7.69, -6.97, 
-  -6.27, -5.59, -4.92, -4.26, -3.62, -2.99, -2.37, -1.77, -1.17, -0.59, 
-  -0.01, 0.56, 1.12, 1.67, 2.21, 2.75, 3.27, 3.80, 4.31, 4.82, 
-  5.32, 5.82, 6.31, 6.80, 7.28, 7.76, 8.23, 8.70, 9.16, 9.62, 
-  10.08, 10.53, 10.98, 11.42, 11.86, 12.30, 12.74, 13.17, 13.60, 14.03, 
-  14.45, 14.88, 15.30, 15.71, 16.13, 16.54, 16.95, 17.36, 17.77, 18.18, 
-  18.58, 18.98, 19.38, 19.78, 20.18, 20.58, 20.98, 21.37, 21.76, 22.16, 
-  22.55, 22.94, 23.33, 23.72, 24.11, 24.49, 24.88, 25.27, 25.65, 26.04, 
-  26.42, 26.81, 27.19, 27.58, 27.96, 28.35, 28.73, 29.11, 29.50, 29.88, 
-  30.26, 30.65, 31.03, 31.42, 31.80, 32.19, 32.57, 32.96, 33.34, 33.73, 
-  34.12, 34.51, 34.89, 35.28, 35.67, 36.06, 36.46, 36.85, 37.24, 37.64, 
-  38.03, 38.43, 38.83, 39.23, 39.63, 40.03, 40.44, 40.84, 41.25, 41.66, 
-  42.07, 42.48, 42.89, 43.31, 43.72, 44.14, 44.56, 44.99, 45.41, 45.84, 
-  46.27, 46.70, 47.14, 47.57, 48.01, 48.46, 48.90, 49.35, 49.80, 50.26, 
-  50.71, 51.17, 51.64, 52.11, 52.58, 53.05, 53.53, 54.01, 54.50, 54.99, 
-  55.49, 55.99, 56.49, 57.00, 57.51, 58.03, 58.55, 59.08, 59.62, 60.16, 
-  60.70, 61.26, 61.82, 62.38, 62.95, 63.53, 64.12, 64.71, 65.31, 65.92, 
-  66.54, 67.16, 67.79, 68.44, 69.09, 69.75, 70.43, 71.11, 71.80, 72.51, 
-  73.23, 73.96, 74.70, 75.46, 76.23, 77.02, 77.82, 78.64, 79.47, 80.32, 
-  81.20, 82.09, 83.00, 83.93, 84.89, 85.87, 86.87, 87.90, 88.96, 90.06, 
-  91.18, 92.34, 93.53, 94.76, 96.04, 97.35, 98.72, 100.14, 101.61, 103.14, 
-  104.74, 106.41, 108.16, 110.00, 111.92, 113.95, 116.10, 118.38, 120.80, 123.39, 
-  126.16, 129.15, 132.39, 135.93, 139.81, 144.12, 148.94, 154.41, 160.71, 168.12, 
-  177.05, 188.24, 202.99, 224.20, 260.13, 630.92 };
-
-void measure_temperature()
-{
-  /* Measure Temperature */
+#if CONFIG_OUTPUT == OUTPUT_PWM
+#define START_OUTPUT() START_PWM_1A()
+#define STOP_OUTPUT()  STOP_PWM_1A()
+#else
+// the relay is switched from the overflow interrupt
+#define START_OUTPUT() sigma_delta = 0
+#define STOP_OUTPUT()  RELAY_OFF()
+#endif
 
+uint16_t read_thermistor()
+{
   // select ADC3 single-ended channel
-  // Left adjust to have 8 upper bits in the upper register
-  ADMUX = (1 << MUX1) | (1 << MUX0) | (1 << ADLAR);
+  // Right adjust, we use the full 10 bits
+  ADMUX = (1 << MUX1) | (1 << MUX0);
 
   // start conversion
   ADCSRA |= (1 << ADSC);
@@ -146,19 +220,12 @@ void measure_temperature()
   while (ADCSRA & (1 << ADSC))
     ;
 
-  // We only use the 8 upper bit of the ADC value
-  // for the temperature
-  uint8_t high = ADCH;
-
-  // average the temperature measurement
-  temperature_avg = pgm_read_float(&(therm_lut[high]));
-  //temperature_avg = 0.8*temperature_avg + 0.2*pgm_read_float(&(therm_lut[high]));
+  // ADCL must be read first, ADC reads both in the right order
+  return ADC;
 }
 
-void measure_trimpot()
+uint8_t read_trimpot()
 {
-  /* Measure the trimpot value */
-  
   // select ADC1 single-ended channel
   // Left adjust to have 8 upper bits in the upper register
   ADMUX = (1 << MUX0) | (1 << ADLAR);
@@ -170,119 +237,628 @@ void measure_trimpot()
   while (ADCSRA & (1 << ADSC))
     ;
 
+  return ADCH;
+}
+
+#if CONFIG_SETPOINT_DIAL
+// The sum of DIAL_SAMPLES full conversions of the trimpot
+uint16_t read_dial()
+{
+  uint16_t sum = 0;
+  uint8_t i;
+
+  // select ADC1 single-ended channel, right adjust for the 10 bits
+  ADMUX = (1 << MUX0);
+
+  for (i = 0; i < DIAL_SAMPLES; i++)
+  {
+    ADCSRA |= (1 << ADSC);
+    while (ADCSRA & (1 << ADSC))
+      ;
+    sum += ADC;
+  }
+
+  return sum;
+}
+#endif
+
+void measure_temperature(struct sample *s)
+{
+  /* Measure Temperature */
+
+  uint16_t raw = read_thermistor();
+  float t = control_temperature(raw);
+
+  s->thermistor = raw;
+
+  // a faulty reading does not reach the filter
+  if (sensor_check(&sensor, raw, t,
+        control.state == PWM_ON && control.pwm_val >= PWM_MAX) != SENSOR_OK)
+    return;
+
+  control_filter(&control, t);
+}
+
+void measure_trimpot(struct sample *s)
+{
+#if CONFIG_TWI
+  // the run register of the bus master stands for the trimpot,
+  // PB2 is SCL
+  s->trimpot = twi_period(&twi);
+#elif CONFIG_SETPOINT_DIAL
+  // the code of the set point, filtered, 0 in the off zone
+  s->trimpot = dial_update(&dial, read_dial());
+#else
+  /* Measure the trimpot value */
+
   // We only use few upper bit of the ADC value
   // for the trimpot value
-  uint8_t high = ADCH;
-  trimpot_val = high >> 6;
+  uint8_t high = read_trimpot();
+  s->trimpot = high >> 6;
+#endif
 }
 
-void PID_compute()
+#if CONFIG_TRIM
+
+/*
+ * Field trim
+ *
+ * Entered by powering up with the trimpot turned fully up, then turning
+ * it fully down and fully up again within TRIM_GESTURE seconds, while
+ * both LEDs blink. Fully up is also a running position, a unit that
+ * powers up so after a power cut goes on with the control.
+ *   1. LED1 blinks: hold the thermistor at TRIM_T1 (ice bath), wait for
+ *      it to settle and turn the trimpot fully down. LED1 stays on.
+ *   2. LED2 blinks: hold the thermistor at TRIM_T2, wait for it to
+ *      settle and turn the trimpot fully up.
+ * Both LEDs light for 2 s when the trim is stored, or blink fast for
+ * 2 s when it is rejected and the previous trim is kept. A step that
+ * waits longer than TRIM_TIMEOUT seconds ends the trim, the previous
+ * trim is kept and the control starts. Without LED2 (CONFIG_REMOTE,
+ * the serial line is on PB4), LED1 blinks in place of it.
+ */
+#define TRIM_POT_LOW  0x10
+#define TRIM_POT_HIGH 0xF0
+
+// seconds for the gesture, and for each point
+#define TRIM_GESTURE 5
+#define TRIM_TIMEOUT 900
+
+// the trimpot is read every blink of the LEDs
+#define TRIM_BLINK_MS 250
+#define TRIM_TICKS(seconds) ((seconds) * (1000 / TRIM_BLINK_MS))
+
+// the pins of the LEDs, none of the serial line
+#define TRIM_LEDS (LED1_DDR | LED2_DDR)
+#define TRIM_LED2 (LED2_DDR ? LED2_DDR : LED1_DDR)
+
+float trim_capture()
 {
-  /*Compute all the working error variables*/
-  float error = 37.5 - temperature_avg;
+  uint32_t sum = 0;
+  uint8_t i;
 
-  // turn the LED2 on if we are close to set temperature
-  if (fabs(error) < TEMP_SET_ERROR)
-    LED2_ON();
-  else
-    LED2_OFF();
+  // let the hand leave the trimpot
+  _delay_ms(1000);
 
-  // integral term (using trapeze method)
-  ITerm += (K_i * TIME_INTERVAL * (error + error_previous)*0.5);
-  if (ITerm > PWM_MAX) 
-    ITerm = PWM_MAX;
-  else if (ITerm < PWM_MIN) 
+  for (i = 0; i < 64; i++)
   {
-    ITerm = PWM_MIN;
+    sum += read_thermistor();
+    _delay_ms(20);
   }
 
-  // differential term
-  float dInput = (error - error_previous) * TIME_INTERVAL_INV;
+  return sum / 64.;
+}
 
-  /*Compute PID Output*/
-  float output = K_p * error + ITerm + K_d * dInput;
+// Blinks the LEDs until the trimpot is fully up, or fully down, returns
+// 0 when the ticks run out first
+uint8_t trim_wait(uint8_t up, uint8_t leds, uint16_t *ticks)
+{
+  while (up ? read_trimpot() < TRIM_POT_HIGH : read_trimpot() > TRIM_POT_LOW)
+  {
+    if (*ticks == 0)
+      return 0;
+    (*ticks)--;
 
-  // set PWM value
-  if (output > PWM_MAX)
-    pwm_val = PWM_MAX;
-  else if (output < PWM_MIN) 
-    pwm_val = 0.;
-  else
-    pwm_val = (uint8_t)output;
+    PORTB ^= leds;
+    _delay_ms(TRIM_BLINK_MS);
+  }
 
-  /*Remember some variables for next time*/
-  error_previous = error;
+  return 1;
 }
 
-// Here we turn the relay off
-SIGNAL(TIMER1_COMPA_vect)
+// The two points, 0 when a step waits past TRIM_TIMEOUT
+uint8_t trim_points(float *adc1, float *adc2)
+{
+  uint16_t ticks = TRIM_TICKS(TRIM_TIMEOUT);
+
+  // wait for the trimpot to be released from the top
+  if (!trim_wait(0, LED1_DDR, &ticks))
+    return 0;
+  LED1_ON();
+  *adc1 = trim_capture();
+
+  ticks = TRIM_TICKS(TRIM_TIMEOUT);
+  if (!trim_wait(1, TRIM_LED2, &ticks))
+    return 0;
+  PORTB |= TRIM_LED2;
+  *adc2 = trim_capture();
+
+  return 1;
+}
+
+void field_trim()
 {
-  measure_trimpot();
-  measure_temperature();
-  
-  if (trimpot_val > 0)
+  float adc1, adc2;
+  uint16_t ticks = TRIM_TICKS(TRIM_GESTURE);
+  uint8_t i;
+
+  // down and up again, what a running unit does not do, else the
+  // control starts with the previous trim, as after a step timed out
+  if (trim_wait(0, TRIM_LEDS, &ticks)
+      && trim_wait(1, TRIM_LEDS, &ticks))
   {
-    if (state == PWM_OFF)
+    LED1_OFF();
+    LED2_OFF();
+
+    if (trim_points(&adc1, &adc2))
     {
-      START_PWM_1A();
-      state = PWM_ON;
+      if (trim_compute(adc1, adc2))
+        _delay_ms(2000);
+      else
+      {
+        for (i = 0; i < 20; i++)
+        {
+          PORTB ^= TRIM_LEDS;
+          _delay_ms(100);
+        }
+      }
+    }
+  }
+
+  LED1_OFF();
+  LED2_OFF();
+}
+
+#endif /* CONFIG_TRIM */
+
+
+// Blink period of the faults, in seconds
+#define FAULTS_BLINK 0.5
+
+/*
+ * Fault patterns, blinking every FAULTS_BLINK
+ *
+ *   over-temperature   LED2 blinks
+ *   thermistor open    LED1 blinks
+ *   thermistor short   LED1 and LED2 blink together
+ *   reading jumps      LED1 and LED2 blink in turn
+ *   reading stuck      LED1 blinks, LED2 on
+ *
+ * With one of the LEDs taken by a bus (see config.h), the other blinks
+ * on any fault.
+ */
+void show_faults()
+{
+  static uint8_t blink = 0;
+  static uint8_t shown = 0;
+  uint8_t fault = sensor_fault(&sensor);
 
+  blink ^= 1;
+
+#if CONFIG_REMOTE || CONFIG_TWI
+  if (protect_fault() != PROTECT_OK || fault != SENSOR_OK)
+  {
+    if (blink)
+    {
       LED1_ON();
+      LED2_ON();
     }
+    else
+    {
+      LED1_OFF();
+      LED2_OFF();
+    }
+  }
+#else
+  if (protect_fault() != PROTECT_OK)
+  {
+    LED1_OFF();
+    LED2_TOGGLE();
+  }
+  else if (fault != SENSOR_OK)
+  {
+    if (blink)
+      LED1_ON();
+    else
+      LED1_OFF();
 
-    // do the PID magic
-    PID_compute();
+    if (fault == SENSOR_STUCK
+        || (fault == SENSOR_SHORT && blink)
+        || (fault == SENSOR_JUMP && !blink))
+      LED2_ON();
+    else
+      LED2_OFF();
   }
-  else
+#endif
+  else if (shown)
   {
-    if (state == PWM_ON)
-    {
-      STOP_PWM_1A();
-      state = PWM_OFF;
+    // the fault cleared, back to the running indication
+    if (control.state == PWM_ON)
+      LED1_ON();
+    else
+      LED1_OFF();
+    LED2_OFF();
+  }
 
-      RELAY_OFF();
+  shown = protect_fault() != PROTECT_OK || fault != SENSOR_OK;
+}
 
-      LED1_OFF();
-      pwm_val = 0;
-      ITerm = 0.0;
-      error_previous = 0.0;
-    }
+// the tasks of the main loop, see sched.h
+struct task tasks[] =
+{
+  TASK(show_faults, FAULTS_BLINK, FAULTS_BLINK),
+#if CONFIG_ENERGY
+  TASK(energy_task, ENERGY_TASK, 1.),
+#endif
+};
+
+const uint8_t tasks_n = sizeof(tasks) / sizeof(tasks[0]);
+
+#if CONFIG_WATCHDOG
+void control_checkpoint()
+{
+  struct checkpoint c;
+
+  c.control = control;
+#if CONFIG_OUTPUT == OUTPUT_SIGMA_DELTA
+  c.sigma_delta = sigma_delta;
+#endif
+
+  supervisor_checkpoint(&c, sizeof(c));
+}
+
+// Restore the control state after a warm reset, returns 1 on success
+uint8_t control_resume()
+{
+  struct checkpoint c;
+
+  if (!supervisor_resume(&c, sizeof(c)))
+    return 0;
+
+  // a snapshot out of range is not resumed
+  if (c.control.state > PWM_OFF || c.control.pwm_val > PWM_MAX
+      || c.control.interval < 1 || c.control.interval > CONFIG_SAMPLE_MAX)
+    return 0;
+#if CONFIG_LID
+  if (c.control.lid > LID_RECOVER || isnan(c.control.slope))
+    return 0;
+#endif
+#if CONFIG_CONTROLLER == CONTROLLER_PID
+  if (!(c.control.pid.ITerm >= PWM_MIN && c.control.pid.ITerm <= PWM_MAX)
+      || isnan(c.control.pid.error_previous))
+    return 0;
+#endif
+
+  control = c.control;
+#if CONFIG_OUTPUT == OUTPUT_SIGMA_DELTA
+  sigma_delta = c.sigma_delta;
+#endif
+
+  if (control.state == PWM_ON)
+  {
+#if CONFIG_OUTPUT == OUTPUT_PWM
+    OCR1A = control.pwm_val;
+#endif
+    START_OUTPUT();
+    LED1_ON();
+  }
+
+  return 1;
+}
+#else
+#define control_checkpoint() ((void)0)
+#define control_resume() ((void)0)
+#endif
+
+void PID_compute(uint8_t trimpot_val)
+{
+  uint8_t previous = control.state;
+  uint8_t hold = sensor_fault(&sensor) != SENSOR_OK;
+
+  // a latched over-temperature fault acts as the trimpot at zero,
+  // the heater stays off on a faulty reading
+  control_update(&control,
+      protect_fault() == PROTECT_OK ? trimpot_val : 0, hold);
+
+  if (previous == PWM_OFF && control.state == PWM_ON)
+  {
+    START_OUTPUT();
+    LED1_ON();
+  }
+  else if (previous == PWM_ON && control.state == PWM_OFF)
+  {
+    STOP_OUTPUT();
+    RELAY_OFF();
+    LED1_OFF();
+  }
+
+  // turn the LED2 on if we are close to set temperature
+  if (control.state == PWM_ON && !hold)
+  {
+    if (fabs(control_set_point(trimpot_val) - control.temperature_avg)
+        < TEMP_SET_ERROR)
+      LED2_ON();
+    else
+      LED2_OFF();
+  }
+}
+
+#if CONFIG_HISTORY
+// Hands the period to the main loop, a period the queue has no room for
+// is lost
+void sample_push(const struct sample *s)
+{
+  if (!queue_full(&samples))
+  {
+    *queue_back(&samples) = *s;
+    queue_push(&samples);
+  }
+}
+#else
+#define sample_push(s)
+#endif
+
+// Here we turn the relay off
+SIGNAL(TIMER1_COMPA_vect)
+{
+  static uint16_t period = 0;
+  // the set point index of the last measurement, none after a reset
+  static uint8_t run = 0xFF;
+  struct sample s;
+  uint8_t index, measure;
+
+  // compute at 8 MHz, see clock.h
+  clock_burst();
+
+  // the ADC is only powered for the measurements
+  adc_on();
+  measure_trimpot(&s);
+
+  // the set point in use, a latched fault stops the heater
+  index = protect_fault() == PROTECT_OK ? control_index(s.trimpot) : 0;
+
+  // a steady chamber is measured every few periods, a change of the
+  // set point or a latched fault at once (see control.h)
+  measure = control_sampling(&control) || run != index;
+  if (measure)
+    measure_temperature(&s);
+  else
+    s.thermistor = CONTROL_NO_READING;
+  adc_off();
+
+  if (measure)
+  {
+    PID_compute(s.trimpot);
+    run = index;
+    energy_set_point(run);
   }
+
+  s.period = period++;
+  s.state = control.state;
+  s.pwm_val = control.pwm_val;
+  s.faults = sensor_fault(&sensor) | (protect_fault() << 4);
+  s.temperature = control.temperature_avg;
+
+  // what the bus master reads of the period
+  twi_publish(&twi, &control, s.faults, control_set_point(s.trimpot));
+
+  sample_push(&s);
+
+  // the period completed, feed the watchdog
+  control_checkpoint();
+
+  clock_relax();
 }
 
 // The timer overflow interrupt routine
 SIGNAL(TIMER1_OVF_vect)
 {
+  sched_overflow();
+
+#if CONFIG_OUTPUT == OUTPUT_SIGMA_DELTA
+  // the relay is on for the whole period when the duty cycle
+  // accumulated over the periods overflows
+  uint8_t previous = sigma_delta;
+
+  sigma_delta += control.pwm_val;
+  if (control.state == PWM_ON && sigma_delta < previous
+      && protect_fault() == PROTECT_OK)
+  {
+    RELAY_ON();
+    energy_overflow(256);
+  }
+  else
+  {
+    RELAY_OFF();
+    energy_overflow(0);
+  }
+#else
   // set pwm duty cycle to value computed by PID
-  OCR1A = pwm_val;
+  OCR1A = control.pwm_val;
+
+  // the time the heater is on in the period, see energy.h
+  energy_overflow(control.state == PWM_ON && protect_fault() == PROTECT_OK
+      ? control.pwm_val : 0);
+#endif
 }
 
-int main()
+// Wakes the main loop for the next release of a task
+SIGNAL(TIMER1_COMPB_vect)
 {
-  int i;
+}
 
-  // enable interrupts
-  sei();
+#if CONFIG_TWI
+// The I2C slave, see twi.h
+SIGNAL(USI_START_vect)
+{
+  twi_start(&twi);
+}
+
+SIGNAL(USI_OVF_vect)
+{
+  twi_overflow(&twi);
+}
+#endif
+
+#if CONFIG_WATCHDOG
+// The watchdog tick, every SUPERVISOR_TICK
+SIGNAL(WDT_vect)
+{
+#if CONFIG_PROTECT
+  uint16_t adc;
+
+  if (protect_fault() == PROTECT_OK)
+  {
+    // ADC clocked at 62.5 kHz, the clock is not in a burst here
+    adc_on();
+    ADCSRA = (1 << ADEN) | (1 << ADPS2);
+    adc = read_thermistor();
+    adc_off();
+
+    protect_update(adc);
+  }
+
+  if (protect_fault() != PROTECT_OK)
+  {
+    // cut the heater whatever the control is doing
+    STOP_PWM_1A();
+    RELAY_OFF();
+  }
+#endif
+
+  supervisor_tick();
+}
+#endif
+
+/*
+ * The stages of the main loop, on each wake up: the periods queued by
+ * the compare match, the changes of the parameters to store, and the
+ * tasks due.
+ */
+void main_stages()
+{
+#if CONFIG_HISTORY
+  // the history in EEPROM, once a sample
+  while (!queue_empty(&samples))
+  {
+    history_update(&history, queue_front(&samples));
+    queue_pop(&samples);
+  }
+#endif
+
+  params_save();
+
+  // the command of the serial line, see remote.h
+  remote_poll();
+
+  sched_run(tasks, tasks_n);
+
+  // the main loop is not stuck either, see supervisor.h
+  supervisor_alive();
+}
+
+// 1 when the stages have nothing left to do, the interrupts disabled
+uint8_t main_idle()
+{
+#if CONFIG_HISTORY
+  if (!queue_empty(&samples))
+    return 0;
+#endif
+
+  if (remote_pending())
+    return 0;
+
+  return !sched_due(tasks, tasks_n);
+}
+
+/*
+ * Everything before the infinite loop but the release of the tasks, up
+ * to the start of TIMER1: the replay of host/ runs it as well.
+ */
+void main_init()
+{
+  uint8_t warm;
+
+  // first, a watchdog reset leaves the watchdog running
+  warm = supervisor_init();
+
+  // load the per-device calibration before the first measurement
+  therm_init();
+  trim_init();
+  params_init();
+  history_init(&history, warm);
+  energy_init();
+  sensor_init(&sensor);
+  dial_init(&dial);
+  control_init(&control);
+
+  lowpower_init();
 
   // ADC setting, enabled, prescaled clk/16
   ADCSRA = (1 << ADEN) | (1 << ADPS2);
 
-  // set up timer 1 as system clock
-  TCNT1 = 0x0;            // counter at zero
-  TIMSK |= (1 << TOIE1) | (1 << OCIE1A);   // set the overflow interrupt
-  TCCR1 = (1 << CS13) | (1 << CS12) | (1 << CS11) | (1 << CS10); // T1 clock to clk/16384
-
   // configure PB1 to switch relay
   // configure PB0 and PB4 for the two LEDs
-  DDRB = (1 << PB1) | (1 << PB0) | (1 << PB4);
+  DDRB = (1 << PB1) | LED1_DDR | LED2_DDR;
   RELAY_OFF();
   LED1_OFF();
   LED2_OFF();
+  remote_init();
+  twi_init(&twi);
+
+#if CONFIG_TRIM
+  // trimpot fully up at power up, and the gesture, start the field trim
+  if (!warm && read_trimpot() > TRIM_POT_HIGH)
+    field_trim();
+#endif
+
+  adc_off();
+
+  // a fault latched before the reset stays latched
+  protect_init(warm);
+
+  // pick up where the control was before the reset
+  if (warm && protect_fault() == PROTECT_OK)
+    control_resume();
+
+  // enable interrupts
+  sei();
+
+  // set up timer 1 as system clock
+  TCNT1 = 0x0;            // counter at zero
+  TIMSK |= (1 << TOIE1) | (1 << OCIE1A);   // set the overflow interrupt
+  TCCR1 |= (1 << CS13) | (1 << CS12) | (1 << CS11) | (1 << CS10); // T1 clock to clk/16384
+
+  // from now on, every period must complete
+  supervisor_start();
+}
+
+int main()
+{
+  main_init();
+  sched_start(tasks, tasks_n);
 
   // The infinite loop
   while (1)
   {
-
+    // the control happens in the TIMER1 interrupts
+    main_stages();
+
+    // an interrupt after the check wakes the CPU at once, see lowpower.h
+    cli();
+    if (main_idle())
+      lowpower_idle();
+    sei();
   }
 
 }
@@ -0,0 +1,94 @@
+/*
+ * Low power
+ * =========
+ *
+ * Between the interrupts, once the main loop has nothing left to do,
+ * the CPU sleeps in Idle mode, where TIMER1 keeps running. The
+ * peripherals the firmware does not use are stopped through PRR, the
+ * digital input buffers of the two analog pins are disabled, and the
+ * ADC is only powered during the measurements of a control period.
+ *
+ * The brown-out detector is disabled by the fuses (EFUSE/HFUSE). If a
+ * build enables it, CONFIG_BOD_SLEEP turns it off while sleeping.
+ */
+
+#ifndef LOWPOWER_H
+#define LOWPOWER_H
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+#include "config.h"
+#include "clock.h"
+
+// ADC enabled, clocked at 62.5 kHz
+#define ADC_ON_ADCSRA ((1 << ADEN) | ADC_PRESCALER)
+
+#if CONFIG_LOWPOWER
+
+// Peripherals stopped for good, TIMER0 and USI unless a feature uses them
+#ifndef LOWPOWER_PRR
+#if CONFIG_TWI
+#define LOWPOWER_PRR (1 << PRTIM0)
+#else
+#define LOWPOWER_PRR ((1 << PRTIM0) | (1 << PRUSI))
+#endif
+#endif
+
+static inline void lowpower_init()
+{
+  PRR = LOWPOWER_PRR;
+
+#if CONFIG_TWI
+  // the thermistor (ADC3) is analog only, PB2 is SCL
+  DIDR0 = (1 << ADC3D);
+#else
+  // the thermistor (ADC3) and the trimpot (ADC1) are analog only
+  DIDR0 = (1 << ADC3D) | (1 << ADC1D);
+#endif
+
+  // analog comparator off
+  ACSR = (1 << ACD);
+
+  set_sleep_mode(SLEEP_MODE_IDLE);
+}
+
+static inline void adc_on()
+{
+  PRR &= ~(1 << PRADC);
+  ADCSRA = ADC_ON_ADCSRA;
+}
+
+static inline void adc_off()
+{
+  ADCSRA = 0;
+  PRR |= (1 << PRADC);
+}
+
+/*
+ * Called with the interrupts disabled, once the main loop found nothing
+ * left to do: the CPU sleeps as they are enabled, an interrupt that
+ * came after the check wakes it at once.
+ */
+static inline void lowpower_idle()
+{
+  sleep_enable();
+#if CONFIG_BOD_SLEEP
+  sleep_bod_disable();
+#endif
+  sei();
+  sleep_cpu();
+  sleep_disable();
+}
+
+#else
+
+#define lowpower_init() ((void)0)
+#define adc_on() (ADCSRA = ADC_ON_ADCSRA)
+#define adc_off() ((void)0)
+#define lowpower_idle() sei()
+
+#endif /* CONFIG_LOWPOWER */
+
+#endif /* LOWPOWER_H */
@@ -0,0 +1,286 @@
+/*
+* ----------------------------------------------------------------------------
+* "THE BEER-WARE LICENSE" (Revision 42):
+* <fakufaku@gmail.com> wrote this file. As long as you retain this notice you
+* can do whatever you want with this stuff. If we meet some day, and you think
+* this stuff is worth it, you can buy me a beer in return -- Robin Scheibler
+* ----------------------------------------------------------------------------
+*/
+
+/*
+ * IncubaLibre multi-zone
+ * ======================
+ *
+ * One ATmega328P for a rack of chambers: CONFIG_ZONES independent
+ * thermistors, controllers and relays, built from the same Makefile
+ * with 'make NAME=multizone'.
+ *
+ * Pins
+ * ----
+ *
+ *   ADC0..ADC(N-1)   thermistors, same divider as the ATtiny85 board
+ *   ADC5             trimpot, set point of all the zones, 0 stops them
+ *   PD2..PD(2+N-1)   relays, active low
+ *   PB0..PB(N-1)     LEDs, on while heating, blinking on a fault
+ *
+ * Scheduler
+ * ---------
+ *
+ * The control period is the one of the ATtiny85 (TIME_INTERVAL), so
+ * the PID gains are the same. TIMER1 divides it in 256 slots of
+ * 16.384 ms, and each relay is on for the first pwm_val slots of its
+ * zone's period. The periods of the zones are staggered by 256/N
+ * slots: the relays do not switch together, and each zone is measured
+ * in the last slot of its period, in its own slot, while its relay is
+ * off (pwm_val <= PWM_MAX < 256).
+ *
+ *   slot     0         64        128       192       0
+ *   zone 0   |on.....off......................M|
+ *   zone 1             |on.....off......................M|
+ *   zone 2                       |on.....off......................M|
+ *
+ * The interrupt only switches the relays and flags the zone to
+ * measure. The conversion and the controller run in the main loop, at
+ * most a few ms, well within a slot, and the new duty cycle is taken
+ * at the start of the zone's next period.
+ *
+ * Safety
+ * ------
+ *
+ * A reading outside SENSOR_ADC_MIN..SENSOR_ADC_MAX, or above
+ * CONFIG_PROTECT_TMAX, latches the zone off. The watchdog is fed by
+ * each zone update and resets the board when the main loop stops.
+ *
+ * The calibration record of thermistor.h applies to all the zones,
+ * the field trim is not used.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <avr/sleep.h>
+#include <avr/wdt.h>
+
+#include "config.h"
+#include "thermistor.h"
+#include "sensor.h"
+#include "pid.h"
+
+#if CONFIG_REMOTE || CONFIG_TWI
+#error "CONFIG_REMOTE and CONFIG_TWI are for the ATtiny85 build, the zones have their own gains"
+#endif
+
+#define ZONES CONFIG_ZONES
+
+#define SLOT_TICKS 16384     // 1 MHz clock, 256 slots per period
+#define ZONE_PHASE (256 / ZONES)
+
+#define TRIMPOT_CHANNEL 5
+
+// Zone faults
+#define ZONE_OK    0
+#define ZONE_OPEN  SENSOR_OPEN
+#define ZONE_SHORT SENSOR_SHORT
+#define ZONE_OVER  8
+
+// Per-zone state
+static uint8_t pwm_val[ZONES];
+static uint8_t pwm_active[ZONES];   // taken at the start of the period
+static float temperature_avg[ZONES];
+static struct pid pid[ZONES];
+static uint8_t fault[ZONES];
+
+// Bit masks of the zones
+static uint8_t running = 0;
+static uint8_t filled = 0;          // temperature_avg is valid
+static volatile uint8_t due = 0;    // to be measured
+
+static uint8_t trimpot_val = 0;
+
+const float temperature_setPoints[4] PROGMEM = CONFIG_SETPOINTS;
+
+// Relay and LED of a zone
+#define RELAY_ON(z)   PORTD &= ~(1 << (PD2 + (z)))
+#define RELAY_OFF(z)  PORTD |= (1 << (PD2 + (z)))
+#define LED_ON(z)     PORTB |= (1 << (z))
+#define LED_OFF(z)    PORTB &= ~(1 << (z))
+#define LED_TOGGLE(z) PORTB ^= (1 << (z))
+
+uint16_t read_adc(uint8_t channel)
+{
+  // AVcc reference, right adjusted
+  ADMUX = (1 << REFS0) | channel;
+
+  // start conversion
+  ADCSRA |= (1 << ADSC);
+
+  // wait for conversion to finish
+  while (ADCSRA & (1 << ADSC))
+    ;
+
+  return ADC;
+}
+
+float set_point()
+{
+#if CONFIG_SETPOINT_TRIMPOT
+  return pgm_read_float(&(temperature_setPoints[trimpot_val]));
+#else
+  return pgm_read_float(&(temperature_setPoints[1]));
+#endif
+}
+
+void zone_stop(uint8_t z)
+{
+  running &= ~(1 << z);
+  pwm_val[z] = 0;
+  pid_reset(&pid[z]);
+}
+
+// Measure a zone and compute its duty cycle for the next period
+void zone_update(uint8_t z)
+{
+  uint16_t adc;
+  float t;
+
+  // zone 0 measures the trimpot for everybody
+  if (z == 0)
+    trimpot_val = read_adc(TRIMPOT_CHANNEL) >> 8;
+
+  adc = read_adc(z);
+
+  if (fault[z] == ZONE_OK)
+  {
+    if (adc < SENSOR_ADC_MIN)
+      fault[z] = ZONE_OPEN;
+    else if (adc > SENSOR_ADC_MAX)
+      fault[z] = ZONE_SHORT;
+  }
+
+  if (fault[z] != ZONE_OK)
+  {
+    zone_stop(z);
+    LED_TOGGLE(z);
+    return;
+  }
+
+  t = therm_convert(adc);
+
+  // average the temperature measurement
+#if CONFIG_FILTER == FILTER_EMA
+  if (filled & (1 << z))
+    temperature_avg[z] += CONFIG_FILTER_ALPHA * (t - temperature_avg[z]);
+  else
+    temperature_avg[z] = t;
+#else
+  temperature_avg[z] = t;
+#endif
+  filled |= 1 << z;
+
+  if (temperature_avg[z] > CONFIG_PROTECT_TMAX)
+  {
+    fault[z] = ZONE_OVER;
+    zone_stop(z);
+    return;
+  }
+
+  if (trimpot_val > 0)
+  {
+    running |= 1 << z;
+    LED_ON(z);
+
+    pwm_val[z] = pid_compute(&pid[z], set_point() - temperature_avg[z], pwm_val[z], 1);
+  }
+  else
+  {
+    zone_stop(z);
+    LED_OFF(z);
+  }
+}
+
+// One slot of the control period
+SIGNAL(TIMER1_COMPA_vect)
+{
+  static uint8_t slot = 0;
+  uint8_t z, local;
+
+  for (z = 0; z < ZONES; z++)
+  {
+    local = slot - z * ZONE_PHASE;
+
+    if (local == 0)
+      pwm_active[z] = pwm_val[z];
+
+    if (local < pwm_active[z] && (running & (1 << z)))
+      RELAY_ON(z);
+    else
+      RELAY_OFF(z);
+
+    // measured in the last slot, the relay is off
+    if (local == 255)
+      due |= 1 << z;
+  }
+
+  slot++;
+}
+
+int main()
+{
+  uint8_t z, todo;
+
+  // a watchdog reset leaves the watchdog running
+  MCUSR = 0;
+  wdt_disable();
+
+  therm_init();
+
+  // only TIMER1 and the ADC
+  PRR = (1 << PRTWI) | (1 << PRTIM2) | (1 << PRTIM0) | (1 << PRSPI)
+    | (1 << PRUSART0);
+  DIDR0 = (1 << (TRIMPOT_CHANNEL)) | ((1 << ZONES) - 1);
+  ACSR = (1 << ACD);
+
+  // ADC enabled, prescaled clk/16
+  ADCSRA = (1 << ADEN) | (1 << ADPS2);
+
+  for (z = 0; z < ZONES; z++)
+  {
+    RELAY_OFF(z);
+    LED_OFF(z);
+    DDRD |= 1 << (PD2 + z);
+    DDRB |= 1 << z;
+  }
+
+  // TIMER1 in CTC mode, one compare match per slot
+  OCR1A = SLOT_TICKS - 1;
+  TIMSK1 = (1 << OCIE1A);
+  TCCR1B = (1 << WGM12) | (1 << CS10);
+
+  // one zone update at least every control period
+  wdt_enable(WDTO_8S);
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  sei();
+
+  while (1)
+  {
+    cli();
+    todo = due;
+    due = 0;
+    if (!todo)
+    {
+      // nothing to do before the next slot
+      sleep_enable();
+      sei();
+      sleep_cpu();
+      sleep_disable();
+      continue;
+    }
+    sei();
+
+    for (z = 0; z < ZONES; z++)
+      if (todo & (1 << z))
+        zone_update(z);
+
+    wdt_reset();
+  }
+}
@@ -0,0 +1,104 @@
+/*
+* ----------------------------------------------------------------------------
+* "THE BEER-WARE LICENSE" (Revision 42):
+* <fakufaku@gmail.com> wrote this file. As long as you retain this notice you
+* can do whatever you want with this stuff. If we meet some day, and you think
+* this stuff is worth it, you can buy me a beer in return -- Robin Scheibler
+* ----------------------------------------------------------------------------
+*/
+
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+
+#include "params.h"
+#include "eeprom_map.h"
+#include "thermistor.h"
+
+#if PARAMS_RUNTIME
+
+struct params params;
+struct params params_next;
+
+// a commit waits for the main loop to write it
+static volatile uint8_t params_unsaved = 0;
+
+// the defaults, in flash (control.c)
+extern const float temperature_setPoints[4] PROGMEM;
+
+// 1 when p can run the controller
+static uint8_t params_valid(const struct params *p)
+{
+  uint8_t i;
+
+  if (!(p->k_p >= 0. && p->k_i >= 0. && p->k_d >= 0.))
+    return 0;
+  if (p->pwm_min > p->pwm_max)
+    return 0;
+  for (i = 0; i < 4; i++)
+    if (!(p->setpoints[i] >= 0. && p->setpoints[i] < CONFIG_PROTECT_TMAX))
+      return 0;
+
+  return 1;
+}
+
+void params_init()
+{
+  uint8_t i;
+
+  eeprom_read_block(&params, (const void *)EE_PARAMS, sizeof(params));
+
+  if (params.magic != PARAMS_MAGIC
+      || crc8(&params, sizeof(params) - 1) != params.crc
+      || !params_valid(&params))
+  {
+    params.k_p = CONFIG_K_P;
+    params.k_i = CONFIG_K_I;
+    params.k_d = CONFIG_K_D;
+    for (i = 0; i < 4; i++)
+      params.setpoints[i] = pgm_read_float(&(temperature_setPoints[i]));
+    params.pwm_min = CONFIG_PWM_MIN;
+    params.pwm_max = CONFIG_PWM_MAX;
+    params.id = CONFIG_REMOTE_ID;
+  }
+
+  params_next = params;
+}
+
+// Returns 1 when params_next is taken, 0 when it is rejected
+uint8_t params_apply()
+{
+  // params is being written to EEPROM, it cannot change yet
+  if (params_unsaved)
+    return 0;
+
+  if (!params_valid(&params_next))
+  {
+    params_next = params;
+    return 0;
+  }
+
+  params = params_next;
+  return 1;
+}
+
+void params_commit()
+{
+  params.magic = PARAMS_MAGIC;
+  params.crc = crc8(&params, sizeof(params) - 1);
+  params_next = params;
+
+  params_unsaved = 1;
+}
+
+void params_save()
+{
+  if (!params_unsaved)
+    return;
+
+  // only the bytes that changed wear the EEPROM
+  eeprom_update_block(&params, (void *)EE_PARAMS, sizeof(params));
+
+  params_unsaved = 0;
+}
+
+#endif /* PARAMS_RUNTIME */
@@ -0,0 +1,61 @@
+/*
+ * Runtime parameters
+ * ==================
+ *
+ * With CONFIG_REMOTE or CONFIG_TWI, the gains, the set points and the
+ * duty cycle limits are variables instead of constants of config.h:
+ * set over the serial line (see remote.h) or the I2C bus (see twi.h)
+ * and kept in EEPROM. The values of config.h are the defaults of a
+ * unit without a valid record.
+ *
+ * Changes go to params_next first. params_apply() checks them and
+ * copies them to params in one go, between two control periods, so
+ * that a period never runs with half of a new configuration.
+ *
+ * params_commit() only marks the record, params_save() writes it to
+ * EEPROM from the main loop, where the history is written (see
+ * history.h): the EEPROM cannot take two writes at once. Until it is
+ * written, about 0.1 s, params_apply() rejects the next changes.
+ */
+
+#ifndef PARAMS_H
+#define PARAMS_H
+
+#include <stdint.h>
+
+#include "config.h"
+
+// the parameters are set at run time
+#define PARAMS_RUNTIME (CONFIG_REMOTE || CONFIG_TWI)
+
+#define PARAMS_MAGIC 0x50   // 'P'
+
+// 33 bytes on the AVR, the crc last
+struct params
+{
+  float k_p, k_i, k_d;
+  float setpoints[4];
+  uint8_t pwm_min, pwm_max;
+  uint8_t id;               // address on the serial line or the bus
+  uint8_t magic;
+  uint8_t crc;
+};
+
+#if PARAMS_RUNTIME
+
+extern struct params params;
+extern struct params params_next;
+
+void params_init();
+uint8_t params_apply();
+void params_commit();
+void params_save();
+
+#else
+
+#define params_init()
+#define params_save()
+
+#endif /* PARAMS_RUNTIME */
+
+#endif /* PARAMS_H */
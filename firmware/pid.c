@@ -0,0 +1,93 @@
+/*
+* ----------------------------------------------------------------------------
+* "THE BEER-WARE LICENSE" (Revision 42):
+* <fakufaku@gmail.com> wrote this file. As long as you retain this notice you
+* can do whatever you want with this stuff. If we meet some day, and you think
+* this stuff is worth it, you can buy me a beer in return -- Robin Scheibler
+* ----------------------------------------------------------------------------
+*/
+
+#include "pid.h"
+
+#ifdef PID_TUNING
+// the gains and limits of the controller
+#define K_p (p->kp)
+#define K_i (p->ki)
+#define K_d (p->kd)
+#undef PWM_MIN
+#undef PWM_MAX
+#define PWM_MIN (p->pwm_min)
+#define PWM_MAX (p->pwm_max)
+
+void pid_tune(struct pid *p, float kp, float ki, float kd,
+    uint8_t pwm_min, uint8_t pwm_max)
+{
+  p->kp = kp;
+  p->ki = ki;
+  p->kd = kd;
+  p->pwm_min = pwm_min;
+  p->pwm_max = pwm_max;
+}
+#elif PARAMS_RUNTIME
+// set at run time, see params.h
+#define K_p (params.k_p)
+#define K_i (params.k_i)
+#define K_d (params.k_d)
+#elif CONFIG_CONTROLLER == CONTROLLER_PID
+// PID constants, folded in the code by the compiler
+static const float K_p = CONFIG_K_P;
+static const float K_i = CONFIG_K_I;
+static const float K_d = CONFIG_K_D;
+#endif
+
+void pid_reset(struct pid *p)
+{
+#if CONFIG_CONTROLLER == CONTROLLER_PID
+  p->ITerm = 0.0;
+  p->error_previous = 0.0;
+#endif
+}
+
+/*
+ * error is the set point minus the temperature, periods the control
+ * periods since the last error, returns the new duty cycle
+ */
+uint8_t pid_compute(struct pid *p, float error, uint8_t pwm_val,
+    uint8_t periods)
+{
+#if CONFIG_CONTROLLER == CONTROLLER_ONOFF
+  // full power below the set point, off above, hold in between
+  if (error > CONFIG_HYSTERESIS)
+    pwm_val = PWM_MAX;
+  else if (error < -CONFIG_HYSTERESIS)
+    pwm_val = 0;
+#else
+  // integral term (using trapeze method)
+  p->ITerm += (K_i * (periods * TIME_INTERVAL) * (error + p->error_previous)*0.5);
+  if (p->ITerm > PWM_MAX) 
+    p->ITerm = PWM_MAX;
+  else if (p->ITerm < PWM_MIN) 
+  {
+    p->ITerm = PWM_MIN;
+  }
+
+  // differential term
+  float dInput = (error - p->error_previous) * TIME_INTERVAL_INV / periods;
+
+  /*Compute PID Output*/
+  float output = K_p * error + p->ITerm + K_d * dInput;
+
+  // set PWM value
+  if (output > PWM_MAX)
+    pwm_val = PWM_MAX;
+  else if (output < PWM_MIN) 
+    pwm_val = 0.;
+  else
+    pwm_val = (uint8_t)output;
+
+  /*Remember some variables for next time*/
+  p->error_previous = error;
+#endif
+
+  return pwm_val;
+}
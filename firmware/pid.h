@@ -0,0 +1,61 @@
+/*
+ * Controller
+ * ==========
+ *
+ * The controller of one chamber, shared by incubalibre.c, multizone.c
+ * and the host simulations. CONFIG_CONTROLLER selects the PID or the
+ * on/off controller with hysteresis (see config.h).
+ *
+ * The output is the duty cycle of the relay over a control period,
+ * from 0 to PWM_MAX out of 256.
+ *
+ * The gains and limits are constants of config.h, or the runtime
+ * parameters of params.h with CONFIG_REMOTE or CONFIG_TWI. The host
+ * tuning tools build it with PID_TUNING, where each struct pid carries
+ * its own gains and limits.
+ */
+
+#ifndef PID_H
+#define PID_H
+
+#include <stdint.h>
+
+#include "config.h"
+
+// Time interval is 1MHz/16384/256
+#define TIME_INTERVAL 4.194304
+#define TIME_INTERVAL_INV 0.2384186
+
+// see config.h, or set at run time (params.h)
+#if CONFIG_REMOTE || CONFIG_TWI
+#include "params.h"
+#define PWM_MAX (params.pwm_max)
+#define PWM_MIN (params.pwm_min)
+#else
+#define PWM_MAX CONFIG_PWM_MAX
+#define PWM_MIN CONFIG_PWM_MIN
+#endif
+
+struct pid
+{
+#if CONFIG_CONTROLLER == CONTROLLER_PID
+  float ITerm;
+  float error_previous;
+#else
+  uint8_t unused;
+#endif
+#ifdef PID_TUNING
+  float kp, ki, kd;
+  uint8_t pwm_min, pwm_max;
+#endif
+};
+
+void pid_reset(struct pid *p);
+#ifdef PID_TUNING
+void pid_tune(struct pid *p, float kp, float ki, float kd,
+    uint8_t pwm_min, uint8_t pwm_max);
+#endif
+uint8_t pid_compute(struct pid *p, float error, uint8_t pwm_val,
+    uint8_t periods);
+
+#endif /* PID_H */
@@ -0,0 +1,4 @@
+/*
+ * Default profile: the original IncubaLibre board, look-up table,
+ * PID and slow PWM of the relay. Everything is left to config.h.
+ */
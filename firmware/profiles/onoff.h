@@ -0,0 +1,15 @@
+/*
+ * On/off profile: large boxes with a lot of thermal mass, where the
+ * relay is switched on or off for whole periods. The smallest build,
+ * no EEPROM calibration or trim, and the trimpot picks the set point.
+ */
+
+#define CONFIG_THERM_EEPROM     0
+#define CONFIG_TRIM             0
+#define CONFIG_CONTROLLER       CONTROLLER_ONOFF
+#define CONFIG_OUTPUT           OUTPUT_SIGMA_DELTA
+#define CONFIG_SETPOINT_TRIMPOT 1
+
+// measure every period: the hysteresis only switches on a measurement,
+// and the chamber overshoots further between sparse ones
+#define CONFIG_SAMPLE_MAX       1
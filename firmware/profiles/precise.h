@@ -0,0 +1,10 @@
+/*
+ * Precise profile: units calibrated one by one (EEPROM record and
+ * field trim), Steinhart-Hart conversion and a smoothed reading,
+ * computed at 8 MHz.
+ */
+
+#define CONFIG_THERM        THERM_SH
+#define CONFIG_FILTER       FILTER_EMA
+#define CONFIG_FILTER_ALPHA 0.25
+#define CONFIG_CLOCK_BURST  1
@@ -0,0 +1,94 @@
+/*
+* ----------------------------------------------------------------------------
+* "THE BEER-WARE LICENSE" (Revision 42):
+* <fakufaku@gmail.com> wrote this file. As long as you retain this notice you
+* can do whatever you want with this stuff. If we meet some day, and you think
+* this stuff is worth it, you can buy me a beer in return -- Robin Scheibler
+* ----------------------------------------------------------------------------
+*/
+
+#include "protect.h"
+#include "sensor.h"
+#include "supervisor.h"
+#include "thermistor.h"
+#include "trim.h"
+
+#if CONFIG_PROTECT
+
+#ifndef NOINIT
+#define NOINIT __attribute__((section(".noinit")))
+#endif
+
+// the latch survives the resets, the copy tells it from garbage
+static uint8_t fault NOINIT;
+static uint8_t fault_check NOINIT;
+
+// temperatures of the last ticks, in 1/100 C
+static int16_t history[PROTECT_RATE_TICKS];
+static uint8_t history_n;
+static uint8_t head;
+
+static uint8_t confirm;
+
+void protect_init(uint8_t warm)
+{
+  if (!warm || (uint8_t)~fault != fault_check)
+    fault = PROTECT_OK;
+  fault_check = ~fault;
+
+  history_n = 0;
+  head = 0;
+  confirm = 0;
+}
+
+uint8_t protect_fault()
+{
+  return fault;
+}
+
+// One reading of the thermistor per tick, returns the latched fault
+uint8_t protect_update(uint16_t adc)
+{
+  uint8_t now = PROTECT_OK;
+  int16_t t_c;
+  float t;
+
+  if (fault != PROTECT_OK)
+    return fault;
+
+  // an open or shorted thermistor is a fault of sensor.h
+  if (adc < SENSOR_ADC_MIN || adc > SENSOR_ADC_MAX)
+    return fault;
+
+  t = therm_convert(trim_apply(adc));
+
+  // NaN or out of any sensible range counts as over-temperature
+  if (!(t < CONFIG_PROTECT_TMAX))
+    now = PROTECT_OVER;
+
+  t_c = (t > 300. || t < -300.) ? 30000 : (int16_t)(t * 100.);
+
+  // the oldest temperature of the window is the one replaced
+  if (history_n == PROTECT_RATE_TICKS
+      && t_c - history[head] > (int16_t)(CONFIG_PROTECT_RATE * 100.
+        * SUPERVISOR_TICK * PROTECT_RATE_TICKS))
+    now = PROTECT_RISE;
+
+  history[head] = t_c;
+  if (++head == PROTECT_RATE_TICKS)
+    head = 0;
+  if (history_n < PROTECT_RATE_TICKS)
+    history_n++;
+
+  if (now == PROTECT_OK)
+    confirm = 0;
+  else if (++confirm >= PROTECT_CONFIRM)
+  {
+    fault = now;
+    fault_check = ~fault;
+  }
+
+  return fault;
+}
+
+#endif /* CONFIG_PROTECT */
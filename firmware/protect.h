@@ -0,0 +1,51 @@
+/*
+ * Over-temperature protection
+ * ===========================
+ *
+ * A second path, independent of the control period and of the PID,
+ * samples the thermistor at every watchdog tick (SUPERVISOR_TICK) and
+ * cuts the heater when the temperature is above CONFIG_PROTECT_TMAX,
+ * or rises faster than CONFIG_PROTECT_RATE C/s over the last
+ * PROTECT_RATE_TICKS ticks, for PROTECT_CONFIRM ticks in a row.
+ *
+ * The fault is latched until the power is removed, a warm reset keeps
+ * it. While latched the relay is off and LED2 blinks.
+ *
+ * The worst-case reaction time is measured by host/protect_sim: with
+ * a slow watchdog (0.6 s ticks) the heater is off within 1.4 s of the
+ * thermistor reaching the limit, any lag of the thermistor adds up.
+ */
+
+#ifndef PROTECT_H
+#define PROTECT_H
+
+#include <stdint.h>
+
+#include "config.h"
+
+// Fault classes
+#define PROTECT_OK   0
+#define PROTECT_OVER 1    // above CONFIG_PROTECT_TMAX
+#define PROTECT_RISE 2    // faster than CONFIG_PROTECT_RATE
+
+// One bad reading does not trip
+#define PROTECT_CONFIRM 2
+
+// Window of the rate of rise, 4 s
+#define PROTECT_RATE_TICKS 8
+
+#if CONFIG_PROTECT
+
+void protect_init(uint8_t warm);
+uint8_t protect_update(uint16_t adc);
+uint8_t protect_fault();
+
+#else
+
+#define protect_init(warm)
+#define protect_update(adc) PROTECT_OK
+#define protect_fault() PROTECT_OK
+
+#endif /* CONFIG_PROTECT */
+
+#endif /* PROTECT_H */
@@ -0,0 +1,66 @@
+/*
+ * Interrupt to main loop queue
+ * ============================
+ *
+ * A ring of records from the interrupts to the main loop, that neither
+ * side disables the interrupts for: the producer only writes head, the
+ * consumer only writes tail, and each is a single byte, read or written
+ * in one instruction on the AVR.
+ *
+ * The producer is the interrupt context. The interrupts do not nest
+ * (SIGNAL), so any of them can push to the same queue. The consumer is
+ * the main loop.
+ *
+ * The indices run freely and wrap at 256, head - tail is the number of
+ * records queued. The size must be a power of two, 128 at most.
+ *
+ *   QUEUE(struct sample, 4) samples;
+ *
+ *   // interrupt                     // main loop
+ *   if (!queue_full(&samples))       while (!queue_empty(&samples))
+ *   {                                {
+ *     *queue_back(&samples) = s;       use(queue_front(&samples));
+ *     queue_push(&samples);            queue_pop(&samples);
+ *   }                                }
+ */
+
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <stdint.h>
+
+// the compiler keeps the accesses to the records on their side of it
+#define QUEUE_BARRIER() __asm__ __volatile__ ("" ::: "memory")
+
+#define QUEUE(type, size) \
+  struct \
+  { \
+    volatile uint8_t head; \
+    volatile uint8_t tail; \
+    type item[size]; \
+  }
+
+#define QUEUE_SIZE(q) (sizeof((q)->item) / sizeof((q)->item[0]))
+
+// The slot of an index, the records are accessed after it is read
+static inline uint8_t queue_slot(volatile uint8_t *index, uint8_t size)
+{
+  uint8_t i = *index;
+
+  QUEUE_BARRIER();
+  return i & (size - 1);
+}
+
+#define queue_count(q) ((uint8_t)((q)->head - (q)->tail))
+#define queue_empty(q) (queue_count(q) == 0)
+#define queue_full(q)  (queue_count(q) == QUEUE_SIZE(q))
+
+// producer, the record is written before it is pushed
+#define queue_back(q)  (&(q)->item[queue_slot(&(q)->head, QUEUE_SIZE(q))])
+#define queue_push(q)  do { QUEUE_BARRIER(); (q)->head++; } while (0)
+
+// consumer, the record is done with before it is popped
+#define queue_front(q) (&(q)->item[queue_slot(&(q)->tail, QUEUE_SIZE(q))])
+#define queue_pop(q)   do { QUEUE_BARRIER(); (q)->tail++; } while (0)
+
+#endif /* QUEUE_H */
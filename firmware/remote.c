@@ -0,0 +1,455 @@
+/*
+* ----------------------------------------------------------------------------
+* "THE BEER-WARE LICENSE" (Revision 42):
+* <fakufaku@gmail.com> wrote this file. As long as you retain this notice you
+* can do whatever you want with this stuff. If we meet some day, and you think
+* this stuff is worth it, you can buy me a beer in return -- Robin Scheibler
+* ----------------------------------------------------------------------------
+*/
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include <util/crc16.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "remote.h"
+#include "params.h"
+#include "softuart.h"
+#include "sched.h"
+
+#if CONFIG_REMOTE
+
+#define TYPE_FLOAT 0
+#define TYPE_BYTE  1
+
+// the parameters of params.h that can be read and set
+struct field
+{
+  char name[5];
+  uint8_t offset;
+  uint8_t type;
+};
+
+static const struct field fields[] PROGMEM =
+{
+  { "kp",   offsetof(struct params, k_p),          TYPE_FLOAT },
+  { "ki",   offsetof(struct params, k_i),          TYPE_FLOAT },
+  { "kd",   offsetof(struct params, k_d),          TYPE_FLOAT },
+  { "sp1",  offsetof(struct params, setpoints[1]), TYPE_FLOAT },
+  { "sp2",  offsetof(struct params, setpoints[2]), TYPE_FLOAT },
+  { "sp3",  offsetof(struct params, setpoints[3]), TYPE_FLOAT },
+  { "pmin", offsetof(struct params, pwm_min),      TYPE_BYTE },
+  { "pmax", offsetof(struct params, pwm_max),      TYPE_BYTE },
+  { "id",   offsetof(struct params, id),           TYPE_BYTE },
+};
+
+#define N_FIELDS (sizeof(fields) / sizeof(fields[0]))
+
+// the line being received, REMOTE_LINE + 1 when it is too long
+static char line[REMOTE_LINE + 1];
+static uint8_t len = 0;
+
+// the line is in, for the main loop
+static volatile uint8_t line_ready = 0;
+
+// crc8 of the reply being sent
+static uint8_t reply_crc;
+
+void remote_init()
+{
+  softuart_init();
+
+  // the start bit is a pin change on the line
+  PCMSK |= (1 << SOFTUART_TX);
+  GIFR = (1 << PCIF);
+  GIMSK |= (1 << PCIE);
+}
+
+static uint8_t hex_digit(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return 0xFF;
+}
+
+static void reply_putc(char c)
+{
+  reply_crc = _crc_ibutton_update(reply_crc, c);
+  softuart_putc(c);
+}
+
+static void reply_puts_P(const char *s)
+{
+  char c;
+
+  while ((c = pgm_read_byte(s++)) != '\0')
+    reply_putc(c);
+}
+
+static void reply_putu(uint16_t v)
+{
+  char buf[5];
+  uint8_t n = 0;
+
+  do
+  {
+    buf[n++] = '0' + v % 10;
+    v /= 10;
+  } while (v);
+
+  while (n)
+    reply_putc(buf[--n]);
+}
+
+// Thousandths as a decimal number, no printf on the ATtiny85
+static void reply_put_milli(int32_t v)
+{
+  uint16_t frac;
+
+  if (v < 0)
+  {
+    reply_putc('-');
+    v = -v;
+  }
+  reply_putu(v / 1000);
+
+  frac = v % 1000;
+  reply_putc('.');
+  reply_putc('0' + frac / 100);
+  reply_putc('0' + frac / 10 % 10);
+  reply_putc('0' + frac % 10);
+}
+
+static void reply_start()
+{
+  reply_crc = 0;
+  reply_putu(params.id);
+  reply_putc(' ');
+}
+
+static char hex_char(uint8_t v)
+{
+  return v < 10 ? '0' + v : 'a' + v - 10;
+}
+
+static void reply_end()
+{
+  uint8_t crc = reply_crc;
+
+  softuart_putc('*');
+  softuart_putc(hex_char(crc >> 4));
+  softuart_putc(hex_char(crc & 0x0F));
+  softuart_putc('\n');
+}
+
+// Decimal number to thousandths, returns 0 when it is not one
+static uint8_t parse_milli(const char *s, int32_t *v)
+{
+  int32_t x = 0;
+  uint8_t neg = 0, point = 0, decimals = 0, digits = 0;
+
+  if (*s == '-')
+  {
+    neg = 1;
+    s++;
+  }
+
+  for (; *s != '\0'; s++)
+  {
+    if (*s == '.' && !point)
+    {
+      point = 1;
+      continue;
+    }
+    if (*s < '0' || *s > '9' || decimals == 3 || x > 9999999L)
+      return 0;
+    x = x * 10 + (*s - '0');
+    digits++;
+    decimals += point;
+  }
+  if (digits == 0)
+    return 0;
+
+  for (; decimals < 3; decimals++)
+    x *= 10;
+
+  *v = neg ? -x : x;
+  return 1;
+}
+
+// Cuts the next word off the line
+static char *next_word(char **s)
+{
+  char *w;
+
+  while (**s == ' ')
+    (*s)++;
+  w = *s;
+  while (**s != ' ' && **s != '\0')
+    (*s)++;
+  if (**s == ' ')
+    *(*s)++ = '\0';
+
+  return *w != '\0' ? w : NULL;
+}
+
+static const struct field *find_field(const char *name)
+{
+  uint8_t i;
+
+  for (i = 0; i < N_FIELDS; i++)
+    if (strcmp_P(name, fields[i].name) == 0)
+      return &fields[i];
+
+  return NULL;
+}
+
+// Replies REMOTE_DUMP bytes of EEPROM from an address, in hex
+static uint8_t dump(const char *address)
+{
+  uint8_t buf[REMOTE_DUMP];
+  int32_t v;
+  uint16_t a;
+  uint8_t i;
+
+  if (!parse_milli(address, &v) || v < 0 || v % 1000
+      || v > (E2END + 1L - REMOTE_DUMP) * 1000L)
+    return 0;
+  a = v / 1000;
+  eeprom_read_block(buf, (const void *)(size_t)a, REMOTE_DUMP);
+
+  reply_start();
+  reply_puts_P(PSTR("dump "));
+  reply_putu(a);
+  reply_putc(' ');
+  for (i = 0; i < REMOTE_DUMP; i++)
+  {
+    reply_putc(hex_char(buf[i] >> 4));
+    reply_putc(hex_char(buf[i] & 0x0F));
+  }
+  reply_end();
+  return 2;
+}
+
+#if SCHED_STATS
+// Replies the statistics of a task of sched.h
+static uint8_t task(const char *number)
+{
+  const struct task *t;
+  int32_t v;
+
+  if (!parse_milli(number, &v) || v < 0 || v % 1000
+      || v >= tasks_n * 1000L)
+    return 0;
+  t = &tasks[v / 1000];
+
+  reply_start();
+  reply_puts_P(PSTR("task "));
+  reply_putu(v / 1000);
+  reply_putc(' ');
+  reply_putu(t->runs);
+  reply_putc(' ');
+  reply_putu(t->late);
+  reply_putc(' ');
+  reply_putu(t->skipped);
+  reply_putc(' ');
+  reply_putu(t->response_max);
+  reply_end();
+  return 2;
+}
+#endif
+
+// params_apply(), away from the compare match that reads params
+static uint8_t apply(uint8_t commit)
+{
+  uint8_t ok;
+
+  cli();
+  ok = params_apply();
+  if (ok && commit)
+    params_commit();
+  sei();
+
+  return ok;
+}
+
+// Runs a command line, returns 1 for ok, 0 for err, 2 when already replied
+static uint8_t run(char *s)
+{
+  char *cmd = next_word(&s);
+  char *name = next_word(&s);
+  char *value = next_word(&s);
+  const struct field *f = NULL;
+  uint8_t offset = 0, type = 0;
+  int32_t v;
+  float x;
+
+  if (cmd == NULL || next_word(&s) != NULL)
+    return 0;
+
+  if (!strcmp_P(cmd, PSTR("dump")) && name != NULL && value == NULL)
+    return dump(name);
+
+#if SCHED_STATS
+  if (!strcmp_P(cmd, PSTR("task")) && name != NULL && value == NULL)
+    return task(name);
+#endif
+
+  if (name != NULL)
+  {
+    if ((f = find_field(name)) == NULL)
+      return 0;
+    offset = pgm_read_byte(&f->offset);
+    type = pgm_read_byte(&f->type);
+  }
+
+  if (!strcmp_P(cmd, PSTR("get")) && f != NULL && value == NULL)
+  {
+    reply_start();
+    reply_puts_P(f->name);
+    reply_putc(' ');
+    if (type == TYPE_FLOAT)
+    {
+      memcpy(&x, (uint8_t *)&params + offset, sizeof(x));
+      reply_put_milli((int32_t)(x * 1000. + (x < 0. ? -0.5 : 0.5)));
+    }
+    else
+      reply_putu(((uint8_t *)&params)[offset]);
+    reply_end();
+    return 2;
+  }
+
+  if (!strcmp_P(cmd, PSTR("set")) && f != NULL && value != NULL)
+  {
+    if (!parse_milli(value, &v))
+      return 0;
+    if (type == TYPE_BYTE && (v < 0 || v > 255000L || v % 1000))
+      return 0;
+    x = v / 1000.;
+
+    // the I2C slave writes params_next in the compare match as well
+    cli();
+    if (type == TYPE_FLOAT)
+      memcpy((uint8_t *)&params_next + offset, &x, sizeof(x));
+    else
+      ((uint8_t *)&params_next)[offset] = v / 1000;
+    sei();
+    return 1;
+  }
+
+  if (f != NULL)
+    return 0;
+
+  if (!strcmp_P(cmd, PSTR("apply")))
+    return apply(0);
+
+  if (!strcmp_P(cmd, PSTR("commit")))
+    return apply(1);
+
+  return 0;
+}
+
+// Checks the checksum and the address of a line and runs it
+static void command(char *s)
+{
+  char *star, *id;
+  uint8_t crc = 0, hi, lo, broadcast, result;
+  int32_t v;
+
+  // the checksum of the characters before the '*'
+  star = strrchr(s, '*');
+  if (star == NULL || star[1] == '\0' || star[2] == '\0' || star[3] != '\0')
+    return;
+  hi = hex_digit(star[1]);
+  lo = hex_digit(star[2]);
+  for (id = s; id < star; id++)
+    crc = _crc_ibutton_update(crc, *id);
+  if (hi > 0x0F || lo > 0x0F || crc != (hi << 4 | lo))
+    return;
+  *star = '\0';
+
+  // the address, this unit or all of them
+  if ((id = next_word(&s)) == NULL)
+    return;
+  broadcast = id[0] == '*' && id[1] == '\0';
+  if (!broadcast && (!parse_milli(id, &v) || v != params.id * 1000L))
+    return;
+
+  result = run(s);
+
+  if (!broadcast && result != 2)
+  {
+    reply_start();
+    if (result)
+      reply_puts_P(PSTR("ok"));
+    else
+      reply_puts_P(PSTR("err"));
+    reply_end();
+  }
+}
+
+// Runs the line received, if any, and replies
+void remote_poll()
+{
+  if (!line_ready)
+    return;
+
+  command(line);
+
+  // the interrupt takes the next line from now on
+  len = 0;
+  line_ready = 0;
+}
+
+uint8_t remote_pending()
+{
+  return line_ready;
+}
+
+// A byte of the line, the line goes to the main loop once it is in
+static void receive(uint8_t c)
+{
+  if (c == '\n')
+  {
+    if (len <= REMOTE_LINE)
+    {
+      line[len] = '\0';
+      line_ready = 1;
+    }
+    else
+      len = 0;
+  }
+  else if (c != '\r' && len <= REMOTE_LINE)
+  {
+    if (len < REMOTE_LINE)
+      line[len] = c;
+    len++;
+  }
+}
+
+// A start bit, or the rising edge after one
+SIGNAL(PCINT0_vect)
+{
+  uint8_t c;
+
+  if (PINB & (1 << SOFTUART_TX))
+    return;
+
+  c = softuart_getc();
+
+  // the bytes before the main loop took the line are dropped
+  if (!line_ready)
+    receive(c);
+
+  // the edges of the byte are not start bits
+  GIFR = (1 << PCIF);
+}
+
+#endif /* CONFIG_REMOTE */
@@ -0,0 +1,74 @@
+/*
+ * Remote configuration
+ * ====================
+ *
+ * With CONFIG_REMOTE, the gains, set points and duty cycle limits of
+ * params.h are read and set over the half-duplex serial line of
+ * softuart.h, at CONFIG_REMOTE_BAUD, without reflashing. The line is
+ * shared by the units on a bus, each answers to its own id.
+ *
+ * A command is a line of text closed by a checksum:
+ *
+ *   <id> get <name>*hh
+ *   <id> set <name> <value>*hh
+ *   <id> apply*hh
+ *   <id> commit*hh
+ *   <id> dump <address>*hh
+ *   <id> task <number>*hh
+ *
+ * hh is the crc8 of thermistor.h of the characters before '*', in hex.
+ * The id "*" addresses every unit, which then do not reply. A unit
+ * replies "<id> ok*hh", "<id> err*hh" or "<id> <name> <value>*hh".
+ * A line with a bad checksum gets no reply, the host retries.
+ *
+ * The names are kp, ki, kd, sp1, sp2, sp3, pmin, pmax and id; the
+ * values are decimal with up to 3 decimals. set changes params_next
+ * only, apply takes all the changes at once, commit also stores them
+ * in EEPROM (see params.h).
+ *
+ * dump replies "<id> dump <address> <hex>*hh", REMOTE_DUMP bytes of
+ * EEPROM from the decimal address, to read the history of history.h
+ * or the calibration records of a unit in the field.
+ *
+ * task replies "<id> task <number> <runs> <late> <skipped> <response>*hh",
+ * the statistics of a task of the main loop, the response in ticks of
+ * TIMER1 (see sched.h): whether the tasks keep their deadlines on a
+ * unit in the field.
+ *
+ * The bytes are received in the pin change interrupt, a line is
+ * handed to the main loop, remote_poll(), which runs the command and
+ * replies: the interrupts stay enabled between the bytes of a reply,
+ * and a dump reads the EEPROM where the history, the params and the
+ * energy counters are written. A byte that arrives while another
+ * interrupt runs, or before the main loop took the line before, is
+ * lost: the checksum then fails and the host retries.
+ */
+
+#ifndef REMOTE_H
+#define REMOTE_H
+
+#include "config.h"
+
+#if CONFIG_REMOTE
+
+// longest command line, without the '\n'
+#define REMOTE_LINE 31
+
+// EEPROM bytes in a dump reply
+#define REMOTE_DUMP 16
+
+void remote_init();
+
+// From the main loop, runs the line the interrupt received
+void remote_poll();
+uint8_t remote_pending();
+
+#else
+
+#define remote_init()
+#define remote_poll()
+#define remote_pending() 0
+
+#endif /* CONFIG_REMOTE */
+
+#endif /* REMOTE_H */
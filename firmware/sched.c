@@ -0,0 +1,142 @@
+/*
+* ----------------------------------------------------------------------------
+* "THE BEER-WARE LICENSE" (Revision 42):
+* <fakufaku@gmail.com> wrote this file. As long as you retain this notice you
+* can do whatever you want with this stuff. If we meet some day, and you think
+* this stuff is worth it, you can buy me a beer in return -- Robin Scheibler
+* ----------------------------------------------------------------------------
+*/
+
+#include <avr/io.h>
+#include <stddef.h>
+
+#include "sched.h"
+
+// overflows of TIMER1, the high byte of the time
+static volatile uint8_t cycles = 0;
+
+void sched_overflow()
+{
+  cycles++;
+}
+
+uint16_t sched_now()
+{
+  uint8_t c, hi, lo;
+
+  // an interrupt between the reads changes cycles, read again
+  do
+  {
+    c = cycles;
+    lo = TCNT1;
+    hi = c;
+
+    // an overflow the interrupt has not counted yet, when they are
+    // disabled
+    if ((TIFR & (1 << TOV1)) && lo < 0x80)
+      hi++;
+  }
+  while (c != cycles);
+
+  return (uint16_t)hi << 8 | lo;
+}
+
+void sched_start(struct task *tasks, uint8_t n)
+{
+  uint16_t now = sched_now();
+  uint8_t i;
+
+  for (i = 0; i < n; i++)
+    tasks[i].release = now;
+}
+
+#if SCHED_STATS
+static void count(uint16_t *c)
+{
+  if (*c != 0xFFFF)
+    (*c)++;
+}
+#else
+#define count(c) ((void)0)
+#endif
+
+// The task due with the earliest deadline, NULL when none is due
+static struct task *next_due(struct task *tasks, uint8_t n, uint16_t now)
+{
+  struct task *t, *next = NULL;
+  uint8_t i;
+
+  for (i = 0; i < n; i++)
+  {
+    t = &tasks[i];
+    if ((int16_t)(now - t->release) < 0)
+      continue;
+    if (next == NULL || (int16_t)(t->release + t->deadline
+          - next->release - next->deadline) < 0)
+      next = t;
+  }
+
+  return next;
+}
+
+static void done(struct task *t, uint16_t now)
+{
+#if SCHED_STATS
+  uint16_t response = now - t->release;
+
+  count(&t->runs);
+  if (response > t->deadline)
+    count(&t->late);
+  if (response > t->response_max)
+    t->response_max = response;
+#endif
+
+  // the releases already past are skipped
+  t->release += t->period;
+  while ((int16_t)(now - t->release) > 0)
+  {
+    t->release += t->period;
+    count(&t->skipped);
+  }
+}
+
+void sched_run(struct task *tasks, uint8_t n)
+{
+  struct task *t, *next = NULL;
+  uint16_t now;
+  uint8_t i;
+
+  while ((t = next_due(tasks, n, now = sched_now())) != NULL)
+  {
+    t->run();
+    done(t, sched_now());
+  }
+
+  for (i = 0; i < n; i++)
+    if (next == NULL
+        || (int16_t)(tasks[i].release - next->release) < 0)
+      next = &tasks[i];
+
+  // the overflow wakes the main loop for a release after it, a release
+  // passed in the meantime is seen by sched_due()
+  if (next != NULL && (next->release >> 8) == (now >> 8))
+  {
+    OCR1B = next->release & 0xFF;
+    TIFR = (1 << OCF1B);
+    TIMSK |= (1 << OCIE1B);
+  }
+  else
+    TIMSK &= ~(1 << OCIE1B);
+}
+
+uint8_t sched_due(const struct task *tasks, uint8_t n)
+{
+  uint16_t now = sched_now();
+  uint8_t i;
+
+  for (i = 0; i < n; i++)
+    if ((int16_t)(now - tasks[i].release) >= 0)
+      return 1;
+
+  return 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * Task scheduler
+ * ==============
+ *
+ * The work that needs no fixed place in the control period runs as
+ * tasks of the main loop, one after the other: a task runs to its end,
+ * and of the tasks due, the one with the earliest deadline goes first.
+ *
+ * The time counts the ticks of TIMER1, 16.4 ms, and its overflows,
+ * sched_overflow() in the overflow interrupt. There is no periodic
+ * tick: after the tasks due, the compare match B of TIMER1 is set to
+ * the next release when it falls before the overflow, else the
+ * overflow wakes the main loop. TIMER0 times the clock bursts and the
+ * serial line, it is stopped otherwise.
+ *
+ * A task is released every period and should complete within its
+ * deadline from the release. A task that falls a period behind skips
+ * the releases it missed instead of running them back to back.
+ *
+ * With SCHED_STATS, the counts of each task, 65535 at most:
+ *   runs
+ *   late     runs completed past the deadline
+ *   skipped  releases skipped
+ * and the longest time from a release to the completion, in ticks.
+ * They are read with the task command of the serial line (remote.h),
+ * and printed by the replay of host/.
+ *
+ * The times wrap after 18 minutes, periods and deadlines are shorter.
+ */
+
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+
+#include "config.h"
+#include "pid.h"
+
+// a count of TIMER1, in seconds
+#define SCHED_TICK (TIME_INTERVAL / 256)
+#define SCHED_TICKS(seconds) ((uint16_t)((seconds) / SCHED_TICK + 0.5))
+
+// the statistics, kept where they can be read
+#ifndef SCHED_STATS
+#define SCHED_STATS CONFIG_REMOTE
+#endif
+
+// a task released every period seconds, due deadline seconds after
+#define TASK(run, period, deadline) \
+  { run, SCHED_TICKS(period), SCHED_TICKS(deadline), 0 }
+
+struct task
+{
+  void (*run)();
+  uint16_t period;          // ticks
+  uint16_t deadline;
+  uint16_t release;         // the next one
+
+#if SCHED_STATS
+  uint16_t runs;
+  uint16_t late;
+  uint16_t skipped;
+  uint16_t response_max;    // ticks
+#endif
+};
+
+// the tasks of the main loop, in incubalibre.c
+extern struct task tasks[];
+extern const uint8_t tasks_n;
+
+// From the overflow interrupt of TIMER1
+void sched_overflow();
+
+uint16_t sched_now();
+
+// Releases all the tasks now
+void sched_start(struct task *tasks, uint8_t n);
+
+// Runs the tasks due and sets the wake up for the next release
+void sched_run(struct task *tasks, uint8_t n);
+
+// 1 when a task is due, with the interrupts disabled as well
+uint8_t sched_due(const struct task *tasks, uint8_t n);
+
+#endif /* SCHED_H */
@@ -0,0 +1,77 @@
+/*
+* ----------------------------------------------------------------------------
+* "THE BEER-WARE LICENSE" (Revision 42):
+* <fakufaku@gmail.com> wrote this file. As long as you retain this notice you
+* can do whatever you want with this stuff. If we meet some day, and you think
+* this stuff is worth it, you can buy me a beer in return -- Robin Scheibler
+* ----------------------------------------------------------------------------
+*/
+
+#include <math.h>
+
+#include "sensor.h"
+
+#if CONFIG_SENSOR_CHECK
+
+void sensor_init(struct sensor *s)
+{
+  s->fault = SENSOR_OK;
+  s->latched = SENSOR_OK;
+  s->repeat = 0;
+  s->have_last = 0;
+  s->stuck = 0;
+}
+
+/*
+ * adc is the raw reading, t its temperature and heating tells that
+ * the heater ran at full power over the period.
+ * Returns the fault of this reading, or the latched one.
+ */
+uint8_t sensor_check(struct sensor *s, uint16_t adc, float t, uint8_t heating)
+{
+  uint8_t now = SENSOR_OK;
+
+  if (s->latched != SENSOR_OK)
+    return s->latched;
+
+  if (adc < SENSOR_ADC_MIN)
+    now = SENSOR_OPEN;
+  else if (adc > SENSOR_ADC_MAX)
+    now = SENSOR_SHORT;
+  else if (s->have_last)
+  {
+    if (fabs(t - s->t_last) > CONFIG_SENSOR_JUMP)
+      now = SENSOR_JUMP;
+    else if (adc == s->adc_last && (heating || s->stuck >= SENSOR_STUCK_N))
+    {
+      // once stuck, the heater stays off until the reading moves
+      if (s->stuck < SENSOR_STUCK_N)
+        s->stuck++;
+      if (s->stuck >= SENSOR_STUCK_N)
+        now = SENSOR_STUCK;
+    }
+    else
+      s->stuck = 0;
+  }
+
+  if (now == SENSOR_OK)
+  {
+    s->have_last = 1;
+    s->t_last = t;
+    s->adc_last = adc;
+    s->repeat = 0;
+  }
+  else if (now != SENSOR_STUCK && ++s->repeat >= SENSOR_LATCH)
+    s->latched = now;
+
+  s->fault = now;
+
+  return now;
+}
+
+uint8_t sensor_fault(struct sensor *s)
+{
+  return s->latched != SENSOR_OK ? s->latched : s->fault;
+}
+
+#endif /* CONFIG_SENSOR_CHECK */
@@ -0,0 +1,77 @@
+/*
+ * Sensor health
+ * =============
+ *
+ * Every reading of the thermistor, each control period or every few
+ * of them in steady state (see control.h), is checked before it
+ * reaches the filter and the PID:
+ *
+ *   open   the reading is below SENSOR_ADC_MIN (-29 C), the thermistor
+ *          is on the supply side of the divider
+ *   short  the reading is above SENSOR_ADC_MAX (126 C)
+ *   jump   the temperature moved more than CONFIG_SENSOR_JUMP since
+ *          the last good reading, a loose contact
+ *   stuck  the reading did not change by a single code during
+ *          SENSOR_STUCK_N periods at full power
+ *
+ * A faulty reading holds the heater off and the PID for the period it
+ * was taken in, and measures every period from then on. A fault that
+ * lasts SENSOR_LATCH periods in a row is latched until the power is
+ * removed. A stuck reading is not: a box too weak for its set point
+ * sits at full power on a quiet reading as well, it holds the heater
+ * off until the reading moves, which a cooling chamber does and a
+ * stuck thermistor does not. The class of the fault is shown on the
+ * LEDs (see show_faults() in incubalibre.c).
+ *
+ * The state of the checks of one thermistor is a struct sensor.
+ *
+ * host/sensor_sim injects each of the faults.
+ */
+
+#ifndef SENSOR_H
+#define SENSOR_H
+
+#include <stdint.h>
+
+#include "config.h"
+
+// Fault classes
+#define SENSOR_OK    0
+#define SENSOR_OPEN  1
+#define SENSOR_SHORT 2
+#define SENSOR_JUMP  3
+#define SENSOR_STUCK 4
+
+// Plausible raw readings
+#define SENSOR_ADC_MIN 32
+#define SENSOR_ADC_MAX 960
+
+#define SENSOR_LATCH 3
+#define SENSOR_STUCK_N 15   // about a minute
+
+#if CONFIG_SENSOR_CHECK
+
+struct sensor
+{
+  uint8_t fault;          // of the last reading
+  uint8_t latched;
+  uint8_t repeat;
+  uint8_t have_last;      // last good reading
+  float t_last;
+  uint16_t adc_last;
+  uint8_t stuck;
+};
+
+void sensor_init(struct sensor *s);
+uint8_t sensor_check(struct sensor *s, uint16_t adc, float t, uint8_t heating);
+uint8_t sensor_fault(struct sensor *s);
+
+#else
+
+#define sensor_init(s)
+#define sensor_check(s, adc, t, heating) SENSOR_OK
+#define sensor_fault(s) SENSOR_OK
+
+#endif /* CONFIG_SENSOR_CHECK */
+
+#endif /* SENSOR_H */
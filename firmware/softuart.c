@@ -0,0 +1,139 @@
+/*
+* ----------------------------------------------------------------------------
+* "THE BEER-WARE LICENSE" (Revision 42):
+* <fakufaku@gmail.com> wrote this file. As long as you retain this notice you
+* can do whatever you want with this stuff. If we meet some day, and you think
+* this stuff is worth it, you can buy me a beer in return -- Robin Scheibler
+* ----------------------------------------------------------------------------
+*/
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "softuart.h"
+
+#if SOFTUART_BIT_TICKS > 255
+#error "SOFTUART_BAUD too low for F_CPU"
+#endif
+
+#ifdef SOFTUART_RX
+#define TX_ENABLE()  DDRB |= (1 << SOFTUART_TX)
+#define TX_DISABLE() DDRB &= ~(1 << SOFTUART_TX)
+#else
+#define TX_ENABLE()
+#define TX_DISABLE()
+#endif
+
+void softuart_init()
+{
+  // idle line is high, driven or pulled up
+  PORTB |= (1 << SOFTUART_TX);
+  TX_DISABLE();
+#ifndef SOFTUART_RX
+  DDRB |= (1 << SOFTUART_TX);
+#endif
+}
+
+// TIMER0 in CTC mode at clk/1, one compare match per bit
+static uint8_t timer_start(uint8_t first)
+{
+  uint8_t prr = PRR;
+
+  PRR &= ~(1 << PRTIM0);
+  TCCR0A = (1 << WGM01);
+  OCR0A = SOFTUART_BIT_TICKS;
+  TCNT0 = first;
+  TIFR = (1 << OCF0A);
+  TCCR0B = (1 << CS00);
+
+  return prr;
+}
+
+static void timer_stop(uint8_t prr)
+{
+  TCCR0B = 0;
+  PRR = prr;
+}
+
+static void timer_wait()
+{
+  while (!(TIFR & (1 << OCF0A)))
+    ;
+  TIFR = (1 << OCF0A);
+}
+
+void softuart_putc(char c)
+{
+  // start bit, 8 data bits LSB first, stop bit
+  uint16_t frame = ((uint16_t)(uint8_t)c << 1) | 0x200;
+  uint8_t i, prr;
+  uint8_t saved_sreg = SREG;
+
+  cli();
+  prr = timer_start(0);
+  TX_ENABLE();
+
+  for (i = 0; i < 10; i++)
+  {
+    if (frame & 1)
+      PORTB |= (1 << SOFTUART_TX);
+    else
+      PORTB &= ~(1 << SOFTUART_TX);
+    frame >>= 1;
+
+    timer_wait();
+  }
+
+  TX_DISABLE();
+  timer_stop(prr);
+#ifdef SOFTUART_RX
+  // the edges we sent are not a start bit
+  GIFR = (1 << PCIF);
+#endif
+
+  SREG = saved_sreg;
+}
+
+#ifdef SOFTUART_RX
+/*
+ * Called on the falling edge of the start bit, with the interrupts
+ * disabled. Samples the middle of the bits, returns in the stop bit.
+ */
+uint8_t softuart_getc()
+{
+  uint8_t c = 0, i, prr;
+
+  // half a bit to the middle of the start bit, less the latency
+  prr = timer_start(SOFTUART_BIT_TICKS / 2 + SOFTUART_RX_LATENCY);
+  timer_wait();
+
+  for (i = 0; i < 8; i++)
+  {
+    timer_wait();
+    c >>= 1;
+    if (PINB & (1 << SOFTUART_TX))
+      c |= 0x80;
+  }
+
+  // the middle of the stop bit
+  timer_wait();
+  timer_stop(prr);
+
+  return c;
+}
+#endif
+
+void softuart_putu(uint16_t v)
+{
+  char buf[5];
+  uint8_t n = 0;
+
+  do
+  {
+    buf[n++] = '0' + v % 10;
+    v /= 10;
+  } while (v);
+
+  while (n)
+    softuart_putc(buf[--n]);
+}
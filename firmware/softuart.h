@@ -0,0 +1,54 @@
+/*
+ * Software UART
+ * =============
+ *
+ * 8N1, bit timing from TIMER0 in CTC mode so that it does not depend
+ * on the code between bits. Interrupts are disabled for the duration
+ * of a byte (~1 ms at 9600 baud). TIMER0 only runs during a byte, the
+ * 8 MHz bursts of clock.h can use it in between.
+ *
+ * The ATtiny85 has no spare pin, TX shares PB4 with LED2 by default.
+ *
+ * With SOFTUART_RX, the line is half-duplex on the TX pin: an input
+ * with the pull-up while idle, driven only while sending. The caller
+ * detects the start bit (a pin change interrupt) and calls
+ * softuart_getc() right away.
+ */
+
+#ifndef SOFTUART_H
+#define SOFTUART_H
+
+#include <stdint.h>
+
+#include "config.h"
+
+#if CONFIG_REMOTE
+// the half-duplex line of remote.h
+#define SOFTUART_BAUD CONFIG_REMOTE_BAUD
+#define SOFTUART_RX
+#endif
+
+#ifndef SOFTUART_BAUD
+#define SOFTUART_BAUD 9600
+#endif
+
+#ifndef SOFTUART_TX
+#define SOFTUART_TX PB4
+#endif
+
+// cycles from the falling edge of the start bit to softuart_getc()
+#ifndef SOFTUART_RX_LATENCY
+#define SOFTUART_RX_LATENCY 40
+#endif
+
+// TIMER0 at clk/1, must fit in 8 bits
+#define SOFTUART_BIT_TICKS ((F_CPU + SOFTUART_BAUD / 2) / SOFTUART_BAUD - 1)
+
+void softuart_init();
+void softuart_putc(char c);
+void softuart_putu(uint16_t v);
+#ifdef SOFTUART_RX
+uint8_t softuart_getc();
+#endif
+
+#endif /* SOFTUART_H */
@@ -0,0 +1,109 @@
+/*
+* ----------------------------------------------------------------------------
+* "THE BEER-WARE LICENSE" (Revision 42):
+* <fakufaku@gmail.com> wrote this file. As long as you retain this notice you
+* can do whatever you want with this stuff. If we meet some day, and you think
+* this stuff is worth it, you can buy me a beer in return -- Robin Scheibler
+* ----------------------------------------------------------------------------
+*/
+
+#include <avr/io.h>
+#include <avr/wdt.h>
+#include <string.h>
+
+#include "supervisor.h"
+#include "thermistor.h"
+
+#if CONFIG_WATCHDOG
+
+#define SNAPSHOT_MAGIC 0x53   // 'S'
+
+struct snapshot
+{
+  uint8_t magic;
+  uint8_t len;
+  uint8_t restarts;
+  uint8_t data[SUPERVISOR_SNAPSHOT_MAX];
+  uint8_t crc;
+};
+
+// survives the resets, not the power cycles
+static struct snapshot snapshot __attribute__((section(".noinit")));
+
+static uint8_t warm;
+
+// watchdog ticks since the last completed control period, and since
+// the last pass of the main loop
+static uint8_t stall;
+static volatile uint8_t stall_loop;
+
+/*
+ * Must run first in main(): after a watchdog reset the watchdog stays
+ * enabled with its shortest timeout until WDRF is cleared.
+ * Returns 1 after a reset that is not a power-on.
+ */
+uint8_t supervisor_init()
+{
+  uint8_t mcusr = MCUSR;
+
+  MCUSR = 0;
+  wdt_disable();
+
+  warm = !(mcusr & (1 << PORF))
+    && (mcusr & ((1 << WDRF) | (1 << BORF) | (1 << EXTRF)));
+
+  return warm;
+}
+
+void supervisor_start()
+{
+  // SUPERVISOR_TICK
+  wdt_enable(WDTO_500MS);
+  WDTCR |= (1 << WDIE);
+}
+
+// From the watchdog interrupt, the timeout cleared WDIE
+void supervisor_tick()
+{
+  if (++stall < SUPERVISOR_STALL_TICKS
+      && ++stall_loop < SUPERVISOR_STALL_TICKS)
+    WDTCR |= (1 << WDIE);
+}
+
+// From the main loop, after its stages
+void supervisor_alive()
+{
+  stall_loop = 0;
+}
+
+// Save the state of a completed control period
+void supervisor_checkpoint(const void *data, uint8_t len)
+{
+  snapshot.magic = SNAPSHOT_MAGIC;
+  snapshot.len = len;
+  snapshot.restarts = 0;
+  memcpy(snapshot.data, data, len);
+  snapshot.crc = crc8(&snapshot, sizeof(snapshot) - 1);
+
+  stall = 0;
+}
+
+// Copy the snapshot to data after a warm reset, returns 1 if it is valid
+uint8_t supervisor_resume(void *data, uint8_t len)
+{
+  if (!warm
+      || snapshot.magic != SNAPSHOT_MAGIC
+      || snapshot.len != len
+      || crc8(&snapshot, sizeof(snapshot) - 1) != snapshot.crc
+      || snapshot.restarts >= SUPERVISOR_MAX_RESTARTS)
+    return 0;
+
+  memcpy(data, snapshot.data, len);
+
+  snapshot.restarts++;
+  snapshot.crc = crc8(&snapshot, sizeof(snapshot) - 1);
+
+  return 1;
+}
+
+#endif /* CONFIG_WATCHDOG */
@@ -0,0 +1,62 @@
+/*
+ * Supervisor
+ * ==========
+ *
+ * The watchdog runs in interrupt and reset mode with a short timeout,
+ * SUPERVISOR_TICK. Each timeout raises the interrupt (the tick of the
+ * over-temperature protection, see protect.h) and disarms it, so that
+ * the next timeout resets the MCU. supervisor_tick() arms it again as
+ * long as a control period completed within SUPERVISOR_STALL_TICKS,
+ * and the main loop went through its stages within as many ticks: the
+ * writes to EEPROM and the tasks run there (see sched.h), a hang of
+ * the main loop resets the MCU as well. When the interrupts stay
+ * disabled nothing arms it at all.
+ *
+ * At the end of each control period a snapshot of the control state
+ * is saved in a part of SRAM that is not cleared at reset (.noinit),
+ * protected by a CRC.
+ *
+ * After a reset that is not a power-on (watchdog, brown-out, reset
+ * pin), the firmware resumes from the snapshot instead of warming up
+ * from scratch. A snapshot is used at most SUPERVISOR_MAX_RESTARTS
+ * times in a row without a control period completing in between, so
+ * that a snapshot that itself crashes the firmware is dropped.
+ */
+
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+#include <stdint.h>
+
+#include "config.h"
+
+// struct checkpoint of incubalibre.c, 28 bytes on the host with the
+// lid of control.h and the sigma-delta output
+#define SUPERVISOR_SNAPSHOT_MAX 28
+#define SUPERVISOR_MAX_RESTARTS 3
+
+// Watchdog interrupt period in seconds, and ~two control periods
+#define SUPERVISOR_TICK 0.5
+#define SUPERVISOR_STALL_TICKS 16
+
+#if CONFIG_WATCHDOG
+
+uint8_t supervisor_init();
+void supervisor_start();
+void supervisor_tick();
+void supervisor_alive();
+void supervisor_checkpoint(const void *data, uint8_t len);
+uint8_t supervisor_resume(void *data, uint8_t len);
+
+#else
+
+#define supervisor_init() 0
+#define supervisor_start()
+#define supervisor_tick()
+#define supervisor_alive()
+#define supervisor_checkpoint(data, len)
+#define supervisor_resume(data, len) 0
+
+#endif /* CONFIG_WATCHDOG */
+
+#endif /* SUPERVISOR_H */
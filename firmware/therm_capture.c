@@ -0,0 +1,56 @@
+/*
+* ----------------------------------------------------------------------------
+* "THE BEER-WARE LICENSE" (Revision 42):
+* <fakufaku@gmail.com> wrote this file. As long as you retain this notice you
+* can do whatever you want with this stuff. If we meet some day, and you think
+* this stuff is worth it, you can buy me a beer in return -- Robin Scheibler
+* ----------------------------------------------------------------------------
+*/
+
+/*
+ * Thermistor capture
+ * ==================
+ *
+ * Calibration firmware. The relay stays off and LED1 on, and the raw
+ * 10-bit thermistor readings are streamed on the software UART (PB4,
+ * 9600 8N1) as fast as the line allows, about 90 lines per second:
+ *
+ *   <sequence number> <adc>\n
+ *
+ * The sequence number wraps at 65536 and lets the host detect lost
+ * lines. ThermistorCalibration/capture.py records the stream and pairs
+ * it with the log of a reference thermometer into a calibration file.
+ *
+ * > make NAME=therm_capture avrdude
+ */
+
+#include <avr/io.h>
+
+#include "softuart.h"
+
+int main()
+{
+  uint16_t seq = 0;
+
+  // relay off, LED1 on to tell we are not regulating
+  DDRB = (1 << PB1) | (1 << PB0);
+  PORTB = (1 << PB1) | (1 << PB0);
+
+  softuart_init();
+
+  // ADC enabled, prescaled clk/16, ADC3 right adjusted
+  ADCSRA = (1 << ADEN) | (1 << ADPS2);
+  ADMUX = (1 << MUX1) | (1 << MUX0);
+
+  while (1)
+  {
+    ADCSRA |= (1 << ADSC);
+    while (ADCSRA & (1 << ADSC))
+      ;
+
+    softuart_putu(seq++);
+    softuart_putc(' ');
+    softuart_putu(ADC);
+    softuart_putc('\n');
+  }
+}
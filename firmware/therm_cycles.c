@@ -0,0 +1,96 @@
+/*
+* ----------------------------------------------------------------------------
+* "THE BEER-WARE LICENSE" (Revision 42):
+* <fakufaku@gmail.com> wrote this file. As long as you retain this notice you
+* can do whatever you want with this stuff. If we meet some day, and you think
+* this stuff is worth it, you can buy me a beer in return -- Robin Scheibler
+* ----------------------------------------------------------------------------
+*/
+
+/*
+ * Thermistor conversion cycle count
+ * =================================
+ *
+ * Times therm_convert() for every ADC code with TIMER0 running at the
+ * CPU clock and stores the results in EEPROM at EE_BENCH:
+ *
+ *   uint32_t total cycles for the 1024 codes
+ *   uint16_t min cycles
+ *   uint16_t max cycles
+ *
+ * LED1 turns on when done. Build, flash and read back with
+ *
+ * > make NAME=therm_cycles PROFILE=default avrdude
+ * > make rbench
+ *
+ * The counts include the call, the TIMER0 overflow interrupts and
+ * about 10 cycles of measurement overhead.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+
+#include "thermistor.h"
+#include "eeprom_map.h"
+
+volatile uint16_t overflows = 0;
+volatile float sink;
+
+SIGNAL(TIMER0_OVF_vect)
+{
+  overflows++;
+}
+
+int main()
+{
+  uint32_t total = 0;
+  uint16_t min = 0xFFFF, max = 0;
+  uint16_t adc, cycles;
+
+  therm_init();
+
+  DDRB = (1 << PB0);
+
+  // TIMER0 at clk/1
+  TCCR0A = 0;
+  TCCR0B = (1 << CS00);
+  TIMSK |= (1 << TOIE0);
+  sei();
+
+  for (adc = 0; adc < THERM_ADC_N; adc++)
+  {
+    cli();
+    overflows = 0;
+    TCNT0 = 0;
+    TIFR = (1 << TOV0);
+    sei();
+
+    sink = therm_convert(adc);
+
+    cli();
+    cycles = TCNT0;
+    // an overflow pending before the read, not one just after it
+    if ((TIFR & (1 << TOV0)) && cycles < 0x80)
+      overflows++;
+    cycles += overflows << 8;
+    sei();
+
+    total += cycles;
+    if (cycles < min)
+      min = cycles;
+    if (cycles > max)
+      max = cycles;
+  }
+
+  eeprom_update_block(&total, (void *)EE_BENCH, sizeof(total));
+  eeprom_update_block(&min, (void *)(EE_BENCH + 4), sizeof(min));
+  eeprom_update_block(&max, (void *)(EE_BENCH + 6), sizeof(max));
+
+  PORTB |= (1 << PB0);
+
+  while (1)
+  {
+
+  }
+}
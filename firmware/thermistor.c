@@ -0,0 +1,228 @@
+/*
+* ----------------------------------------------------------------------------
+* "THE BEER-WARE LICENSE" (Revision 42):
+* <fakufaku@gmail.com> wrote this file. As long as you retain this notice you
+* can do whatever you want with this stuff. If we meet some day, and you think
+* this stuff is worth it, you can buy me a beer in return -- Robin Scheibler
+* ----------------------------------------------------------------------------
+*/
+
+#include <avr/pgmspace.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include <math.h>
+
+#include "config.h"
+#include "thermistor.h"
+#include "eeprom_map.h"
+
+#define ZERO_CELSIUS 273.15
+
+#if CONFIG_THERM == THERM_SH
+
+/*
+ * Fixed-point Steinhart-Hart
+ * --------------------------
+ *
+ * With x = ln(R_T), 1/T = a + x * (b + c * x^2) is evaluated with 16x16
+ * and 32x16 bit integer multiplies only:
+ *
+ *   x      Q11  int16, ln(R_T) spans -0.4 to 15 over the ADC range
+ *   x^2    Q7   int16
+ *   a      Q36  int32
+ *   b      Q41  int32, fits for |b| < 9.7e-4
+ *   c      Q50  int32, fits for |c| < 1.9e-6
+ *   1/T    Q36  int32
+ *
+ * ln(R_T) = ln(R2) + ln(2) * (log2(2N - 2 adc - 1) - log2(2 adc + 1))
+ * where log2 is a normalization followed by a quartic polynomial
+ * accurate to 2e-4. A single 32 bit division gives T in Q8.
+ * The error against the floating point equation stays under 0.025 C
+ * from 0 to 100 C (see host/therm_bench.c), well below the 0.4 C step
+ * of the look-up table.
+ */
+
+// Fitted on ThermistorCalibration/data.txt, used without EEPROM record
+#define THERM_SH_A  1.30598061e-03
+#define THERM_SH_B  2.62708333e-04
+#define THERM_SH_C  -9.97425762e-09
+#define THERM_SH_R2 1500.
+
+// log2(1 + f) = f * (C1 + f * (C2 + f * (C3 + f * C4))), Q15
+#define LOG2_C1 47138
+#define LOG2_C2 -22220
+#define LOG2_C3 10605
+#define LOG2_C4 -2762
+
+#define LN2_Q15 22713
+#define ZERO_CELSIUS_Q8 69926
+
+static int32_t sh_a;      // Q36
+static int32_t sh_b;      // Q41
+static int32_t sh_c;      // Q50
+static int16_t sh_lnR2;   // Q11
+
+// (a * b) >> 16 using only 16x16 bit multiplies
+static int32_t mulhi(int32_t a, int16_t b)
+{
+  int16_t hi = a >> 16;
+  uint16_t lo = a & 0xFFFF;
+
+  return (int32_t)hi * b + (((int32_t)lo * b) >> 16);
+}
+
+// log2(v) in Q12, v > 0
+static uint16_t log2_q12(uint16_t v)
+{
+  uint8_t e = 15;
+  int32_t f, p;
+
+  // normalize so that v = 2^e * (1 + f)
+  while (!(v & 0x8000))
+  {
+    v <<= 1;
+    e--;
+  }
+  f = v & 0x7FFF;
+
+  p = LOG2_C4;
+  p = LOG2_C3 + ((p * f) >> 15);
+  p = LOG2_C2 + ((p * f) >> 15);
+  p = LOG2_C1 + ((p * f) >> 15);
+  p = (p * f) >> 15;
+
+  return ((uint16_t)e << 12) + ((p + 4) >> 3);
+}
+
+static void sh_load(float a, float b, float c, float R2)
+{
+  sh_a = a * 68719476736.;        // 2^36
+  sh_b = b * 2199023255552.;      // 2^41
+  sh_c = c * 1125899906842624.;   // 2^50
+  sh_lnR2 = ((uint32_t)log2_q12(R2 + 0.5) * LN2_Q15 + 32768) >> 16;
+}
+
+#else
+
+// Look-up table of Thermistor values
+const float therm_lut[] PROGMEM = { -66.89, -53.98, -47.36, -42.76, -39.19, -36.24, -33.71, -31.49, -29.51, -27.72, 
+  -26.07, -24.55, -23.14, -21.81, -20.56, -19.37, -18.25, -17.17, -16.15, -15.17, 
+  -14.22, -13.31, -12.43, -11.58, -10.76, -9.96, -9.18, -8.43, -7.69, -6.97, 
+  -6.27, -5.59, -4.92, -4.26, -3.62, -2.99, -2.37, -1.77, -1.17, -0.59, 
+  -0.01, 0.56, 1.12, 1.67, 2.21, 2.75, 3.27, 3.80, 4.31, 4.82, 
+  5.32, 5.82, 6.31, 6.80, 7.28, 7.76, 8.23, 8.70, 9.16, 9.62, 
+  10.08, 10.53, 10.98, 11.42, 11.86, 12.30, 12.74, 13.17, 13.60, 14.03, 
+  14.45, 14.88, 15.30, 15.71, 16.13, 16.54, 16.95, 17.36, 17.77, 18.18, 
+  18.58, 18.98, 19.38, 19.78, 20.18, 20.58, 20.98, 21.37, 21.76, 22.16, 
+  22.55, 22.94, 23.33, 23.72, 24.11, 24.49, 24.88, 25.27, 25.65, 26.04, 
+  26.42, 26.81, 27.19, 27.58, 27.96, 28.35, 28.73, 29.11, 29.50, 29.88, 
+  30.26, 30.65, 31.03, 31.42, 31.80, 32.19, 32.57, 32.96, 33.34, 33.73, 
+  34.12, 34.51, 34.89, 35.28, 35.67, 36.06, 36.46, 36.85, 37.24, 37.64, 
+  38.03, 38.43, 38.83, 39.23, 39.63, 40.03, 40.44, 40.84, 41.25, 41.66, 
+  42.07, 42.48, 42.89, 43.31, 43.72, 44.14, 44.56, 44.99, 45.41, 45.84, 
+  46.27, 46.70, 47.14, 47.57, 48.01, 48.46, 48.90, 49.35, 49.80, 50.26, 
+  50.71, 51.17, 51.64, 52.11, 52.58, 53.05, 53.53, 54.01, 54.50, 54.99, 
+  55.49, 55.99, 56.49, 57.00, 57.51, 58.03, 58.55, 59.08, 59.62, 60.16, 
+  60.70, 61.26, 61.82, 62.38, 62.95, 63.53, 64.12, 64.71, 65.31, 65.92, 
+  66.54, 67.16, 67.79, 68.44, 69.09, 69.75, 70.43, 71.11, 71.80, 72.51, 
+  73.23, 73.96, 74.70, 75.46, 76.23, 77.02, 77.82, 78.64, 79.47, 80.32, 
+  81.20, 82.09, 83.00, 83.93, 84.89, 85.87, 86.87, 87.90, 88.96, 90.06, 
+  91.18, 92.34, 93.53, 94.76, 96.04, 97.35, 98.72, 100.14, 101.61, 103.14, 
+  104.74, 106.41, 108.16, 110.00, 111.92, 113.95, 116.10, 118.38, 120.80, 123.39, 
+  126.16, 129.15, 132.39, 135.93, 139.81, 144.12, 148.94, 154.41, 160.71, 168.12, 
+  177.05, 188.24, 202.99, 224.20, 260.13, 630.92 };
+
+#endif /* CONFIG_THERM */
+
+// The calibration in use, loaded from EEPROM at boot
+static struct therm_cal cal;
+
+uint8_t crc8(const void *data, uint8_t len)
+{
+  const uint8_t *p = (const uint8_t *)data;
+  uint8_t crc = 0;
+
+  while (len--)
+    crc = _crc_ibutton_update(crc, *p++);
+
+  return crc;
+}
+
+void therm_init()
+{
+#if CONFIG_THERM_EEPROM
+  eeprom_read_block(&cal, (const void *)EE_THERM_CAL, sizeof(cal));
+
+  // an erased EEPROM reads 0xFF everywhere and fails the magic test
+  if (cal.magic != THERM_CAL_MAGIC 
+      || cal.version != THERM_CAL_VERSION
+      || crc8(&cal, sizeof(cal) - 1) != cal.crc)
+#endif
+    cal.kind = THERM_CAL_NONE;
+
+#if CONFIG_THERM == THERM_SH
+  if (cal.kind == THERM_CAL_SH)
+    sh_load(cal.a, cal.b, cal.c, cal.R2);
+  else
+    sh_load(THERM_SH_A, THERM_SH_B, THERM_SH_C, THERM_SH_R2);
+#endif
+}
+
+uint8_t therm_cal_kind()
+{
+  return cal.kind;
+}
+
+#if CONFIG_THERM == THERM_SH
+
+float therm_convert(uint16_t adc)
+{
+  int16_t x, x2;
+  int32_t d, y;
+  int32_t t;
+
+  // ln(R_T) in Q11, with the same bin centering as the table
+  d = (int32_t)log2_q12(2 * THERM_ADC_N - 2 * adc - 1) - log2_q12(2 * adc + 1);
+  x = ((d * LN2_Q15 + 32768) >> 16) + sh_lnR2;
+  x2 = ((int32_t)x * x) >> 15;
+
+  // 1/T in Q36
+  y = sh_a + mulhi(sh_b + mulhi(sh_c, x2), x);
+  if (y < 4096)
+    y = 4096;
+
+  // T = 2^36 / y in Q8, then to Celsius
+  t = (int32_t)(0xFFFFFFFF / (((uint32_t)y + 2048) >> 12)) - ZERO_CELSIUS_Q8;
+
+  if (cal.kind == THERM_CAL_DELTA)
+    t += (int32_t)cal.delta * 256 / 100;
+
+  return t * (1. / 256.);
+}
+
+#else
+
+float therm_convert(uint16_t adc)
+{
+#if CONFIG_THERM_EEPROM
+  if (cal.kind == THERM_CAL_SH)
+  {
+    // Same bin centering as the look-up table generation script,
+    // it also keeps us away from the divisions by zero at both ends.
+    float alpha = adc + 0.5;
+    float lnR = log(cal.R2 * (THERM_ADC_N - alpha) / alpha);
+
+    return 1. / (cal.a + cal.b * lnR + cal.c * lnR * lnR * lnR) - ZERO_CELSIUS;
+  }
+#endif
+
+  // The table has 8 bits resolution
+  float t = pgm_read_float(&(therm_lut[adc >> (THERM_ADC_BITS - 8)]));
+
+  if (cal.kind == THERM_CAL_DELTA)
+    t += cal.delta * 0.01;
+
+  return t;
+}
+
+#endif /* CONFIG_THERM */
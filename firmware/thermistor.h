@@ -0,0 +1,60 @@
+/*
+ * Thermistor conversion
+ * =====================
+ *
+ * Converts the 10-bit ADC reading of the thermistor divider into a
+ * temperature in Celsius.
+ *
+ * By default the look-up table compiled in the firmware is used. A
+ * per-device calibration record can be stored in EEPROM (see
+ * ThermistorCalibration/thermistor_calibration.py, option -e) so that
+ * the same firmware image serves every unit. The record holds either
+ *
+ *   - THERM_CAL_SH:    the Steinhart-Hart coefficients a, b, c of the
+ *                      unit's own thermistor and the value of R2, or
+ *   - THERM_CAL_DELTA: an offset, in hundredth of degree, added to the
+ *                      shared look-up table.
+ *
+ * A missing or corrupted record falls back to the shared table.
+ */
+
+#ifndef THERMISTOR_H
+#define THERMISTOR_H
+
+#include <stdint.h>
+
+#define THERM_CAL_MAGIC   0x54    // 'T'
+#define THERM_CAL_VERSION 1
+
+#define THERM_CAL_NONE    0
+#define THERM_CAL_SH      1
+#define THERM_CAL_DELTA   2
+
+// ADC resolution
+#define THERM_ADC_BITS    10
+#define THERM_ADC_N       (1 << THERM_ADC_BITS)
+
+// The record as stored in EEPROM, little endian IEEE floats.
+// The CRC is the Dallas/Maxim CRC-8 of all the preceding bytes.
+struct therm_cal
+{
+  uint8_t magic;
+  uint8_t version;
+  uint8_t kind;
+  uint8_t reserved;
+  float a;
+  float b;
+  float c;
+  float R2;
+  int16_t delta;    // in 1/100 C
+  uint8_t reserved2;
+  uint8_t crc;
+};
+
+void therm_init();
+uint8_t therm_cal_kind();
+float therm_convert(uint16_t adc);
+
+uint8_t crc8(const void *data, uint8_t len);
+
+#endif /* THERMISTOR_H */
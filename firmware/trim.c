@@ -0,0 +1,87 @@
+/*
+* ----------------------------------------------------------------------------
+* "THE BEER-WARE LICENSE" (Revision 42):
+* <fakufaku@gmail.com> wrote this file. As long as you retain this notice you
+* can do whatever you want with this stuff. If we meet some day, and you think
+* this stuff is worth it, you can buy me a beer in return -- Robin Scheibler
+* ----------------------------------------------------------------------------
+*/
+
+#include <avr/eeprom.h>
+
+#include "trim.h"
+#include "eeprom_map.h"
+
+#if CONFIG_TRIM
+
+// Both points must be this many ADC codes apart
+#define TRIM_MIN_SPAN 16
+
+struct trim trim;
+
+static void trim_identity()
+{
+  trim.gain = 1 << TRIM_SHIFT;
+  trim.offset = 1L << (TRIM_SHIFT - 1);
+}
+
+void trim_init()
+{
+  eeprom_read_block(&trim, (const void *)EE_TRIM, sizeof(trim));
+
+  if (trim.magic != TRIM_MAGIC || crc8(&trim, sizeof(trim) - 1) != trim.crc)
+    trim_identity();
+}
+
+// ADC value, with a fraction, that the conversion maps to temperature t
+static float therm_code(float t)
+{
+  uint16_t lo = 0, hi = THERM_ADC_N - 1, mid;
+  float t_lo, t_hi;
+
+  // the conversion is increasing with the ADC value
+  while (hi - lo > 1)
+  {
+    mid = (lo + hi) / 2;
+    if (therm_convert(mid) > t)
+      hi = mid;
+    else
+      lo = mid;
+  }
+
+  t_lo = therm_convert(lo);
+  t_hi = therm_convert(hi);
+  if (t_hi <= t_lo)
+    return lo;
+
+  return lo + (t - t_lo) / (t_hi - t_lo);
+}
+
+/*
+ * adc1 and adc2 are the readings, averaged, at TRIM_T1 and TRIM_T2.
+ * Returns 1 and stores the trim when it is plausible, 0 otherwise.
+ */
+uint8_t trim_compute(float adc1, float adc2)
+{
+  float code1 = therm_code(TRIM_T1);
+  float code2 = therm_code(TRIM_T2);
+  float gain;
+
+  if (adc2 - adc1 < TRIM_MIN_SPAN)
+    return 0;
+
+  gain = (code2 - code1) / (adc2 - adc1);
+  if (gain < 0.5 || gain > 2.0)
+    return 0;
+
+  trim.magic = TRIM_MAGIC;
+  trim.gain = gain * (1 << TRIM_SHIFT) + 0.5;
+  trim.offset = (code1 - gain * adc1 + 0.5) * (1L << TRIM_SHIFT);
+  trim.crc = crc8(&trim, sizeof(trim) - 1);
+
+  eeprom_update_block(&trim, (void *)EE_TRIM, sizeof(trim));
+
+  return 1;
+}
+
+#endif /* CONFIG_TRIM */
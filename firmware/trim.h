@@ -0,0 +1,71 @@
+/*
+ * Field trim
+ * ==========
+ *
+ * Two-point correction of the thermistor reading, for the offset and
+ * gain errors left by the tolerance of R2, the supply and the spread
+ * of the thermistors. It is applied to the raw ADC value, before the
+ * conversion to temperature, as one integer multiply-add:
+ *
+ *   adc' = (adc * gain + offset) >> TRIM_SHIFT
+ *
+ * The trim is captured on the unit (see field_trim() in incubalibre.c)
+ * with the thermistor held at TRIM_T1 and then at TRIM_T2, and stored
+ * in EEPROM. Without a valid record the trim is the identity.
+ */
+
+#ifndef TRIM_H
+#define TRIM_H
+
+#include <stdint.h>
+
+#include "config.h"
+#include "thermistor.h"
+
+#define TRIM_MAGIC 0x47   // 'G'
+#define TRIM_SHIFT 14     // gain in Q14
+
+// Reference temperatures of the two points: an ice bath, and a water
+// bath at the usual set point checked with a reference thermometer.
+#ifndef TRIM_T1
+#define TRIM_T1 0.0
+#endif
+#ifndef TRIM_T2
+#define TRIM_T2 37.5
+#endif
+
+// Same layout on the host, without padding
+struct trim
+{
+  int32_t offset;     // Q14, includes the rounding
+  uint16_t gain;      // Q14
+  uint8_t magic;
+  uint8_t crc;
+};
+
+#if CONFIG_TRIM
+
+extern struct trim trim;
+
+void trim_init();
+uint8_t trim_compute(float adc1, float adc2);
+
+static inline uint16_t trim_apply(uint16_t adc)
+{
+  int32_t v = ((int32_t)adc * trim.gain + trim.offset) >> TRIM_SHIFT;
+
+  if (v < 0)
+    return 0;
+  if (v > THERM_ADC_N - 1)
+    return THERM_ADC_N - 1;
+  return v;
+}
+
+#else
+
+#define trim_init()
+#define trim_apply(adc) (adc)
+
+#endif /* CONFIG_TRIM */
+
+#endif /* TRIM_H */
@@ -0,0 +1,226 @@
+/*
+* ----------------------------------------------------------------------------
+* "THE BEER-WARE LICENSE" (Revision 42):
+* <fakufaku@gmail.com> wrote this file. As long as you retain this notice you
+* can do whatever you want with this stuff. If we meet some day, and you think
+* this stuff is worth it, you can buy me a beer in return -- Robin Scheibler
+* ----------------------------------------------------------------------------
+*/
+
+#include <avr/io.h>
+#include <string.h>
+
+#include "twi.h"
+#include "params.h"
+
+#if CONFIG_TWI
+
+// what the next counter overflow is
+#define MODE_ADDRESS    0   // the address byte is in
+#define MODE_SEND       1   // our ack of the address is out, send
+#define MODE_SENT       2   // a byte is out, read the ack
+#define MODE_MASTER_ACK 3   // the ack of the master is in
+#define MODE_RECEIVE    4   // our ack is out, receive
+#define MODE_RECEIVED   5   // a byte is in
+
+// two-wire mode, waiting for a start condition
+#define USICR_IDLE ((1 << USISIE) | (1 << USIWM1) | (1 << USICS1))
+// two-wire mode, SCL held low on the counter overflow too
+#define USICR_ACTIVE ((1 << USISIE) | (1 << USIOIE) | (1 << USIWM1) \
+    | (1 << USIWM0) | (1 << USICS1))
+// flags cleared, the counter overflows after n bits (both edges count)
+#define USISR_BITS(n) ((1 << USIOIF) | (1 << USIPF) | (1 << USIDC) \
+    | (16 - 2 * (n)))
+
+// The writable registers from the parameters in use
+static void twi_load(struct twi *t)
+{
+  t->regs.id = params.id;
+  t->regs.k_p = params.k_p;
+  t->regs.k_i = params.k_i;
+  t->regs.k_d = params.k_d;
+  memcpy(t->regs.setpoints, &params.setpoints[1], sizeof(t->regs.setpoints));
+  t->regs.pwm_min = params.pwm_min;
+  t->regs.pwm_max = params.pwm_max;
+  t->regs.command = 0;
+}
+
+void twi_init(struct twi *t)
+{
+  memset(t, 0, sizeof(*t));
+  t->status.magic = TWI_MAGIC;
+  t->regs.watts = CONFIG_HEATER_WATTS;
+  t->regs.run = CONFIG_TWI_RUN;
+  twi_load(t);
+
+  // SCL is driven low by the USI only, SDA is released
+  PORTB |= (1 << TWI_SCL) | (1 << TWI_SDA);
+  DDRB |= (1 << TWI_SCL);
+  DDRB &= ~(1 << TWI_SDA);
+
+  USICR = USICR_IDLE;
+  USISR = (1 << USISIF) | USISR_BITS(8);
+}
+
+/*
+ * At the start of a control period, takes the command written by the
+ * master, returns the run register for the trimpot.
+ */
+uint8_t twi_period(struct twi *t)
+{
+  uint8_t command = t->regs.command;
+  uint8_t ok = 0;
+
+  if (command != 0)
+  {
+    params_next.id = t->regs.id;
+    params_next.k_p = t->regs.k_p;
+    params_next.k_i = t->regs.k_i;
+    params_next.k_d = t->regs.k_d;
+    memcpy(&params_next.setpoints[1], t->regs.setpoints,
+        sizeof(t->regs.setpoints));
+    params_next.pwm_min = t->regs.pwm_min;
+    params_next.pwm_max = t->regs.pwm_max;
+
+    if (command == TWI_APPLY || command == TWI_COMMIT)
+      ok = params_apply();
+    if (ok && command == TWI_COMMIT)
+      params_commit();
+
+    t->status.result = ok ? TWI_OK : TWI_REJECTED;
+    twi_load(t);
+  }
+
+  // a run out of range is off
+  if (t->regs.run > 3)
+    t->regs.run = 0;
+
+  return t->regs.run;
+}
+
+// At the end of a control period
+void twi_publish(struct twi *t, const struct control *c, uint8_t faults,
+    float set_point)
+{
+  t->status.sequence++;
+  t->status.state = c->state;
+  t->status.faults = faults;
+  t->status.temperature = c->temperature_avg;
+#if CONFIG_CONTROLLER == CONTROLLER_PID
+  t->status.iterm = c->pid.ITerm;
+#endif
+  t->status.set_point = set_point;
+  t->status.pwm_val = c->pwm_val;
+}
+
+static void send_ack()
+{
+  USIDR = 0;
+  DDRB |= (1 << TWI_SDA);
+  USISR = USISR_BITS(1);
+}
+
+static void idle()
+{
+  DDRB &= ~(1 << TWI_SDA);
+  USICR = USICR_IDLE;
+  USISR = USISR_BITS(8);
+}
+
+// Start condition
+void twi_start(struct twi *t)
+{
+  t->mode = MODE_ADDRESS;
+  DDRB &= ~(1 << TWI_SDA);
+
+  // the start completes when SCL falls, unless SDA rises first (a stop)
+  while ((PINB & (1 << TWI_SCL)) && !(PINB & (1 << TWI_SDA)))
+    ;
+
+  if (!(PINB & (1 << TWI_SDA)))
+    USICR = USICR_ACTIVE;
+  else
+    USICR = USICR_IDLE;
+
+  USISR = (1 << USISIF) | USISR_BITS(8);
+}
+
+// Counter overflow, SCL is held low until the counter is set again
+void twi_overflow(struct twi *t)
+{
+  uint8_t data = USIDR;
+
+  switch (t->mode)
+  {
+    case MODE_ADDRESS:
+      if ((data >> 1) == CONFIG_TWI_BASE + params.id && (data & 1))
+      {
+        // a consistent copy for the whole read
+        t->regs.status = t->status;
+#if CONFIG_ENERGY
+        t->regs.energy = energy.count;
+#endif
+        t->mode = MODE_SEND;
+      }
+      else if ((data >> 1) == CONFIG_TWI_BASE + params.id || data == 0)
+      {
+        t->first = 1;
+        t->mode = MODE_RECEIVE;
+      }
+      else
+      {
+        idle();
+        break;
+      }
+      send_ack();
+      break;
+
+    case MODE_MASTER_ACK:
+      // a nack ends the read
+      if (data)
+      {
+        idle();
+        break;
+      }
+      // fall through
+    case MODE_SEND:
+      USIDR = t->pointer < TWI_SIZE
+        ? ((uint8_t *)&t->regs)[t->pointer] : 0xFF;
+      t->pointer++;
+      DDRB |= (1 << TWI_SDA);
+      USISR = USISR_BITS(8);
+      t->mode = MODE_SENT;
+      break;
+
+    case MODE_SENT:
+      DDRB &= ~(1 << TWI_SDA);
+      USIDR = 0;
+      USISR = USISR_BITS(1);
+      t->mode = MODE_MASTER_ACK;
+      break;
+
+    case MODE_RECEIVE:
+      DDRB &= ~(1 << TWI_SDA);
+      USISR = USISR_BITS(8);
+      t->mode = MODE_RECEIVED;
+      break;
+
+    case MODE_RECEIVED:
+      if (t->first)
+      {
+        t->pointer = data;
+        t->first = 0;
+      }
+      else
+      {
+        if (t->pointer >= TWI_WRITABLE && t->pointer < TWI_WRITABLE_END)
+          ((uint8_t *)&t->regs)[t->pointer] = data;
+        t->pointer++;
+      }
+      send_ack();
+      t->mode = MODE_RECEIVE;
+      break;
+  }
+}
+
+#endif /* CONFIG_TWI */
@@ -0,0 +1,138 @@
+/*
+ * I2C slave
+ * =========
+ *
+ * With CONFIG_TWI, a unit is an I2C slave on the USI, at the address
+ * CONFIG_TWI_BASE + its id (params.h), so that one host can supervise
+ * many units on one bus. SDA is PB0, SCL is PB2.
+ *
+ * A write sets the register pointer with its first byte and writes the
+ * registers from there, a read returns the registers from the pointer.
+ * The pointer moves on with each byte; past the map, reads return 0xFF
+ * and writes are ignored. The floats are IEEE 754, little endian, as
+ * in the memory of the AVR.
+ *
+ *   0x00  magic      TWI_MAGIC                                    r
+ *   0x01  sequence   counts the control periods                   r
+ *   0x02  state      PWM_ON or PWM_OFF (control.h)                r
+ *   0x03  faults     sensor fault | protect fault << 4            r
+ *   0x04  temperature   filtered, C (float)                       r
+ *   0x08  iterm      integral term of the PID (float)             r
+ *   0x0C  set_point  C (float)                                    r
+ *   0x10  pwm_val    duty cycle of the period                     r
+ *   0x11  result     of the last command, TWI_OK or TWI_REJECTED  r
+ *   0x14  k_p, k_i, k_d (floats)                                  rw
+ *   0x20  sp1, sp2, sp3 (floats)                                  rw
+ *   0x2C  run        set point 1 to 3, 0 for off, as the trimpot  rw
+ *   0x2D  id         address - CONFIG_TWI_BASE                    rw
+ *   0x2E  pwm_min, pwm_max                                        rw
+ *   0x30  command    TWI_APPLY or TWI_COMMIT                      rw
+ *   0x34  heater1, heater2, heater3  time on at the set points,
+ *                    counts of ENERGY_UNIT (uint32, energy.h)     r
+ *   0x40  switches   closings of the relay (uint32)               r
+ *   0x44  watts      CONFIG_HEATER_WATTS (uint16)                 r
+ *
+ * The read only registers are the ones of the last control period,
+ * copied when a read is addressed: a read in one transaction is never
+ * torn by a control period. The energy counters read 0 without
+ * CONFIG_ENERGY.
+ *
+ * run is taken at each control period. The other writable registers
+ * are taken together when command is written, at the next control
+ * period: TWI_APPLY checks them and runs with them, TWI_COMMIT also
+ * stores them in EEPROM. command is the last writable register, a
+ * block write of the whole map ends with it. It reads back as 0 once taken, and
+ * the writable registers then read back as the parameters in use.
+ *
+ * A general call (address 0) writes to every unit at once.
+ *
+ * The USI holds SCL low while the interrupts run, the bus waits for a
+ * unit busy in the compare match interrupt. TIMER1 runs on, the
+ * interrupts only delay the compare match by a few tens of cycles.
+ */
+
+#ifndef TWI_H
+#define TWI_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "control.h"
+#include "energy.h"
+
+#define TWI_SDA PB0
+#define TWI_SCL PB2
+
+#define TWI_MAGIC 0x1C
+
+// results
+#define TWI_OK       1
+#define TWI_REJECTED 2
+
+// commands
+#define TWI_APPLY  1
+#define TWI_COMMIT 2
+
+struct twi_status
+{
+  uint8_t magic;
+  uint8_t sequence;
+  uint8_t state;
+  uint8_t faults;
+  float temperature;
+  float iterm;
+  float set_point;
+  uint8_t pwm_val;
+  uint8_t result;
+  uint8_t reserved[2];      // the floats after are aligned on the host
+};
+
+// the register map, same layout on the host
+struct twi_regs
+{
+  struct twi_status status;
+  float k_p, k_i, k_d;
+  float setpoints[3];
+  uint8_t run;
+  uint8_t id;
+  uint8_t pwm_min, pwm_max;
+  uint8_t command;
+  uint8_t reserved[3];      // the counters after are aligned on the host
+  struct energy_record energy;
+  uint16_t watts;
+};
+
+// the writable registers, and the end of the map
+#define TWI_WRITABLE sizeof(struct twi_status)
+#define TWI_WRITABLE_END (offsetof(struct twi_regs, command) + 1)
+#define TWI_SIZE (offsetof(struct twi_regs, watts) + 2)
+
+struct twi
+{
+  struct twi_regs regs;
+  struct twi_status status;   // of the last control period
+  uint8_t mode;               // of the USI, what the next overflow is
+  uint8_t pointer;
+  uint8_t first;              // the next byte written is the pointer
+};
+
+#if CONFIG_TWI
+
+void twi_init(struct twi *t);
+uint8_t twi_period(struct twi *t);
+void twi_publish(struct twi *t, const struct control *c, uint8_t faults,
+    float set_point);
+
+// the USI interrupts
+void twi_start(struct twi *t);
+void twi_overflow(struct twi *t);
+
+#else
+
+#define twi_init(t)
+#define twi_publish(t, c, faults, set_point)
+
+#endif /* CONFIG_TWI */
+
+#endif /* TWI_H */